@@ -7,24 +7,69 @@
 #include <assert.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include <SDL2/SDL.h>
 #include <vulkan/vulkan.h>
 
-#define LOG_INFO    0
-#define LOG_WARNING 1
-#define LOG_ERROR   2
+#define LOG_DEBUG   0
+#define LOG_INFO    1
+#define LOG_WARNING 2
+#define LOG_ERROR   3
+
+/** levels below this are compiled out, e.g. -DVK_LOG_MIN_LEVEL=LOG_WARNING **/
+#ifndef VK_LOG_MIN_LEVEL
+#define VK_LOG_MIN_LEVEL LOG_INFO
+#endif
 
-#define VK_CHECK(expr)      {assert(expr == VK_SUCCESS);}
-#define SDL_CHECK(expr)     {assert(expr == SDL_TRUE);}
 #define VK_CLAMP(v, bound)  (((v) > (bound)) ? (bound): (v))
+/** one log record as handed to the sink, category is a string literal **/
+typedef struct VK_LOG_RECORD {
+    uint64_t    time;     // vk_get_time_ns when the record was written
+    int         level;
+    uint32_t    thread;   // logging threads are numbered from 1 in the order they first log
+    const char *category;
+    const char *message;
+} VK_LOG_RECORD;
+
+typedef void (*VK_LOG_CALLBACK)(const VK_LOG_RECORD *record, void *user_data);
+
+extern void vk_log_write
+(
+    int level,
+    const char *category,
+    const char *format,
+    ...
+) __attribute__((format(printf, 3, 4)));
+
+/** formatted logging with a category tag, disabled levels compile to nothing **/
+#define VK_LOGF(level, category, ...)                                           \
+    do {                                                                        \
+        if ((level) >= VK_LOG_MIN_LEVEL)                                        \
+            vk_log_write((level), (category), __VA_ARGS__);                     \
+    } while(0)
 /** basic logging macro **/
-#define VK_LOG(level, msg)                                                      \
+#define VK_LOG(level, msg) VK_LOGF((level), "vk", "%s", (msg))
+
+/** the call is evaluated in every build, including NDEBUG ones, and a failure aborts **/
+#define VK_CHECK(expr)                                                          \
+    do {                                                                        \
+        VkResult vk_check_result = (expr);                                      \
+        if (vk_check_result != VK_SUCCESS) {                                    \
+            VK_LOGF(LOG_ERROR, "vk", "%s failed with VkResult %d (%s:%d)",      \
+                    #expr, vk_check_result, __FILE__, __LINE__);                \
+            abort();                                                            \
+        }                                                                       \
+    } while(0)
+#define SDL_CHECK(expr)                                                         \
     do {                                                                        \
-        switch ((level)) {                                                      \
-            case 0:  fprintf(stderr, "[INFO]: %s\n", (msg)); break;             \
-            case 1:  fprintf(stderr, "[WARNING]: %s\n", (msg)); break;          \
-            case 2:  fprintf(stderr, "[ERROR]: %s\n", (msg)); break;            \
+        SDL_bool sdl_check_result = (expr);                                     \
+        if (sdl_check_result != SDL_TRUE) {                                     \
+            VK_LOGF(LOG_ERROR, "sdl", "%s failed: %s (%s:%d)",                  \
+                    #expr, SDL_GetError(), __FILE__, __LINE__);                 \
+            abort();                                                            \
         }                                                                       \
     } while(0)
 /** takes filename, extension name and length for each along with result variable **
@@ -41,6 +86,26 @@
         result = !strncmp(&(filename)[nameindex], filetype, typesize);          \
     } while(0)
 
+/** monotonic clock in nanoseconds, used for timing the creation stages **/
+static inline uint64_t vk_get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/** 64 bit FNV-1a, keys the shader and object caches and checksums the pipeline cache file **/
+static inline uint64_t vk_fnv1a(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 enum VK_QUEUE_FAMILIES_ENUM {
     GRAPHICS       = 0x00,
     COMPUTE        = 0x01,
@@ -49,9 +114,15 @@ enum VK_QUEUE_FAMILIES_ENUM {
     PRESENT        = 0x04
 };
 
+/** most queues created for a single role */
+#define VK_MAX_QUEUES_PER_ROLE 16
+
 typedef struct VK_SUPPORTED_QUEUE_FAMILIES {
     bool     found[5];
     uint32_t indicies[5];
+    uint32_t family_queue_counts[5]; // queues exposed by the family of each role
+    uint32_t first_queue[5];         // index in the family of the first queue of each role
+    uint32_t queue_count[5];         // queues created for each role
 } VK_SUPPORTED_QUEUE_FAMILIES;
 
 typedef struct VK_SWAPCHAIN_SUPPORT_DETAILS {
@@ -70,10 +141,42 @@ typedef struct VK_DEVICE_SPECIFICATION {
     // VK Device Features - if value is true then feature is checked
     VkPhysicalDeviceFeatures device_features;
 
+    // pNext chain of Vulkan 1.1+ feature structs, e.g. VkPhysicalDeviceVulkan12Features,
+    // members set to VK_TRUE are required and the chain is enabled on the logical device
+    void *features_chain;
+
     // VK Queues required by the user
     bool specified_queues[5];
+
+    // queue allocation policy, roles get dedicated families unless shared is set
+    bool         shared_queues;
+    uint32_t     queue_counts[5];     // queues per role, 0 means 1, limited by the family
+    const float *queue_priorities[5]; // queue_counts priorities per role, NULL means 1.0
+
+    // if true every suitable device is scored and the best is selected, otherwise the first is
+    bool scored;
+    // score added per device type, indexed by VkPhysicalDeviceType, defaults are used if all are zero
+    uint32_t type_scores[5];
+
+    // pin a device by a substring of its name or by its VkPhysicalDeviceIDProperties deviceUUID, skips scoring
+    // pinning by UUID needs a Vulkan 1.1 instance and device
+    const char *device_name;
+    bool        pin_uuid;
+    uint8_t     device_uuid[VK_UUID_SIZE];
 } VK_DEVICE_SPECIFICATION;
 
+/** score breakdown of a device that passed the filters of vk_select_physical_device */
+typedef struct VK_DEVICE_SCORE {
+    char                 name[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+    VkPhysicalDeviceType type;
+    VkDeviceSize         device_local_bytes;
+    uint32_t             max_compute_invocations;
+    bool                 dedicated_compute;  // a compute family without graphics
+    bool                 dedicated_transfer; // a transfer family without graphics or compute
+    uint64_t             score;
+    bool                 selected;
+} VK_DEVICE_SCORE;
+
 typedef struct VK_ATTACHMENT_DESCRIPTION_SPECIFICATION {
     VkAttachmentDescriptionFlags flags;
     VkFormat                     format;
@@ -110,6 +213,28 @@ typedef struct VK_SUBPASS_SPECIFICATION {
     VkAttachmentReference*    depth_stencil_attchments;
 } VK_SUBPASS_SPECIFICATION;
 
+typedef struct VK_SUBPASS_DEPENDENCY_SPECIFICATION {
+    uint32_t             src_subpass;
+    uint32_t             dst_subpass;
+    VkPipelineStageFlags src_stage_mask;
+    VkPipelineStageFlags dst_stage_mask;
+    VkAccessFlags        src_access_mask;
+    VkAccessFlags        dst_access_mask;
+    VkDependencyFlags    dependency_flags;
+} VK_SUBPASS_DEPENDENCY_SPECIFICATION;
+
+/**
+ * specialization constants of one shader stage, map_entries point into data.
+ * the values are part of the create info, so the pipeline cache keys variants of one SPIR-V file apart.
+ */
+typedef struct VK_SPECIALIZATION_SPECIFICATION {
+    VkShaderStageFlagBits     stage;
+    uint32_t                  map_entries_count;
+    VkSpecializationMapEntry *map_entries;
+    size_t                    data_size;
+    void                     *data;
+} VK_SPECIALIZATION_SPECIFICATION;
+
 typedef struct VK_PIPELINE_SPECIFICATION {
     /** vertex input create info specs */
     uint32_t                           vertex_binding_descriptions_count;
@@ -132,6 +257,9 @@ typedef struct VK_PIPELINE_SPECIFICATION {
     /** scissor specs */
     VkRect2D scissor;
 
+    /** if true viewport and scissor are set with vkCmdSetViewport/vkCmdSetScissor and survive resizes */
+    VkBool32 dynamic_viewport;
+
     /** rasterizer specs */
     VkBool32        depth_clamp_enable;
     VkBool32        rasterizer_discard_enable;
@@ -165,21 +293,731 @@ typedef struct VK_PIPELINE_SPECIFICATION {
     VkAttachmentDescription *attachment_descriptions;
     uint32_t                 subpass_descriptions_count;
     VkSubpassDescription    *subpass_descriptions;
+    uint32_t                 subpass_dependencies_count;
+    VkSubpassDependency     *subpass_dependencies;
+
+    /** shader files, used by vk_create_pipeline_table */
+    uint32_t                 shader_files_count;
+    const char             **shader_files;
+
+    /** at most one per stage, filled by vk_create_specialization_constant */
+    uint32_t                         specializations_count;
+    VK_SPECIALIZATION_SPECIFICATION *specializations;
+
+    /** pipeline layout, set layouts from vk_get_descriptor_set_layout */
+    uint32_t                 descriptor_set_layouts_count;
+    VkDescriptorSetLayout   *descriptor_set_layouts;
+    uint32_t                 push_constant_ranges_count;
+    VkPushConstantRange     *push_constant_ranges;
     
 } VK_PIPELINE_SPECIFICATION;
 
+/** vertex, tessellation control, tessellation evaluation, geometry and fragment */
+#define VK_PIPELINE_MAX_STAGES 5
+
+/** everything vkCreateGraphicsPipelines reads for one specification, create_info points into it */
+typedef struct VK_PIPELINE_STATE {
+    uint32_t                               stages_count;
+    VkShaderModule                         shader_modules[VK_PIPELINE_MAX_STAGES];
+    VkPipelineShaderStageCreateInfo        stages[VK_PIPELINE_MAX_STAGES];
+    VkSpecializationInfo                   specializations[VK_PIPELINE_MAX_STAGES];
+    VkPipelineVertexInputStateCreateInfo   vertex_input;
+    VkPipelineInputAssemblyStateCreateInfo input_assembly;
+    VkViewport                             viewport;
+    VkRect2D                               scissor;
+    VkPipelineViewportStateCreateInfo      viewport_state;
+    VkPipelineRasterizationStateCreateInfo rasterization;
+    VkPipelineMultisampleStateCreateInfo   multisample;
+    VkPipelineColorBlendStateCreateInfo    color_blend;
+    VkDynamicState                         dynamic_states[2];
+    VkPipelineDynamicStateCreateInfo       dynamic_state;
+    VkPipelineLayout                       layout;
+    VkRenderPass                           render_pass;
+    VkGraphicsPipelineCreateInfo           create_info;
+} VK_PIPELINE_STATE;
+
+/** pipelines created together, index i belongs to specification i */
+typedef struct VK_PIPELINE_TABLE {
+    uint32_t          pipelines_count;
+    VkPipeline       *pipelines;
+    VkPipelineLayout *layouts;
+    VkRenderPass     *render_passes;
+} VK_PIPELINE_TABLE;
+
+/** specifications per vkCreateGraphicsPipelines call when building a pipeline table */
+#define VK_PIPELINE_BATCH_SIZE 16
+
+typedef struct VK_COMPUTE_PIPELINE_SPECIFICATION {
+    /** pipeline layout */
+    uint32_t               descriptor_set_layouts_count;
+    VkDescriptorSetLayout *descriptor_set_layouts;
+    uint32_t               push_constant_ranges_count;
+    VkPushConstantRange   *push_constant_ranges;
+
+    /** NULL when the shader has no specialization constants */
+    const VK_SPECIALIZATION_SPECIFICATION *specialization;
+} VK_COMPUTE_PIPELINE_SPECIFICATION;
+
+typedef struct VK_COMPUTE_PIPELINE {
+    VkPipeline       pipeline;
+    VkPipelineLayout layout;
+} VK_COMPUTE_PIPELINE;
+
+/** number of compute submissions that can be in flight at once */
+#define VK_COMPUTE_BATCHES 4
+
+typedef struct VK_COMPUTE_BATCH {
+    VkCommandBuffer command_buffer;
+    VkFence         fence;
+    VkSemaphore     semaphore;       // signaled for the graphics queue when requested
+    uint32_t        dispatch_count;  // dispatches recorded since the batch began
+    bool            recording;
+    bool            submitted;
+} VK_COMPUTE_BATCH;
+
+typedef struct VK_COMPUTE {
+    VkCommandPool    command_pool;
+    VkQueue          queue;
+    uint32_t         family;
+    uint32_t         current_batch;
+    VK_COMPUTE_BATCH batches[VK_COMPUTE_BATCHES];
+} VK_COMPUTE;
+
+typedef struct VK_SHADER_CACHE_ENTRY {
+    uint64_t        hash;      // FNV-1a of the SPIR-V words
+    size_t          size;
+    const uint32_t *code;      // the file's mapping, compared on a hit so a hash collision never shares a module
+    VkShaderModule  module;
+    uint32_t        references;
+} VK_SHADER_CACHE_ENTRY;
+
+typedef struct VK_SHADER_CACHE {
+    pthread_mutex_t        lock;
+    bool                   enabled;
+    uint32_t               entries_count;
+    uint32_t               entries_capacity;
+    VK_SHADER_CACHE_ENTRY *entries;
+    uint32_t               hits;
+    uint32_t               misses;
+} VK_SHADER_CACHE;
+
+typedef struct VK_PIPELINE_CACHE_DETAILS {
+    const char *filename;       // file the cache is loaded from and written back to
+    bool        warm;           // true if a valid blob was loaded from the file
+    uint64_t    load_time;      // ns spent reading and validating the file
+    uint64_t    pipeline_time;  // ns spent in vkCreateGraphicsPipelines since load
+    uint32_t    pipeline_count; // pipelines created since load
+} VK_PIPELINE_CACHE_DETAILS;
+
+/** core descriptor types, VK_DESCRIPTOR_TYPE_SAMPLER to VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT */
+#define VK_DESCRIPTOR_TYPES          11
+/** sets the first pool of an allocator holds, each further pool doubles up to the max */
+#define VK_DESCRIPTOR_POOL_SETS      64
+#define VK_DESCRIPTOR_POOL_MAX_SETS  4096
+
+enum VK_CACHED_OBJECT_ENUM {
+    VK_CACHED_DESCRIPTOR_SET_LAYOUT = 0x00,
+    VK_CACHED_PIPELINE_LAYOUT       = 0x01,
+    VK_CACHED_RENDER_PASS           = 0x02
+};
+
+/** an object shared by every equal description, key is the description flattened without pointers */
+typedef struct VK_OBJECT_CACHE_ENTRY {
+    uint32_t  type;        // VK_CACHED_OBJECT_ENUM
+    uint64_t  hash;        // FNV-1a of key
+    uint64_t  handle_hash; // FNV-1a of the handle plus type, for release and counts lookups
+    size_t    key_size;
+    uint8_t  *key;
+    bool      unique;     // described with a pNext chain, never shared
+    uint32_t  references;
+    union {
+        VkDescriptorSetLayout descriptor_set_layout;
+        VkPipelineLayout      pipeline_layout;
+        VkRenderPass          render_pass;
+    };
+    /** descriptors of each type a set uses, descriptor set layouts only */
+    uint32_t  descriptor_counts[VK_DESCRIPTOR_TYPES];
+
+    struct VK_OBJECT_CACHE_ENTRY *next_by_key;
+    struct VK_OBJECT_CACHE_ENTRY *next_by_handle;
+} VK_OBJECT_CACHE_ENTRY;
+
+/** every entry is chained into two tables of buckets_count buckets, one by key hash and one by handle */
+typedef struct VK_OBJECT_CACHE {
+    uint32_t                entries_count;
+    uint32_t                buckets_count; // power of two, grown to stay above entries_count
+    VK_OBJECT_CACHE_ENTRY **key_buckets;
+    VK_OBJECT_CACHE_ENTRY **handle_buckets;
+    uint32_t               hits;
+    uint32_t               misses;
+} VK_OBJECT_CACHE;
+
+/**
+ * sets are never freed one by one, the whole allocator is reset at once.
+ * pools are sized from the sets allocated since the last reset, so after a few resets one pool fits a frame.
+ */
+typedef struct VK_DESCRIPTOR_ALLOCATOR {
+    uint32_t          pools_count;
+    uint32_t          pools_capacity;
+    VkDescriptorPool *pools;                       // the last pool is allocated from, the others are full
+    uint32_t          pool_sets;                   // sets the last pool was sized for
+    uint32_t          sets;                        // sets allocated since the last reset
+    uint32_t          counts[VK_DESCRIPTOR_TYPES]; // descriptors allocated since the last reset
+} VK_DESCRIPTOR_ALLOCATOR;
+
+typedef struct VK_FRAME {
+    VkCommandBuffer command_buffer;
+    VkFence         in_flight;       // signaled when the GPU has finished the frame
+    VkSemaphore     image_available; // signaled when the swapchain image can be rendered to
+    uint64_t        wait_time;       // ns the CPU waited on fences the last time the frame began
+
+    /** extra semaphores the frame submission waits on and signals, cleared after every submit */
+    uint32_t              wait_semaphores_count;
+    uint32_t              wait_semaphores_capacity;
+    VkSemaphore          *wait_semaphores;
+    VkPipelineStageFlags *wait_stages;
+    uint32_t              signal_semaphores_count;
+    uint32_t              signal_semaphores_capacity;
+    VkSemaphore          *signal_semaphores;
+
+    /** sets for this frame only, reset when the frame begins again */
+    VK_DESCRIPTOR_ALLOCATOR descriptors;
+} VK_FRAME;
+
+/** smallest buddy a block is split into and the default block size */
+#define VK_ALLOCATOR_MIN_SIZE       256ull
+#define VK_ALLOCATOR_BLOCK_SIZE     (128ull * 1024 * 1024)
+
+typedef struct VK_ALLOCATION {
+    VkDeviceMemory memory;
+    VkDeviceSize   offset;
+    VkDeviceSize   size;        // size requested by the caller
+    void          *mapped;      // host pointer to offset if the memory is host visible, else NULL
+    uint32_t       memory_type;
+    int32_t        block;       // index of the owning block, -1 for dedicated allocations
+    uint32_t       order;       // buddy order, allocated size is VK_ALLOCATOR_MIN_SIZE << order
+} VK_ALLOCATION;
+
+typedef struct VK_BUFFER {
+    VkBuffer      buffer;
+    VK_ALLOCATION allocation;
+} VK_BUFFER;
+
+typedef struct VK_IMAGE {
+    VkImage       image;
+    VK_ALLOCATION allocation;
+} VK_IMAGE;
+
+typedef struct VK_MEMORY_BLOCK {
+    VkDeviceMemory memory;
+    uint32_t       memory_type;
+    void          *mapped;
+    VkDeviceSize   used;
+    uint8_t       *tree; // buddy tree, each node holds order + 1 of the largest free buddy below it
+} VK_MEMORY_BLOCK;
+
+typedef struct VK_ALLOCATOR_STATISTICS {
+    uint64_t     allocation_count;  // live sub-allocations
+    uint64_t     dedicated_count;   // live dedicated allocations
+    uint64_t     block_count;
+    uint64_t     total_allocations; // allocations made since creation
+    uint64_t     total_frees;       // frees made since creation
+    VkDeviceSize block_bytes;       // device memory held by blocks
+    VkDeviceSize dedicated_bytes;   // device memory held by dedicated allocations
+    VkDeviceSize used_bytes;        // block memory handed out, including buddy rounding
+    VkDeviceSize requested_bytes;   // block memory requested by callers
+    VkDeviceSize largest_free;      // largest free buddy in any block
+    float        fragmentation;     // 1 - sum of per block largest free / free bytes
+} VK_ALLOCATOR_STATISTICS;
+
+typedef struct VK_ALLOCATOR {
+    pthread_mutex_t                  lock;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VkDeviceSize                     block_size;
+    VkDeviceSize                     granularity; // bufferImageGranularity
+    uint32_t                         max_order;
+    uint32_t                         blocks_count;
+    VK_MEMORY_BLOCK                 *blocks;
+    VK_ALLOCATOR_STATISTICS          statistics;
+} VK_ALLOCATOR;
+
+/** number of transfer submissions that can be in flight at once */
+#define VK_UPLOAD_BATCHES 4
+
+typedef struct VK_UPLOAD_BATCH {
+    VkCommandBuffer command_buffer;
+    VkFence         fence;             // VK_NULL_HANDLE when the scheduler tracks the batch
+    uint64_t        value;             // scheduler counter value of the submission
+    VkSemaphore     semaphore;         // signaled by the submission for the graphics queue to wait on
+    VkDeviceSize    ring_bytes;        // staging bytes used by the batch, released when it retires
+    bool            recording;
+    bool            submitted;
+    bool            semaphore_pending; // signaled but not yet handed to a waiting submission
+} VK_UPLOAD_BATCH;
+
+/** a batch semaphore handed to a frame by vk_upload_acquire */
+typedef struct VK_UPLOAD_HANDED_SEMAPHORE {
+    VkSemaphore semaphore;
+    uint64_t    frame_serial; // of the frame that waits on it, reusable once that frame completes
+} VK_UPLOAD_HANDED_SEMAPHORE;
+
+typedef struct VK_UPLOADER {
+    pthread_mutex_t lock;
+    VK_BUFFER       staging;       // persistently mapped ring buffer
+    VkDeviceSize    size;
+    VkDeviceSize    head;          // next free byte of the ring
+    VkDeviceSize    used;          // bytes between the oldest in flight batch and head
+    VkCommandPool   command_pool;
+    VkQueue         queue;
+    uint32_t        role;          // GRAPHICS or TRANSFER
+    uint32_t        family;        // queue family the copies run on
+    uint32_t        graphics_family;
+    bool            scheduled;     // batches are submitted through the scheduler and complete on its counters
+    uint32_t        current_batch;
+    VK_UPLOAD_BATCH batches[VK_UPLOAD_BATCHES];
+
+    /** acquire halves of queue family ownership transfers, recorded on the graphics queue */
+    uint32_t               buffer_barriers_count;
+    uint32_t               buffer_barriers_capacity;
+    VkBufferMemoryBarrier *buffer_barriers;
+    uint32_t               image_barriers_count;
+    uint32_t               image_barriers_capacity;
+    VkImageMemoryBarrier  *image_barriers;
+
+    /** the frame only waits once it is submitted, so handed semaphores leave their slot until it completes */
+    uint32_t                    handed_count;
+    uint32_t                    handed_capacity;
+    VK_UPLOAD_HANDED_SEMAPHORE *handed;
+} VK_UPLOADER;
+
+/** queues driven by the scheduler, indexed by GRAPHICS, COMPUTE and TRANSFER */
+#define VK_SCHEDULER_QUEUES    3
+#define VK_SCHEDULER_MAX_WAITS 4
+
+typedef struct VK_SCHEDULER_WAIT {
+    uint32_t             role;  // queue waited on
+    uint64_t             value; // returned by vk_scheduler_submit on that queue
+    VkPipelineStageFlags stage; // stages of the waiting work that depend on it
+} VK_SCHEDULER_WAIT;
+
+typedef struct VK_SCHEDULER_SUBMISSION {
+    uint32_t          role;
+    uint64_t          value;
+    VkCommandBuffer   command_buffer; // VK_NULL_HANDLE only waits and signals
+    VkSemaphore       signal;         // binary semaphore for work outside the scheduler, e.g. a frame, or VK_NULL_HANDLE
+    uint32_t          waits_count;
+    VK_SCHEDULER_WAIT waits[VK_SCHEDULER_MAX_WAITS];
+} VK_SCHEDULER_SUBMISSION;
+
+/** fence emulation of a timeline, signaled once every value up to value has completed */
+typedef struct VK_SCHEDULER_FENCE {
+    uint64_t     value;
+    VkFence      fence;
+    uint32_t     semaphores_count; // binary semaphores waited on by the submission, recycled with the fence
+    VkSemaphore *semaphores;
+} VK_SCHEDULER_FENCE;
+
+typedef struct VK_SCHEDULER_QUEUE {
+    VkQueue             queue;
+    VkSemaphore         timeline;
+    uint64_t            next_value;      // last value handed out
+    uint64_t            submitted_value; // last value passed to vkQueueSubmit
+    uint64_t            completed_value; // last value seen completed
+    uint32_t            fences_count;
+    uint32_t            fences_capacity;
+    VK_SCHEDULER_FENCE *fences;          // in flight, oldest first
+} VK_SCHEDULER_QUEUE;
+
+typedef struct VK_SCHEDULER {
+    pthread_mutex_t                lock;
+    bool                           enabled;
+    bool                           timeline; // false emulates the counters with fences and binary semaphores
+    PFN_vkWaitSemaphores           wait_semaphores;
+    PFN_vkGetSemaphoreCounterValue get_semaphore_counter_value;
+    VK_SCHEDULER_QUEUE             queues[VK_SCHEDULER_QUEUES];
+
+    /** submissions not yet flushed, in submission order across all queues */
+    uint32_t                 pending_count;
+    uint32_t                 pending_capacity;
+    VK_SCHEDULER_SUBMISSION *pending;
+
+    /** recycled emulation objects */
+    uint32_t     free_fences_count;
+    uint32_t     free_fences_capacity;
+    VkFence     *free_fences;
+    uint32_t     free_semaphores_count;
+    uint32_t     free_semaphores_capacity;
+    VkSemaphore *free_semaphores;
+
+    uint32_t submit_calls; // vkQueueSubmit calls made by flushes
+    uint32_t submissions;  // work items submitted
+} VK_SCHEDULER;
+
+/** scopes recorded per frame and how deep they nest, each GPU scope uses two timestamp queries */
+#define VK_PROFILE_MAX_SCOPES 64
+#define VK_PROFILE_MAX_DEPTH  16
+
+typedef struct VK_PROFILE_SCOPE {
+    const char *name;      // must live until the frame is read back, usually a literal
+    uint32_t    depth;     // 0 for outermost scopes
+    bool        gpu;       // timestamps were written and read back
+    uint32_t    query;     // first of the two timestamp queries of a GPU scope
+    uint64_t    cpu_begin; // ns, vk_get_time_ns
+    uint64_t    cpu_end;
+    uint64_t    gpu_begin; // ns in the device timestamp domain
+    uint64_t    gpu_end;
+} VK_PROFILE_SCOPE;
+
+typedef struct VK_PROFILE_FRAME {
+    uint64_t         frame_serial;  // frames submitted before this one was recorded
+    uint32_t         queries_count;
+    uint32_t         scopes_count;
+    VK_PROFILE_SCOPE scopes[VK_PROFILE_MAX_SCOPES];
+} VK_PROFILE_FRAME;
+
+typedef struct VK_PROFILER {
+    bool              enabled;
+    bool              timestamps;       // false if the graphics family has no timestampValidBits
+    VkQueryPool       query_pool;       // VK_PROFILE_MAX_SCOPES * 2 queries per frame in flight
+    float             timestamp_period; // ns per timestamp tick
+    uint64_t          timestamp_mask;
+    uint32_t          frames_count;
+    VK_PROFILE_FRAME *frames;           // one per frame in flight, read back when the frame comes around again
+    VK_PROFILE_FRAME  results;          // newest frame read back
+    uint32_t          stack_count;
+    uint32_t          stack[VK_PROFILE_MAX_DEPTH];
+
+    /** Chrome trace event output */
+    FILE    *trace;
+    uint32_t trace_events;
+    uint64_t trace_origin;   // CPU ns the trace starts at
+    bool     gpu_aligned;
+    int64_t  gpu_offset;     // added to GPU ns to line them up with the CPU clock
+} VK_PROFILER;
+
+/** workers the recorder runs, counting the thread that calls vk_record_secondary */
+#define VK_RECORDER_MAX_THREADS 64
+/** secondary buffers allocated at a time when a pool runs out */
+#define VK_RECORDER_BUFFER_BATCH 8
+
+struct VK_CONTEXT;
+
+/** records chunk of the work into command_buffer, called on a worker thread */
+typedef void (*VK_RECORD_CALLBACK)(struct VK_CONTEXT *context, VkCommandBuffer command_buffer, uint32_t chunk, void *user_data);
+
+/** secondary buffers of one thread in one frame in flight, the pool is only touched by that thread */
+typedef struct VK_RECORDER_POOL {
+    VkCommandPool    command_pool;
+    uint32_t         buffers_count;
+    uint32_t         buffers_used;  // handed out since the pool was last reset
+    VkCommandBuffer *buffers;
+} VK_RECORDER_POOL;
+
+typedef struct VK_RECORDER_WORKER {
+    struct VK_CONTEXT *context;
+    uint32_t           index;     // selects the worker's pool in each frame
+    pthread_t          thread;
+} VK_RECORDER_WORKER;
+
+typedef struct VK_RECORDER {
+    bool                enabled;
+    uint32_t            threads_count;
+    uint32_t            frames_count;
+    VK_RECORDER_WORKER *workers;     // workers[0] is the calling thread and never started
+    VK_RECORDER_POOL   *pools;       // frames_count * threads_count, frame major
+
+    pthread_mutex_t     lock;
+    pthread_cond_t      work;        // a job was posted or the recorder shuts down
+    pthread_cond_t      done;        // the last chunk of the job finished
+    uint64_t            generation;  // jobs posted so far
+    bool                shutdown;
+
+    /** the job being recorded */
+    VK_RECORD_CALLBACK             callback;
+    void                          *user_data;
+    VkCommandBufferInheritanceInfo inheritance;
+    uint32_t                       chunks_count;
+    uint32_t                       next_chunk;
+    uint32_t                       chunks_done;
+    uint32_t                       chunk_buffers_capacity;
+    VkCommandBuffer               *chunk_buffers;  // in chunk order, executed in that order
+} VK_RECORDER;
+
+/** workers of the job system, counting the thread that created it */
+#define VK_JOB_MAX_THREADS 64
+
+typedef void (*VK_JOB_FUNCTION)(void *data);
+
+/**
+ * counts unfinished jobs, a counter reaching zero releases the jobs submitted after it.
+ * zero initialise before the first submit, it may be reused once it is back at zero.
+ */
+typedef struct VK_JOB_COUNTER {
+    atomic_uint         pending;
+    struct VK_JOB_NODE *dependents; // jobs waiting for pending to reach zero, guarded by the system's dependency lock
+} VK_JOB_COUNTER;
+
+typedef struct VK_JOB {
+    VK_JOB_FUNCTION function;
+    void           *data;
+    VK_JOB_COUNTER *counter;       // decremented once the job has run, may be NULL
+} VK_JOB;
+
+typedef struct VK_JOB_NODE {
+    VK_JOB              job;
+    struct VK_JOB_NODE *next;
+} VK_JOB_NODE;
+
+/** ring of jobs, the owner pushes and pops at the back and thieves steal from the front */
+typedef struct VK_JOB_DEQUE {
+    pthread_mutex_t lock;
+    uint32_t        front;
+    uint32_t        count;
+    uint32_t        capacity;       // power of two
+    VK_JOB         *jobs;
+} VK_JOB_DEQUE;
+
+typedef struct VK_JOB_WORKER {
+    struct VK_JOB_SYSTEM *system;
+    uint32_t              index;
+    pthread_t             thread;
+    VK_JOB_DEQUE          deque;
+    atomic_ullong         jobs;       // jobs run
+    atomic_ullong         steals;     // jobs taken from other workers
+    atomic_ullong         busy_time;  // ns spent running jobs
+} VK_JOB_WORKER;
+
+/** workers[0] is shared by every thread outside the pool, they run jobs while they wait on a counter */
+typedef struct VK_JOB_SYSTEM {
+    bool            enabled;
+    uint32_t        threads_count;
+    VK_JOB_WORKER  *workers;
+    uint64_t        start_time;       // vk_get_time_ns at creation, utilisation is measured from here
+    atomic_uint     queued;           // jobs sitting in deques
+    atomic_uint     sleeping;         // workers waiting on wake
+    atomic_uint     next_victim;
+    atomic_bool     shutdown;
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t  wake;
+    pthread_mutex_t dependency_lock;
+} VK_JOB_SYSTEM;
+
+typedef struct VK_JOB_WORKER_STATS {
+    uint64_t jobs;
+    uint64_t steals;
+    uint64_t busy_time;   // ns
+    double   utilisation; // busy_time over the time since the system was created
+} VK_JOB_WORKER_STATS;
+
+/** objects culled by one workgroup of the cull shader */
+#define VK_INDIRECT_GROUP_SIZE 64
+
+/** where a mesh sits in the bound index and vertex buffers, std430 layout shared with the cull shader */
+typedef struct VK_INDIRECT_MESH {
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t  vertex_offset;
+    uint32_t padding;
+} VK_INDIRECT_MESH;
+
+/** a bounding sphere in the object's model space and the mesh it draws, std430 layout shared with the cull shader */
+typedef struct VK_INDIRECT_OBJECT {
+    float    center[3];
+    float    radius;
+    uint32_t mesh;
+    uint32_t padding[3];
+} VK_INDIRECT_OBJECT;
+
+/** per frame in flight, written by the cull pass and read by the draw of the same frame */
+typedef struct VK_INDIRECT_FRAME {
+    VK_BUFFER       commands;   // VkDrawIndexedIndirectCommand per surviving object, compacted
+    VK_BUFFER       count;      // number of surviving objects
+    VK_BUFFER       transforms; // column major model matrix per object, persistently mapped
+    VkDescriptorSet cull_set;
+    VkDescriptorSet draw_set;
+} VK_INDIRECT_FRAME;
+
+typedef struct VK_INDIRECT_CULLER {
+    VK_COMPUTE_PIPELINE     pipeline;
+    VkDescriptorSetLayout   cull_set_layout;
+    VkDescriptorSetLayout   draw_set_layout;  // transforms for the vertex shader, add it to the graphics pipeline layout
+    VK_DESCRIPTOR_ALLOCATOR descriptors;
+    VK_BUFFER               objects;
+    VK_BUFFER               meshes;
+    uint32_t                objects_capacity;
+    uint32_t                objects_count;
+    uint32_t                meshes_capacity;
+    bool                    draw_count;       // vkCmdDrawIndexedIndirectCount is enabled, otherwise culled slots are zeroed
+    uint32_t                frames_count;
+    VK_INDIRECT_FRAME      *frames;
+} VK_INDIRECT_CULLER;
+
+enum VK_MESH_LAYOUT_ENUM {
+    VK_MESH_INTERLEAVED     = 0x00, // one vertex buffer holding whole vertices
+    VK_MESH_SPLIT_POSITIONS = 0x01  // positions in binding 0 and the other attributes in binding 1, for depth only passes
+};
+
+/** a run of vertices or indices in a mesh store */
+typedef struct VK_MESH_RANGE {
+    uint32_t offset;
+    uint32_t count;
+} VK_MESH_RANGE;
+
+/** draw with vertexOffset first_vertex and firstIndex first_index, indices are relative to the mesh */
+typedef struct VK_MESH {
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    uint32_t first_index;
+    uint32_t index_count;
+} VK_MESH;
+
+typedef struct VK_MESH_STORE {
+    pthread_mutex_t lock;
+    uint32_t        layout;          // VK_MESH_LAYOUT_ENUM
+    uint32_t        vertex_size;     // bytes of a whole interleaved vertex
+    uint32_t        position_size;   // bytes at the start of each vertex that hold the position
+    uint32_t        vertices_capacity;
+    uint32_t        indices_capacity;
+    uint32_t        vertices_used;
+    uint32_t        indices_used;
+    uint32_t        meshes_count;
+    VK_BUFFER       vertices;        // whole vertices, or positions when split
+    VK_BUFFER       attributes;      // the rest of each vertex when split
+    VK_BUFFER       indices;         // uint32 indices
+
+    /** free runs sorted by offset, neighbours are merged when a mesh is removed */
+    uint32_t        free_vertices_count;
+    uint32_t        free_vertices_capacity;
+    VK_MESH_RANGE  *free_vertices;
+    uint32_t        free_indices_count;
+    uint32_t        free_indices_capacity;
+    VK_MESH_RANGE  *free_indices;
+} VK_MESH_STORE;
+
+/** levels no larger than this are loaded together when a texture is first requested */
+#define VK_TEXTURE_TAIL_EXTENT     64
+/** more detailed levels requested per vk_update_texture_streamer */
+#define VK_TEXTURE_STREAMS_PER_FRAME 4
+
+enum VK_TEXTURE_STATE_ENUM {
+    VK_TEXTURE_LOADING   = 0x00, // a job is reading levels and uploading them
+    VK_TEXTURE_LOADED    = 0x01, // the job is done, its uploads are acquired by the next frame
+    VK_TEXTURE_ACQUIRING = 0x02, // waiting for that frame to begin
+    VK_TEXTURE_IDLE      = 0x03,
+    VK_TEXTURE_FAILED    = 0x04,
+    VK_TEXTURE_STALLED   = 0x05, // the staging ring was full, the frame thread runs the job again
+    VK_TEXTURE_RESERVING = 0x06  // a generated chain waits until the budget has room for all of it
+};
+
+/**
+ * a KTX2 texture streamed from its smallest levels towards level 0. the image only ever holds the
+ * resident levels, every step replaces it with a larger one and copies the levels already resident.
+ * generated chains are the exception, they are blitted from level 0 and load in a single step.
+ */
+typedef struct VK_TEXTURE {
+    struct VK_CONTEXT *context;
+    char              *filename;
+    atomic_uint        state;   // VK_TEXTURE_STATE_ENUM
+    bool               unload;
+
+    /** read from the file header by the first job */
+    VkFormat      format;
+    VkExtent2D    extent;        // of level 0
+    uint32_t      levels_count;  // of the full chain, including generated levels
+    uint32_t      layers_count;  // array layers times faces
+    bool          cube;
+    bool          generate_mips; // the file has only level 0, the rest are blitted on the graphics queue
+    uint64_t     *level_offsets;
+    VkDeviceSize *level_bytes;   // all layers of a level
+    uint32_t      stream_limit;  // most detailed level that fits the staging ring
+
+    /** resident levels, the view covers first_level to levels_count of the full chain */
+    VK_IMAGE      image;
+    VkImageView   view;
+    uint32_t      first_level;   // levels_count while nothing is resident
+    uint32_t      generation;    // bumped whenever view changes, sets holding the old view must be rewritten
+
+    /** written by the job, read by the frame thread once state is VK_TEXTURE_LOADED */
+    VK_IMAGE      pending_image;
+    VkImageView   pending_view;
+    uint32_t      pending_level;
+    VkDeviceSize  pending_bytes; // reserved from the budget until the step completes
+    uint64_t      acquire_serial;
+    uint32_t      upload_level;  // where a stalled step resumes
+    uint32_t      upload_layer;
+} VK_TEXTURE;
+
+typedef struct VK_RETIRED_TEXTURE {
+    uint64_t    frame_serial; // frames submitted once the last frame using it is submitted
+    VK_IMAGE    image;
+    VkImageView view;
+} VK_RETIRED_TEXTURE;
+
+typedef struct VK_TEXTURE_STREAMER {
+    VkDeviceSize        budget;    // cap on resident bytes, tails are always loaded
+    VkDeviceSize        resident;  // bytes held by texture images
+    VkDeviceSize        reserved;  // bytes of steps still loading
+    uint32_t            textures_count;
+    uint32_t            textures_capacity;
+    VK_TEXTURE        **textures;
+    uint32_t            retired_count;
+    uint32_t            retired_capacity;
+    VK_RETIRED_TEXTURE *retired;
+    VK_JOB_COUNTER      jobs;
+} VK_TEXTURE_STREAMER;
+
+/** startup stages with the same name are merged, e.g. every "create render pass" of a pipeline table */
+#define VK_INIT_STAGE_NAME_SIZE 64
+
+typedef struct VK_INIT_STAGE {
+    char     name[VK_INIT_STAGE_NAME_SIZE];
+    uint32_t count;    // times the stage ran
+    uint64_t start;    // ns from the first stage to the first time this one began
+    uint64_t duration; // ns summed over every run
+} VK_INIT_STAGE;
+
+typedef struct VK_INIT_REPORT {
+    uint64_t       origin; // vk_get_time_ns when the first stage began
+    uint64_t       end;    // vk_get_time_ns when the last stage ended
+    uint32_t       stages_count;
+    uint32_t       stages_capacity;
+    VK_INIT_STAGE *stages;
+} VK_INIT_REPORT;
+
+/** resources of a replaced swapchain, destroyed once the frames that used them complete */
+typedef struct VK_RETIRED_SWAPCHAIN {
+    uint64_t        frame_serial;       // frames submitted before the swapchain was replaced
+    VkSwapchainKHR  swapchain;
+    uint32_t        image_count;
+    VkImage        *images;
+    VkImageView    *image_views;
+    VK_IMAGE       *offscreen_targets;
+    uint32_t        framebuffers_count;
+    VkFramebuffer  *framebuffers;
+    VkSemaphore    *render_finished;
+} VK_RETIRED_SWAPCHAIN;
+
 typedef struct VK_CONTEXT {
     /** SDL Objects */
     SDL_Window *window;
 
     /** Vulkan Objects */
+    uint32_t         api_version; // requested before vk_create_instance, 0 for the newest up to 1.3
     VkInstance       instance;
     VkSurfaceKHR     surface;
     VkPhysicalDevice physical_device;
     VkDevice         logical_device;
     VkSwapchainKHR   swapchain;
 
-    VkQueue  queues[5];
+    VkDebugUtilsMessengerEXT debug_messenger; // routes validation messages into the log
+
+    VkQueue  queues[5];                                  // first queue of each role
+    VkQueue  role_queues[5][VK_MAX_QUEUES_PER_ROLE];     // every queue of each role, see vk_get_queue
+
+    /** roles may share a queue, so every submission goes through the lock of its queue, see vk_queue_submit */
+    uint32_t        queue_locks_count;
+    VkQueue         locked_queues[5 * VK_MAX_QUEUES_PER_ROLE];
+    pthread_mutex_t queue_locks[5 * VK_MAX_QUEUES_PER_ROLE];
 
     uint32_t      image_count;
     VkImage           *images;
@@ -188,14 +1026,48 @@ typedef struct VK_CONTEXT {
     VkRenderPass     render_pass;
     VkPipelineLayout pipeline_layout;
     VkPipeline       pipeline;
+    VkPipelineCache  pipeline_cache;
 
     uint32_t       framebuffers_count;
     VkFramebuffer *framebuffers;
 
+    /** Frame loop Objects */
+    VkCommandPool command_pool;
+    uint32_t      frames_count;      // number of frames in flight
+    uint32_t      current_frame;
+    uint32_t      image_index;       // swapchain image acquired by vk_begin_frame
+    VK_FRAME     *frames;
+    VkFence      *images_in_flight;  // fence of the frame rendering to each swapchain image
+    VkSemaphore  *render_finished;   // signaled when each swapchain image can be presented, NULL when headless
+    uint64_t      frame_serial;      // frames submitted so far
+
+    /** Swapchain recreation Objects */
+    bool                  swapchain_out_of_date;
+    uint32_t              retired_swapchains_count;
+    VK_RETIRED_SWAPCHAIN *retired_swapchains;
+    uint64_t              resize_time;       // duration of the last vk_recreate_swapchain
+
+    /** Headless Objects, images and image_views point at these targets when there is no swapchain */
+    bool          headless;
+    VK_IMAGE     *offscreen_targets;
+
     /** Framework Objects */
     VK_DEVICE_SPECIFICATION         device_details;
+    uint32_t                        device_scores_count;
+    VK_DEVICE_SCORE                *device_scores;
     VK_SUPPORTED_QUEUE_FAMILIES     queue_families;
     VK_SWAPCHAIN_SUPPORT_DETAILS swapchain_details;
+    VK_PIPELINE_CACHE_DETAILS    pipeline_cache_details;
+    VK_ALLOCATOR                 allocator;
+    VK_UPLOADER                  uploader;
+    VK_COMPUTE                   compute;
+    VK_SHADER_CACHE              shader_cache;
+    VK_SCHEDULER                 scheduler;
+    VK_PROFILER                  profiler;
+    VK_INIT_REPORT               init_report;
+    VK_OBJECT_CACHE              object_cache;
+    VK_RECORDER                  recorder;
+    VK_JOB_SYSTEM                jobs;
 } VK_CONTEXT;
 
 /** Public functions */
@@ -210,6 +1082,25 @@ extern void vk_create_instance
     const uint32_t required_layer_count
 );
 extern void vk_create_surface (VK_CONTEXT *context);
+extern bool vk_check_features
+(
+    const VkBool32 *required,
+    const VkBool32 *supported,
+    uint32_t count
+);
+extern bool vk_check_feature_chain
+(
+    VK_CONTEXT *context,
+    VkPhysicalDevice device,
+    uint32_t device_api_version,
+    const void *required_chain
+);
+extern VkBool32 vk_get_enabled_feature
+(
+    VK_CONTEXT *context,
+    VkStructureType type,
+    size_t offset
+);
 extern void vk_select_physical_device 
 (
     VK_CONTEXT *context, 
@@ -224,12 +1115,44 @@ extern void vk_create_logical_device
     uint32_t extension_count
 );
 extern void vk_create_queues (VK_CONTEXT *context);
+extern void vk_destroy_queues (VK_CONTEXT *context);
+extern VkResult vk_queue_submit
+(
+    VK_CONTEXT *context,
+    VkQueue queue,
+    uint32_t submit_count,
+    const VkSubmitInfo *submits,
+    VkFence fence
+);
+extern VkResult vk_queue_present
+(
+    VK_CONTEXT *context,
+    VkQueue queue,
+    const VkPresentInfoKHR *present_info
+);
+extern VkQueue vk_get_queue
+(
+    VK_CONTEXT *context,
+    uint32_t role,
+    uint32_t index
+);
 extern void vk_create_swapchain
 (
     VK_CONTEXT *context,
     VK_SWAPCHAIN_SUPPORT_DETAILS swapchain_details
 );
 extern void vk_create_image_views (VK_CONTEXT *context);
+extern bool vk_recreate_swapchain
+(
+    VK_CONTEXT *context,
+    VkExtent2D extent
+);
+extern void vk_collect_retired_swapchains
+(
+    VK_CONTEXT *context,
+    bool wait
+);
+extern void vk_destroy_swapchain (VK_CONTEXT *context);
 extern void vk_create_attachment_description
 (
     VK_PIPELINE_SPECIFICATION *pipeline_specification,
@@ -245,6 +1168,64 @@ extern void vk_create_subpass
     VK_PIPELINE_SPECIFICATION *pipeline_specification,
     VK_SUBPASS_SPECIFICATION subpass_specification 
 );
+extern void vk_create_subpass_dependency
+(
+    VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    VK_SUBPASS_DEPENDENCY_SPECIFICATION dependency_specification
+);
+extern void vk_create_specialization_constant
+(
+    VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    VkShaderStageFlags stages,
+    uint32_t constant_id,
+    const void *value,
+    size_t size
+);
+extern VkShaderStageFlagBits vk_get_shader_stage (const char *filename);
+extern const VkSpecializationInfo *vk_get_specialization_info
+(
+    const VK_SPECIALIZATION_SPECIFICATION *specialization,
+    VkSpecializationInfo *info
+);
+extern bool vk_load_shader_module
+(
+    VK_CONTEXT *context,
+    const char *filename,
+    VkShaderModule *shader_module
+);
+extern void vk_release_shader_module
+(
+    VK_CONTEXT *context,
+    VkShaderModule shader_module
+);
+extern void vk_create_shader_cache (VK_CONTEXT *context);
+extern void vk_trim_shader_cache (VK_CONTEXT *context);
+extern void vk_destroy_shader_cache (VK_CONTEXT *context);
+extern void vk_create_pipeline_state
+(
+    VK_CONTEXT *context,
+    const VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    const char **filenames,
+    uint32_t count,
+    VK_PIPELINE_STATE *state
+);
+extern void vk_destroy_pipeline_state
+(
+    VK_CONTEXT *context,
+    VK_PIPELINE_STATE *state
+);
+extern void vk_create_pipeline_table
+(
+    VK_CONTEXT *context,
+    const VK_PIPELINE_SPECIFICATION *pipeline_specifications,
+    uint32_t count,
+    VK_PIPELINE_TABLE *table
+);
+extern void vk_destroy_pipeline_table
+(
+    VK_CONTEXT *context,
+    VK_PIPELINE_TABLE *table
+);
 extern void vk_create_pipeline
 (
     VK_CONTEXT *context,
@@ -256,4 +1237,511 @@ extern void vk_create_framebuffers
 (
     VK_CONTEXT *context
 );
+extern void vk_create_pipeline_cache
+(
+    VK_CONTEXT *context,
+    const char *filename
+);
+extern void vk_destroy_pipeline_cache (VK_CONTEXT *context);
+extern void vk_create_frames
+(
+    VK_CONTEXT *context,
+    uint32_t frames_in_flight
+);
+extern VkCommandBuffer vk_begin_frame (VK_CONTEXT *context);
+extern void vk_end_frame (VK_CONTEXT *context);
+extern void vk_destroy_frames (VK_CONTEXT *context);
+extern void vk_frame_wait_semaphore
+(
+    VK_CONTEXT *context,
+    VkSemaphore semaphore,
+    VkPipelineStageFlags stage
+);
+extern void vk_frame_signal_semaphore
+(
+    VK_CONTEXT *context,
+    VkSemaphore semaphore
+);
+extern void vk_create_allocator
+(
+    VK_CONTEXT *context,
+    VkDeviceSize block_size
+);
+extern void vk_destroy_allocator (VK_CONTEXT *context);
+extern uint32_t vk_find_memory_type
+(
+    VK_CONTEXT *context,
+    uint32_t type_bits,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred
+);
+extern void vk_allocate_memory
+(
+    VK_CONTEXT *context,
+    VkMemoryRequirements requirements,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred,
+    bool linear,
+    VK_ALLOCATION *allocation
+);
+extern void vk_free_memory
+(
+    VK_CONTEXT *context,
+    VK_ALLOCATION *allocation
+);
+extern void vk_create_buffer
+(
+    VK_CONTEXT *context,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VK_BUFFER *buffer
+);
+extern void vk_destroy_buffer
+(
+    VK_CONTEXT *context,
+    VK_BUFFER *buffer
+);
+extern void vk_create_image
+(
+    VK_CONTEXT *context,
+    const VkImageCreateInfo *create_info,
+    VkMemoryPropertyFlags properties,
+    VK_IMAGE *image
+);
+extern void vk_destroy_image
+(
+    VK_CONTEXT *context,
+    VK_IMAGE *image
+);
+extern void vk_get_allocator_statistics
+(
+    VK_CONTEXT *context,
+    VK_ALLOCATOR_STATISTICS *statistics
+);
+extern void vk_create_uploader
+(
+    VK_CONTEXT *context,
+    VkDeviceSize size
+);
+extern void vk_destroy_uploader (VK_CONTEXT *context);
+extern void vk_upload_buffer
+(
+    VK_CONTEXT *context,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    const void *data,
+    VkDeviceSize size
+);
+extern void vk_upload_image
+(
+    VK_CONTEXT *context,
+    VkImage image,
+    VkImageSubresourceLayers subresource,
+    VkExtent3D extent,
+    const void *data,
+    VkDeviceSize size,
+    VkImageLayout final_layout
+);
+extern bool vk_try_upload_image
+(
+    VK_CONTEXT *context,
+    VkImage image,
+    VkImageSubresourceLayers subresource,
+    VkExtent3D extent,
+    const void *data,
+    VkDeviceSize size,
+    VkImageLayout final_layout
+);
+extern void vk_upload_flush (VK_CONTEXT *context);
+extern uint32_t vk_upload_acquire
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer,
+    VkSemaphore semaphores[VK_UPLOAD_BATCHES],
+    VkPipelineStageFlags stages[VK_UPLOAD_BATCHES]
+);
+extern void vk_upload_wait_idle (VK_CONTEXT *context);
+extern void vk_create_offscreen_targets
+(
+    VK_CONTEXT *context,
+    VkExtent2D extent,
+    VkFormat format,
+    uint32_t count
+);
+extern void vk_destroy_offscreen_targets (VK_CONTEXT *context);
+extern void vk_read_offscreen_target
+(
+    VK_CONTEXT *context,
+    uint32_t index,
+    VkImageLayout layout,
+    void *data
+);
+extern VkDeviceSize vk_get_offscreen_target_size (VK_CONTEXT *context);
+extern void vk_create_compute_pipeline
+(
+    VK_CONTEXT *context,
+    VK_COMPUTE_PIPELINE_SPECIFICATION pipeline_specification,
+    const char *filename,
+    VK_COMPUTE_PIPELINE *pipeline
+);
+extern void vk_destroy_compute_pipeline
+(
+    VK_CONTEXT *context,
+    VK_COMPUTE_PIPELINE *pipeline
+);
+extern void vk_create_compute (VK_CONTEXT *context);
+extern void vk_destroy_compute (VK_CONTEXT *context);
+extern VkCommandBuffer vk_get_compute_command_buffer (VK_CONTEXT *context);
+extern void vk_dispatch_compute
+(
+    VK_CONTEXT *context,
+    VK_COMPUTE_PIPELINE *pipeline,
+    const VkDescriptorSet *descriptor_sets,
+    uint32_t descriptor_sets_count,
+    const void *push_constants,
+    uint32_t push_constants_size,
+    uint32_t group_count_x,
+    uint32_t group_count_y,
+    uint32_t group_count_z
+);
+extern VkSemaphore vk_submit_compute
+(
+    VK_CONTEXT *context,
+    const VkSemaphore *wait_semaphores,
+    const VkPipelineStageFlags *wait_stages,
+    uint32_t wait_semaphores_count,
+    bool signal
+);
+extern void vk_create_scheduler (VK_CONTEXT *context);
+extern void vk_destroy_scheduler (VK_CONTEXT *context);
+extern uint64_t vk_scheduler_submit
+(
+    VK_CONTEXT *context,
+    uint32_t role,
+    VkCommandBuffer command_buffer,
+    const VK_SCHEDULER_WAIT *waits,
+    uint32_t waits_count,
+    VkSemaphore signal
+);
+extern void vk_scheduler_flush (VK_CONTEXT *context);
+extern uint64_t vk_scheduler_completed
+(
+    VK_CONTEXT *context,
+    uint32_t role
+);
+extern void vk_scheduler_wait
+(
+    VK_CONTEXT *context,
+    uint32_t role,
+    uint64_t value
+);
+extern void vk_create_profiler
+(
+    VK_CONTEXT *context,
+    const char *trace_filename
+);
+extern void vk_destroy_profiler (VK_CONTEXT *context);
+extern void vk_profile_begin_frame
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer
+);
+extern void vk_profile_begin
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer,
+    const char *name
+);
+extern void vk_profile_end
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer
+);
+extern const VK_PROFILE_SCOPE *vk_get_profile_results
+(
+    VK_CONTEXT *context,
+    uint32_t *scopes_count
+);
+extern void vk_record_init_stage
+(
+    VK_CONTEXT *context,
+    const char *name,
+    uint64_t start
+);
+extern void vk_write_init_report
+(
+    VK_CONTEXT *context,
+    const char *filename
+);
+extern void vk_destroy_init_report (VK_CONTEXT *context);
+extern void vk_create_logger
+(
+    VK_LOG_CALLBACK callback,
+    void *user_data
+);
+extern void vk_flush_logger (void);
+extern void vk_destroy_logger (void);
+extern void vk_create_debug_messenger (VK_CONTEXT *context);
+extern void vk_destroy_debug_messenger (VK_CONTEXT *context);
+extern void vk_create_descriptor_allocator
+(
+    VK_CONTEXT *context,
+    VK_DESCRIPTOR_ALLOCATOR *allocator
+);
+extern void vk_destroy_descriptor_allocator
+(
+    VK_CONTEXT *context,
+    VK_DESCRIPTOR_ALLOCATOR *allocator
+);
+extern void vk_reset_descriptor_allocator
+(
+    VK_CONTEXT *context,
+    VK_DESCRIPTOR_ALLOCATOR *allocator
+);
+extern VkDescriptorSet vk_allocate_descriptor_set
+(
+    VK_CONTEXT *context,
+    VK_DESCRIPTOR_ALLOCATOR *allocator,
+    VkDescriptorSetLayout layout
+);
+extern VkDescriptorSet vk_allocate_frame_descriptor_set
+(
+    VK_CONTEXT *context,
+    VkDescriptorSetLayout layout
+);
+extern VkDescriptorSetLayout vk_get_descriptor_set_layout
+(
+    VK_CONTEXT *context,
+    const VkDescriptorSetLayoutBinding *bindings,
+    uint32_t bindings_count
+);
+extern void vk_release_descriptor_set_layout
+(
+    VK_CONTEXT *context,
+    VkDescriptorSetLayout layout
+);
+extern bool vk_get_descriptor_set_layout_counts
+(
+    VK_CONTEXT *context,
+    VkDescriptorSetLayout layout,
+    uint32_t *counts
+);
+extern VkPipelineLayout vk_get_pipeline_layout
+(
+    VK_CONTEXT *context,
+    const VkPipelineLayoutCreateInfo *create_info
+);
+extern void vk_release_pipeline_layout
+(
+    VK_CONTEXT *context,
+    VkPipelineLayout layout
+);
+extern VkRenderPass vk_get_render_pass
+(
+    VK_CONTEXT *context,
+    const VkRenderPassCreateInfo *create_info
+);
+extern void vk_release_render_pass
+(
+    VK_CONTEXT *context,
+    VkRenderPass render_pass
+);
+extern void vk_trim_object_cache (VK_CONTEXT *context);
+extern void vk_destroy_object_cache (VK_CONTEXT *context);
+extern void vk_create_recorder
+(
+    VK_CONTEXT *context,
+    uint32_t threads
+);
+extern void vk_destroy_recorder (VK_CONTEXT *context);
+extern void vk_reset_recorder_frame (VK_CONTEXT *context);
+extern void vk_record_secondary
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer primary,
+    VkRenderPass render_pass,
+    uint32_t subpass,
+    VkFramebuffer framebuffer,
+    uint32_t chunks_count,
+    VK_RECORD_CALLBACK callback,
+    void *user_data
+);
+extern void vk_create_job_system
+(
+    VK_CONTEXT *context,
+    uint32_t threads
+);
+extern void vk_destroy_job_system (VK_CONTEXT *context);
+extern void vk_submit_job
+(
+    VK_CONTEXT *context,
+    VK_JOB_FUNCTION function,
+    void *data,
+    VK_JOB_COUNTER *counter
+);
+extern void vk_submit_job_after
+(
+    VK_CONTEXT *context,
+    VK_JOB_COUNTER *dependency,
+    VK_JOB_FUNCTION function,
+    void *data,
+    VK_JOB_COUNTER *counter
+);
+extern void vk_wait_job_counter
+(
+    VK_CONTEXT *context,
+    VK_JOB_COUNTER *counter
+);
+extern uint32_t vk_get_job_stats
+(
+    VK_CONTEXT *context,
+    VK_JOB_WORKER_STATS *stats
+);
+extern void vk_prefetch_shader_files
+(
+    VK_CONTEXT *context,
+    const char **filenames,
+    uint32_t count,
+    VK_JOB_COUNTER *counter
+);
+extern void vk_preload_shader_modules
+(
+    VK_CONTEXT *context,
+    const char **filenames,
+    uint32_t count,
+    VK_JOB_COUNTER *counter
+);
+extern void vk_create_indirect_culler
+(
+    VK_CONTEXT *context,
+    const char *filename,
+    uint32_t objects_capacity,
+    uint32_t meshes_capacity,
+    VK_INDIRECT_CULLER *culler
+);
+extern void vk_destroy_indirect_culler
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler
+);
+extern void vk_set_indirect_meshes
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    const VK_INDIRECT_MESH *meshes,
+    uint32_t count
+);
+extern void vk_set_indirect_objects
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    const VK_INDIRECT_OBJECT *objects,
+    uint32_t count
+);
+extern float *vk_get_indirect_transforms
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler
+);
+extern void vk_cull_indirect
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    VkCommandBuffer command_buffer,
+    const float view_projection[16]
+);
+extern void vk_draw_indirect
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    VkCommandBuffer command_buffer,
+    VkPipelineLayout layout,
+    uint32_t set
+);
+extern void vk_create_mesh_store
+(
+    VK_CONTEXT *context,
+    uint32_t layout,
+    uint32_t vertex_size,
+    uint32_t position_size,
+    uint32_t vertices_capacity,
+    uint32_t indices_capacity,
+    VK_MESH_STORE *store
+);
+extern void vk_destroy_mesh_store
+(
+    VK_CONTEXT *context,
+    VK_MESH_STORE *store
+);
+extern bool vk_add_mesh
+(
+    VK_CONTEXT *context,
+    VK_MESH_STORE *store,
+    const void *vertices,
+    uint32_t vertex_count,
+    const uint32_t *indices,
+    uint32_t index_count,
+    VK_MESH *mesh
+);
+extern void vk_remove_mesh
+(
+    VK_CONTEXT *context,
+    VK_MESH_STORE *store,
+    const VK_MESH *mesh
+);
+extern uint32_t vk_get_mesh_store_input
+(
+    const VK_MESH_STORE *store,
+    const VkVertexInputAttributeDescription *attributes,
+    uint32_t attributes_count,
+    bool positions_only,
+    VkVertexInputBindingDescription *bindings,
+    VkVertexInputAttributeDescription *store_attributes,
+    uint32_t *store_attributes_count
+);
+extern void vk_bind_mesh_store
+(
+    VK_CONTEXT *context,
+    VK_MESH_STORE *store,
+    VkCommandBuffer command_buffer,
+    bool positions_only
+);
+extern void vk_draw_mesh
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer,
+    const VK_MESH *mesh,
+    uint32_t instance_count,
+    uint32_t first_instance
+);
+extern void vk_create_texture_streamer
+(
+    VK_CONTEXT *context,
+    VkDeviceSize budget,
+    VK_TEXTURE_STREAMER *streamer
+);
+extern void vk_destroy_texture_streamer
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer
+);
+extern VK_TEXTURE *vk_load_texture
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    const char *filename
+);
+extern void vk_unload_texture
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    VK_TEXTURE *texture
+);
+extern void vk_update_texture_streamer
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    VkCommandBuffer command_buffer
+);
 #endif // VKMAIN_H_
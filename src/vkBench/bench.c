@@ -0,0 +1,1071 @@
+#include "vkInit.h"
+
+#include <math.h>
+#include <unistd.h>
+
+/**
+ * headless startup and frame time benchmarks, run with `make bench`.
+ * every scenario runs warmup untimed iterations and then iterations timed ones,
+ * on the first CPU device so results are comparable between machines and commits.
+ */
+
+#define W 1280
+#define H 720
+
+#define FRAMES_IN_FLIGHT 2
+#define OFFSCREEN_COUNT  3
+
+#define PIPELINE_CACHE_FILE "bench_pipeline_cache.bin"
+#define BENCH_MAX_RESULTS   16
+#define BENCH_UPLOAD_SIZE   (4ull * 1024 * 1024)
+
+#define BENCH_STRESS_SLOTS      512
+#define BENCH_STRESS_OPERATIONS 4096
+
+#define BENCH_TEXTURES        4
+#define BENCH_TEXTURE_EXTENT  1024
+#define BENCH_TEXTURE_BUDGET  (64ull * 1024 * 1024)
+#define BENCH_TEXTURE_FRAMES  1000 // a load taking longer than this is a failure
+
+typedef struct BENCH_OPTIONS {
+    uint32_t    iterations;
+    uint32_t    warmup;
+    uint32_t    pipelines; // pipelines per creation iteration
+    uint32_t    frames;    // timed frames
+    uint32_t    draws;     // draws per frame
+    uint32_t    threads;   // recorder threads of the secondary scenario, 0 for one per online CPU
+    uint32_t    chunks;    // secondary buffers each frame's draws are split into
+    const char *output;
+} BENCH_OPTIONS;
+
+typedef struct BENCH_RESULT {
+    const char *name;
+    uint32_t    samples;
+    double      mean; // ms
+    double      p50;
+    double      p99;
+    double      max;
+} BENCH_RESULT;
+
+/** one resource of the allocator stress scenario, an optimal image or a buffer */
+typedef struct BENCH_STRESS_SLOT {
+    bool      live;
+    bool      optimal;
+    VK_BUFFER buffer;
+    VK_IMAGE  image;
+} BENCH_STRESS_SLOT;
+
+/** the memory a live sub-allocation covers */
+typedef struct BENCH_STRESS_RANGE {
+    int32_t      block;
+    VkDeviceSize offset;
+    VkDeviceSize size;      // requested
+    VkDeviceSize allocated; // buddy
+    bool         optimal;
+} BENCH_STRESS_RANGE;
+
+/** the draws of one frame, split evenly over the chunks */
+typedef struct BENCH_FRAME_WORK {
+    VkPipeline pipeline;
+    uint32_t   draws;
+    uint32_t   chunks;
+} BENCH_FRAME_WORK;
+
+static const VkViewport viewport = { .width = W, .height = H, .maxDepth = 1.0f };
+static const VkRect2D   scissor  = { .extent = { W, H } };
+
+static const char *shader_files[] = {
+    "shaders/triangle.vert.spv",
+    "shaders/triangle.frag.spv",
+};
+
+static const char *indirect_shader_files[] = {
+    "shaders/indirect.vert.spv",
+    "shaders/triangle.frag.spv",
+};
+
+static int
+bench_compare
+(
+    const void *a,
+    const void *b
+)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/** nearest rank percentile of sorted samples */
+static double
+bench_percentile
+(
+    const uint64_t *sorted,
+    uint32_t count,
+    double percentile
+)
+{
+    uint32_t rank = (uint32_t) ceil(percentile * count);
+    return sorted[(rank > 0) ? rank - 1 : 0] / 1e6;
+}
+
+static BENCH_RESULT
+bench_summarise
+(
+    const char *name,
+    uint64_t *samples,
+    uint32_t count
+)
+{
+    BENCH_RESULT result = { .name = name, .samples = count };
+
+    if (count == 0)
+        return result;
+
+    qsort(samples, count, sizeof(uint64_t), bench_compare);
+
+    double sum = 0.0;
+    for (uint32_t i = 0; i < count; i++)
+        sum += samples[i];
+
+    result.mean = sum / count / 1e6;
+    result.p50  = bench_percentile(samples, count, 0.50);
+    result.p99  = bench_percentile(samples, count, 0.99);
+    result.max  = samples[count - 1] / 1e6;
+
+    printf("%-24s %6u samples  mean %9.3f ms  p50 %9.3f ms  p99 %9.3f ms  max %9.3f ms\n",
+           name, count, result.mean, result.p50, result.p99, result.max);
+    return result;
+}
+
+/** features_chain is passed on as VK_DEVICE_SPECIFICATION.features_chain and must outlive the device */
+static void
+bench_create_device
+(
+    VK_CONTEXT *ctx,
+    void *features_chain
+)
+{
+    VK_DEVICE_SPECIFICATION device_specification = {
+        .supported_types[VK_PHYSICAL_DEVICE_TYPE_CPU] = 1,
+        /** needed by the indirect culler */
+        .device_features.multiDrawIndirect         = VK_TRUE,
+        .device_features.drawIndirectFirstInstance = VK_TRUE,
+        .features_chain                            = features_chain,
+    };
+
+    vk_create_instance(ctx, "bench", "bench", NULL, NULL, 0, 0);
+    vk_select_physical_device(ctx, device_specification, NULL, 0);
+    vk_create_logical_device(ctx, NULL, 0);
+    vk_create_queues(ctx);
+}
+
+static void
+bench_destroy_device
+(
+    VK_CONTEXT *ctx
+)
+{
+    vk_destroy_object_cache(ctx);
+    vk_destroy_queues(ctx);
+    vkDestroyDevice(ctx->logical_device, NULL);
+    vkDestroyInstance(ctx->instance, NULL);
+
+    free(ctx->device_scores);
+    ctx->device_scores       = NULL;
+    ctx->device_scores_count = 0;
+}
+
+/** the example triangle pipeline, rendering into offscreen targets of format */
+static void
+bench_pipeline_specification
+(
+    VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    VkFormat format
+)
+{
+    *pipeline_specification = (VK_PIPELINE_SPECIFICATION) {
+        .topology                 = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .width                    = W,
+        .height                   = H,
+        .max_depth                = 1.0f,
+        .scissor                  = { .extent = { W, H } },
+        .dynamic_viewport         = VK_TRUE,
+        .polygon_mode             = VK_POLYGON_MODE_FILL,
+        .cull_mode                = VK_CULL_MODE_BACK_BIT,
+        .front_face               = VK_FRONT_FACE_CLOCKWISE,
+        .line_width               = 1.0f,
+        .rasterization_samples    = VK_SAMPLE_COUNT_1_BIT,
+        .min_sample_shading       = 1.0f,
+        .logic_op                 = VK_LOGIC_OP_COPY,
+        .shader_files_count       = 2,
+        .shader_files             = shader_files,
+    };
+
+    vk_create_attachment_description(pipeline_specification, (VK_ATTACHMENT_DESCRIPTION_SPECIFICATION) {
+        .format           = format,
+        .samples          = VK_SAMPLE_COUNT_1_BIT,
+        .load_op          = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .store_op         = VK_ATTACHMENT_STORE_OP_STORE,
+        .stencil_load_op  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencil_store_op = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initial_layout   = VK_IMAGE_LAYOUT_UNDEFINED,
+        .final_layout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+    });
+
+    vk_create_attachment_color_blend(pipeline_specification, (VK_ATTACHMENT_COLOR_BLEND_SPECIFICATION) {
+        .color_write_mask       = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        .src_color_blend_factor = VK_BLEND_FACTOR_ONE,
+        .dst_color_blend_factor = VK_BLEND_FACTOR_ZERO,
+        .color_blend_op         = VK_BLEND_OP_ADD,
+        .src_alpha_blend_factor = VK_BLEND_FACTOR_ONE,
+        .dst_alpha_blend_factor = VK_BLEND_FACTOR_ZERO,
+        .alpha_blend_op         = VK_BLEND_OP_ADD,
+    });
+
+    /** the reference is read when the render pass is created, so it can live on the heap with the specification */
+    VkAttachmentReference *color_attachment = malloc(sizeof(VkAttachmentReference));
+    *color_attachment = (VkAttachmentReference) {
+        .attachment = 0,
+        .layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+    };
+
+    vk_create_subpass(pipeline_specification, (VK_SUBPASS_SPECIFICATION) {
+        .color_attachments_count = 1,
+        .color_attachments       = color_attachment
+    });
+
+    vk_create_subpass_dependency(pipeline_specification, (VK_SUBPASS_DEPENDENCY_SPECIFICATION) {
+        .src_subpass     = VK_SUBPASS_EXTERNAL,
+        .dst_subpass     = 0,
+        .src_stage_mask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .dst_stage_mask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .dst_access_mask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    });
+}
+
+/** instance, device selection, logical device and queues, torn down after every iteration */
+static BENCH_RESULT
+bench_instance_device
+(
+    const BENCH_OPTIONS *options
+)
+{
+    uint64_t samples[options->iterations];
+
+    for (uint32_t i = 0; i < options->warmup + options->iterations; i++) {
+        VK_CONTEXT ctx = {};
+
+        uint64_t start = vk_get_time_ns();
+        bench_create_device(&ctx, NULL);
+        uint64_t elapsed = vk_get_time_ns() - start;
+
+        bench_destroy_device(&ctx);
+        vk_destroy_init_report(&ctx);
+
+        if (i >= options->warmup)
+            samples[i - options->warmup] = elapsed;
+    }
+    return bench_summarise("instance_device", samples, options->iterations);
+}
+
+/**
+ * options->pipelines distinct pipelines built as a table, each sample includes loading the cache.
+ * cold starts remove the cache file first, warm starts load the one the previous iteration saved.
+ * Mesa's own disk cache is disabled in main, so the pipeline cache file is the only thing kept warm.
+ */
+static BENCH_RESULT
+bench_pipelines
+(
+    VK_CONTEXT *ctx,
+    const BENCH_OPTIONS *options,
+    const VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    bool warm
+)
+{
+    uint64_t samples[options->iterations];
+    VK_PIPELINE_SPECIFICATION *specifications = malloc(sizeof(VK_PIPELINE_SPECIFICATION) * options->pipelines);
+
+    /** a different depth bias per pipeline keeps the driver from deduplicating them */
+    for (uint32_t i = 0; i < options->pipelines; i++) {
+        specifications[i] = *pipeline_specification;
+        specifications[i].depth_bias_enable          = VK_TRUE;
+        specifications[i].depth_bias_constant_factor = (float) i;
+    }
+
+    for (uint32_t i = 0; i < options->warmup + options->iterations; i++) {
+        VK_PIPELINE_TABLE table;
+
+        if (!warm)
+            remove(PIPELINE_CACHE_FILE);
+
+        uint64_t start = vk_get_time_ns();
+        vk_create_pipeline_cache(ctx, PIPELINE_CACHE_FILE);
+        vk_create_pipeline_table(ctx, specifications, options->pipelines, &table);
+        uint64_t elapsed = vk_get_time_ns() - start;
+
+        vk_destroy_pipeline_table(ctx, &table);
+        vk_destroy_pipeline_cache(ctx);
+        /** every iteration is a fresh start, loading its shader modules, layouts and render passes again */
+        vk_trim_shader_cache(ctx);
+        vk_trim_object_cache(ctx);
+
+        if (i >= options->warmup)
+            samples[i - options->warmup] = elapsed;
+    }
+
+    free(specifications);
+    return bench_summarise((warm) ? "pipelines_warm" : "pipelines_cold", samples, options->iterations);
+}
+
+static BENCH_RESULT
+bench_offscreen_targets
+(
+    VK_CONTEXT *ctx,
+    const BENCH_OPTIONS *options
+)
+{
+    uint64_t samples[options->iterations];
+
+    for (uint32_t i = 0; i < options->warmup + options->iterations; i++) {
+        uint64_t start = vk_get_time_ns();
+        vk_create_offscreen_targets(ctx, (VkExtent2D) { W, H }, VK_FORMAT_R8G8B8A8_UNORM, OFFSCREEN_COUNT);
+        uint64_t elapsed = vk_get_time_ns() - start;
+
+        vk_destroy_offscreen_targets(ctx);
+
+        if (i >= options->warmup)
+            samples[i - options->warmup] = elapsed;
+    }
+    return bench_summarise("offscreen_targets", samples, options->iterations);
+}
+
+/** xorshift32, the stress scenario is seeded so every run makes the same requests */
+static uint32_t
+bench_random
+(
+    uint32_t *state
+)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void
+bench_check
+(
+    bool passed,
+    const char *message
+)
+{
+    if (!passed) {
+        VK_LOGF(LOG_ERROR, "bench", "Check failed: %s", message);
+        exit(-1);
+    }
+}
+
+static int
+bench_compare_ranges
+(
+    const void *a,
+    const void *b
+)
+{
+    const BENCH_STRESS_RANGE *x = a;
+    const BENCH_STRESS_RANGE *y = b;
+
+    if (x->block != y->block)
+        return (x->block < y->block) ? -1 : 1;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/**
+ * every live allocation must meet its resource's alignment, sub-allocations must not overlap,
+ * and a buffer and an optimal image must never share a bufferImageGranularity page.
+ */
+static void
+bench_check_allocations
+(
+    VK_CONTEXT *ctx,
+    const BENCH_STRESS_SLOT *slots,
+    VkDeviceSize granularity
+)
+{
+    BENCH_STRESS_RANGE ranges[BENCH_STRESS_SLOTS];
+    uint32_t ranges_count = 0;
+
+    for (uint32_t i = 0; i < BENCH_STRESS_SLOTS; i++) {
+        if (!slots[i].live)
+            continue;
+
+        VkMemoryRequirements requirements;
+        const VK_ALLOCATION *allocation;
+
+        if (slots[i].optimal) {
+            vkGetImageMemoryRequirements(ctx->logical_device, slots[i].image.image, &requirements);
+            allocation = &slots[i].image.allocation;
+        } else {
+            vkGetBufferMemoryRequirements(ctx->logical_device, slots[i].buffer.buffer, &requirements);
+            allocation = &slots[i].buffer.allocation;
+        }
+
+        bench_check(allocation->offset % requirements.alignment == 0, "allocation misaligned");
+        bench_check((requirements.memoryTypeBits >> allocation->memory_type) & 1, "allocation in an unsupported memory type");
+
+        if (allocation->block < 0)
+            continue;
+
+        ranges[ranges_count++] = (BENCH_STRESS_RANGE) {
+            .block     = allocation->block,
+            .offset    = allocation->offset,
+            .size      = requirements.size,
+            .allocated = VK_ALLOCATOR_MIN_SIZE << allocation->order,
+            .optimal   = slots[i].optimal
+        };
+    }
+
+    qsort(ranges, ranges_count, sizeof(BENCH_STRESS_RANGE), bench_compare_ranges);
+
+    /** sorted and disjoint, so a shared page always shows up between neighbours */
+    for (uint32_t i = 1; i < ranges_count; i++) {
+        const BENCH_STRESS_RANGE *previous = &ranges[i - 1];
+        const BENCH_STRESS_RANGE *next     = &ranges[i];
+
+        if (previous->block != next->block)
+            continue;
+
+        bench_check(previous->offset + previous->allocated <= next->offset, "sub-allocations overlap");
+
+        if (previous->optimal != next->optimal)
+            bench_check((previous->offset + previous->size - 1) / granularity < next->offset / granularity,
+                        "buffer and optimal image share a bufferImageGranularity page");
+    }
+}
+
+static void
+bench_stress_destroy
+(
+    VK_CONTEXT *ctx,
+    BENCH_STRESS_SLOT *slot
+)
+{
+    if (slot->optimal)
+        vk_destroy_image(ctx, &slot->image);
+    else
+        vk_destroy_buffer(ctx, &slot->buffer);
+    slot->live = false;
+}
+
+/**
+ * a sample is BENCH_STRESS_OPERATIONS random allocations and frees of buffers and optimal images,
+ * from one byte to a megabyte, in host visible and device local memory. the live set is checked
+ * after every sample, and once everything is freed the statistics must be back to where they started.
+ */
+static BENCH_RESULT
+bench_allocator_stress
+(
+    VK_CONTEXT *ctx,
+    const BENCH_OPTIONS *options
+)
+{
+    uint64_t samples[options->iterations];
+    BENCH_STRESS_SLOT *slots = calloc(BENCH_STRESS_SLOTS, sizeof(BENCH_STRESS_SLOT));
+    uint32_t seed = 0x9E3779B9;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(ctx->physical_device, &properties);
+
+    VK_ALLOCATOR_STATISTICS before;
+    vk_get_allocator_statistics(ctx, &before);
+
+    for (uint32_t i = 0; i < options->warmup + options->iterations; i++) {
+        uint64_t start = vk_get_time_ns();
+
+        for (uint32_t op = 0; op < BENCH_STRESS_OPERATIONS; op++) {
+            BENCH_STRESS_SLOT *slot = &slots[bench_random(&seed) % BENCH_STRESS_SLOTS];
+
+            if (slot->live) {
+                bench_stress_destroy(ctx, slot);
+                continue;
+            }
+
+            slot->live    = true;
+            slot->optimal = bench_random(&seed) & 1;
+
+            if (slot->optimal) {
+                VkImageCreateInfo create_info = {};
+                create_info.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+                create_info.imageType     = VK_IMAGE_TYPE_2D;
+                create_info.format        = VK_FORMAT_R8G8B8A8_UNORM;
+                create_info.extent        = (VkExtent3D) { 1 + bench_random(&seed) % 512, 1 + bench_random(&seed) % 512, 1 };
+                create_info.mipLevels     = 1;
+                create_info.arrayLayers   = 1;
+                create_info.samples       = VK_SAMPLE_COUNT_1_BIT;
+                create_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
+                create_info.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+                create_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+                create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+                vk_create_image(ctx, &create_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &slot->image);
+            } else {
+                /** sizes are skewed towards small buffers, as most of a real frame's are */
+                VkDeviceSize size = 1 + bench_random(&seed) % (1u << (bench_random(&seed) % 21));
+                VkMemoryPropertyFlags memory = (bench_random(&seed) & 1)
+                    ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                    : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+                vk_create_buffer(ctx, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memory, &slot->buffer);
+            }
+        }
+
+        uint64_t elapsed = vk_get_time_ns() - start;
+        bench_check_allocations(ctx, slots, properties.limits.bufferImageGranularity);
+
+        if (i >= options->warmup)
+            samples[i - options->warmup] = elapsed;
+    }
+
+    for (uint32_t i = 0; i < BENCH_STRESS_SLOTS; i++) {
+        if (slots[i].live)
+            bench_stress_destroy(ctx, &slots[i]);
+    }
+    free(slots);
+
+    VK_ALLOCATOR_STATISTICS after;
+    vk_get_allocator_statistics(ctx, &after);
+
+    bench_check(after.allocation_count == before.allocation_count &&
+                after.dedicated_count  == before.dedicated_count, "allocations leaked");
+    bench_check(after.used_bytes      == before.used_bytes &&
+                after.requested_bytes == before.requested_bytes, "used bytes did not return to zero");
+    bench_check(after.total_allocations - before.total_allocations == after.total_frees - before.total_frees,
+                "allocations and frees do not match");
+    /** freed buddies must merge back, or the blocks stay fragmented */
+    bench_check(after.fragmentation == before.fragmentation, "fragmentation did not return to zero");
+
+    VK_LOGF(LOG_INFO, "bench", "Allocator stress: %llu allocations, %llu blocks",
+            (unsigned long long) (after.total_allocations - before.total_allocations), (unsigned long long) after.block_count);
+
+    return bench_summarise("allocator_stress", samples, options->iterations);
+}
+
+/** state is not inherited by secondary buffers, every chunk binds its own */
+static void
+bench_record_chunk
+(
+    VK_CONTEXT *ctx,
+    VkCommandBuffer cmd,
+    uint32_t chunk,
+    void *user_data
+)
+{
+    (void) ctx;
+    const BENCH_FRAME_WORK *work = user_data;
+
+    uint32_t first = (uint32_t) ((uint64_t) work->draws * chunk / work->chunks);
+    uint32_t last  = (uint32_t) ((uint64_t) work->draws * (chunk + 1) / work->chunks);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, work->pipeline);
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+    for (uint32_t d = first; d < last; d++)
+        vkCmdDraw(cmd, 3, 1, 0, 0);
+}
+
+/**
+ * a sample is one frame from vk_begin_frame to vk_end_frame, including the wait on the frame in flight.
+ * with threads 0 the draws are recorded inline, otherwise as secondary buffers on that many recorder threads.
+ */
+static BENCH_RESULT
+bench_frames
+(
+    VK_CONTEXT *ctx,
+    const BENCH_OPTIONS *options,
+    const VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    const char *name,
+    uint32_t threads
+)
+{
+    uint64_t *samples = malloc(sizeof(uint64_t) * (options->frames ? options->frames : 1));
+
+    vk_create_offscreen_targets(ctx, (VkExtent2D) { W, H }, VK_FORMAT_R8G8B8A8_UNORM, OFFSCREEN_COUNT);
+    vk_create_pipeline(ctx, *pipeline_specification, shader_files, 2);
+    vk_create_framebuffers(ctx);
+    vk_create_frames(ctx, FRAMES_IN_FLIGHT);
+    if (threads)
+        vk_create_recorder(ctx, threads);
+
+    VkClearValue clear_value = { .color = { .float32 = { 0.0f, 0.0f, 0.0f, 1.0f } } };
+
+    BENCH_FRAME_WORK work = {
+        .pipeline = ctx->pipeline,
+        .draws    = options->draws,
+        .chunks   = options->chunks
+    };
+
+    for (uint32_t i = 0; i < options->warmup + options->frames; i++) {
+        uint64_t start = vk_get_time_ns();
+
+        VkCommandBuffer cmd = vk_begin_frame(ctx);
+
+        VkRenderPassBeginInfo render_pass_begin_info = {};
+        render_pass_begin_info.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_begin_info.renderPass        = ctx->render_pass;
+        render_pass_begin_info.framebuffer       = ctx->framebuffers[ctx->image_index];
+        render_pass_begin_info.renderArea.extent = ctx->swapchain_details.extent;
+        render_pass_begin_info.clearValueCount   = 1;
+        render_pass_begin_info.pClearValues      = &clear_value;
+
+        if (threads) {
+            vkCmdBeginRenderPass(cmd, &render_pass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vk_record_secondary(ctx, cmd, ctx->render_pass, 0, ctx->framebuffers[ctx->image_index], options->chunks, bench_record_chunk, &work);
+        } else {
+            vkCmdBeginRenderPass(cmd, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+            work.chunks = 1;
+            bench_record_chunk(ctx, cmd, 0, &work);
+        }
+        vkCmdEndRenderPass(cmd);
+
+        vk_end_frame(ctx);
+
+        if (i >= options->warmup)
+            samples[i - options->warmup] = vk_get_time_ns() - start;
+    }
+
+    VK_CHECK(vkDeviceWaitIdle(ctx->logical_device));
+
+    vk_destroy_recorder(ctx);
+    vk_destroy_frames(ctx);
+    vkDestroyPipeline(ctx->logical_device, ctx->pipeline, NULL);
+    vk_release_pipeline_layout(ctx, ctx->pipeline_layout);
+    /* destroys the framebuffers and the offscreen targets */
+    vk_destroy_swapchain(ctx);
+    vk_release_render_pass(ctx, ctx->render_pass);
+    ctx->pipeline_layout = VK_NULL_HANDLE;
+    ctx->render_pass     = VK_NULL_HANDLE;
+
+    BENCH_RESULT result = bench_summarise(name, samples, options->frames);
+    free(samples);
+    return result;
+}
+
+/**
+ * options->draws objects culled on the GPU and drawn with one indirect draw, the CPU counterpart of
+ * the frames scenario. every other object is outside the frustum, so half of them survive the cull.
+ */
+static BENCH_RESULT
+bench_frames_indirect
+(
+    VK_CONTEXT *ctx,
+    const BENCH_OPTIONS *options,
+    const VK_PIPELINE_SPECIFICATION *pipeline_specification
+)
+{
+    uint64_t *samples = malloc(sizeof(uint64_t) * (options->frames ? options->frames : 1));
+    uint32_t objects_count = (options->draws) ? options->draws : 1;
+
+    vk_create_offscreen_targets(ctx, (VkExtent2D) { W, H }, VK_FORMAT_R8G8B8A8_UNORM, OFFSCREEN_COUNT);
+    vk_create_frames(ctx, FRAMES_IN_FLIGHT);
+    vk_create_uploader(ctx, BENCH_UPLOAD_SIZE);
+
+    VK_INDIRECT_CULLER culler;
+    vk_create_indirect_culler(ctx, "shaders/cull.comp.spv", objects_count, 1, &culler);
+
+    VK_PIPELINE_SPECIFICATION specification = *pipeline_specification;
+    specification.descriptor_set_layouts_count = 1;
+    specification.descriptor_set_layouts       = &culler.draw_set_layout;
+
+    vk_create_pipeline(ctx, specification, indirect_shader_files, 2);
+    vk_create_framebuffers(ctx);
+
+    /** the triangle shader takes its positions from gl_VertexIndex, the stored ones are never fetched */
+    static const float    positions[] = { 0.0f, -0.5f, 0.0f,  0.5f, 0.5f, 0.0f,  -0.5f, 0.5f, 0.0f };
+    static const uint32_t indices[]   = { 0, 1, 2 };
+
+    VK_MESH_STORE store;
+    VK_MESH       mesh;
+    vk_create_mesh_store(ctx, VK_MESH_INTERLEAVED, sizeof(float) * 3, sizeof(float) * 3, 3, 3, &store);
+    vk_add_mesh(ctx, &store, positions, 3, indices, 3, &mesh);
+
+    VK_INDIRECT_MESH indirect_mesh = {
+        .index_count   = mesh.index_count,
+        .first_index   = mesh.first_index,
+        .vertex_offset = (int32_t) mesh.first_vertex
+    };
+    vk_set_indirect_meshes(ctx, &culler, &indirect_mesh, 1);
+
+    VK_INDIRECT_OBJECT *objects    = calloc(objects_count, sizeof(VK_INDIRECT_OBJECT));
+    float              *transforms = calloc(objects_count, sizeof(float) * 16);
+
+    for (uint32_t i = 0; i < objects_count; i++) {
+        objects[i].radius = 0.75f;
+
+        float *transform = &transforms[i * 16];
+        transform[0] = transform[5] = transform[10] = transform[15] = 1.0f;
+        if (i & 1)
+            transform[12] = 10.0f;
+    }
+    vk_set_indirect_objects(ctx, &culler, objects, objects_count);
+
+    static const float view_projection[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+    VkClearValue clear_value = { .color = { .float32 = { 0.0f, 0.0f, 0.0f, 1.0f } } };
+
+    for (uint32_t i = 0; i < options->warmup + options->frames; i++) {
+        uint64_t start = vk_get_time_ns();
+
+        VkCommandBuffer cmd = vk_begin_frame(ctx);
+
+        /** a real scene moves its objects every frame, so the transforms are written every frame */
+        memcpy(vk_get_indirect_transforms(ctx, &culler), transforms, sizeof(float) * 16 * objects_count);
+        vk_cull_indirect(ctx, &culler, cmd, view_projection);
+
+        VkRenderPassBeginInfo render_pass_begin_info = {};
+        render_pass_begin_info.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_begin_info.renderPass        = ctx->render_pass;
+        render_pass_begin_info.framebuffer       = ctx->framebuffers[ctx->image_index];
+        render_pass_begin_info.renderArea.extent = ctx->swapchain_details.extent;
+        render_pass_begin_info.clearValueCount   = 1;
+        render_pass_begin_info.pClearValues      = &clear_value;
+
+        vkCmdBeginRenderPass(cmd, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->pipeline);
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+        vk_bind_mesh_store(ctx, &store, cmd, false);
+        vk_draw_indirect(ctx, &culler, cmd, ctx->pipeline_layout, 0);
+        vkCmdEndRenderPass(cmd);
+
+        vk_end_frame(ctx);
+
+        if (i >= options->warmup)
+            samples[i - options->warmup] = vk_get_time_ns() - start;
+    }
+
+    VK_CHECK(vkDeviceWaitIdle(ctx->logical_device));
+
+    free(transforms);
+    free(objects);
+    vk_destroy_indirect_culler(ctx, &culler);
+    vk_destroy_mesh_store(ctx, &store);
+    vk_destroy_uploader(ctx);
+    vk_destroy_frames(ctx);
+    vkDestroyPipeline(ctx->logical_device, ctx->pipeline, NULL);
+    vk_release_pipeline_layout(ctx, ctx->pipeline_layout);
+    /* destroys the framebuffers and the offscreen targets */
+    vk_destroy_swapchain(ctx);
+    vk_release_render_pass(ctx, ctx->render_pass);
+    ctx->pipeline_layout = VK_NULL_HANDLE;
+    ctx->render_pass     = VK_NULL_HANDLE;
+
+    BENCH_RESULT result = bench_summarise("frames_indirect", samples, options->frames);
+    free(samples);
+    return result;
+}
+
+/**
+ * writes an uncompressed RGBA8 KTX2 file with levels levels, or level 0 only with levels 0 so the chain is generated.
+ * levels are stored smallest first like the KTX2 tools do. the data format descriptor is left out, the loader ignores it.
+ */
+static void
+bench_write_texture
+(
+    const char *filename,
+    uint32_t extent,
+    uint32_t levels,
+    uint8_t seed
+)
+{
+    static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    uint32_t stored = (levels) ? levels : 1;
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        VK_LOGF(LOG_ERROR, "bench", "Could not write texture %s", filename);
+        exit(-1);
+    }
+
+    /** identifier, format, type size, width, height, depth, layers, faces, levels, supercompression, dfd and kvd */
+    uint32_t header[16] = {};
+    uint64_t sgd[2]     = {};
+    memcpy(header, identifier, sizeof(identifier));
+    header[3]  = VK_FORMAT_R8G8B8A8_UNORM;
+    header[4]  = 1;
+    header[5]  = extent;
+    header[6]  = extent;
+    header[9]  = 1;
+    header[10] = levels;
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(sgd, sizeof(sgd), 1, file);
+
+    /** byte offset, byte length and uncompressed byte length of every level, a 2D image has at most 32 */
+    uint64_t index[32][3];
+    uint64_t offset = sizeof(header) + sizeof(sgd) + sizeof(uint64_t[3]) * stored;
+
+    for (uint32_t level = stored; level-- > 0;) {
+        uint64_t size = 4ull * (extent >> level) * (extent >> level);
+        index[level][0] = offset;
+        index[level][1] = size;
+        index[level][2] = size;
+        offset += size;
+    }
+    fwrite(index, sizeof(uint64_t[3]), stored, file);
+
+    for (uint32_t level = stored; level-- > 0;) {
+        size_t   size = index[level][1];
+        uint8_t *data = malloc(size);
+
+        for (size_t i = 0; i < size; i++)
+            data[i] = (uint8_t) (i * 7 + level * 31 + seed);
+        fwrite(data, 1, size, file);
+        free(data);
+    }
+    fclose(file);
+}
+
+/**
+ * a sample is loading BENCH_TEXTURES textures through the streamer until all of them are fully detailed,
+ * one vk_update_texture_streamer per headless frame. the largest level fills the staging ring, so the
+ * loading jobs run into a full ring and must stall and resume without holding up the frames.
+ * the upload batches complete on the scheduler's counters, timeline semaphores or their fence emulation.
+ */
+static BENCH_RESULT
+bench_texture_streaming
+(
+    VK_CONTEXT *ctx,
+    const BENCH_OPTIONS *options,
+    const char *name
+)
+{
+    uint64_t samples[options->iterations];
+    char filenames[BENCH_TEXTURES + 1][32];
+    uint32_t full_levels = 1;
+
+    while (BENCH_TEXTURE_EXTENT >> full_levels)
+        full_levels++;
+
+    /** the last texture has level 0 only, its chain is blitted on the graphics queue */
+    for (uint32_t i = 0; i <= BENCH_TEXTURES; i++) {
+        snprintf(filenames[i], sizeof(filenames[i]), "bench_texture_%u.ktx2", i);
+        bench_write_texture(filenames[i], BENCH_TEXTURE_EXTENT >> (i == BENCH_TEXTURES), (i < BENCH_TEXTURES) ? full_levels : 0, (uint8_t) i);
+    }
+
+    vk_create_offscreen_targets(ctx, (VkExtent2D) { W, H }, VK_FORMAT_R8G8B8A8_UNORM, OFFSCREEN_COUNT);
+    vk_create_frames(ctx, FRAMES_IN_FLIGHT);
+    vk_create_uploader(ctx, BENCH_UPLOAD_SIZE);
+
+    uint32_t frames_total = 0;
+
+    for (uint32_t i = 0; i < options->warmup + options->iterations; i++) {
+        VK_TEXTURE_STREAMER streamer;
+        VK_TEXTURE *textures[BENCH_TEXTURES + 1];
+        uint32_t frames = 0;
+        bool done = false;
+
+        uint64_t start = vk_get_time_ns();
+
+        vk_create_texture_streamer(ctx, BENCH_TEXTURE_BUDGET, &streamer);
+        for (uint32_t t = 0; t <= BENCH_TEXTURES; t++)
+            textures[t] = vk_load_texture(ctx, &streamer, filenames[t]);
+
+        while (!done && frames++ < BENCH_TEXTURE_FRAMES) {
+            VkCommandBuffer cmd = vk_begin_frame(ctx);
+            vk_update_texture_streamer(ctx, &streamer, cmd);
+            vk_end_frame(ctx);
+
+            done = true;
+            for (uint32_t t = 0; t <= BENCH_TEXTURES; t++) {
+                uint32_t state = atomic_load(&textures[t]->state);
+
+                bench_check(state != VK_TEXTURE_FAILED, "texture failed to load");
+                if (state != VK_TEXTURE_IDLE || textures[t]->first_level > textures[t]->stream_limit)
+                    done = false;
+            }
+        }
+        VK_CHECK(vkDeviceWaitIdle(ctx->logical_device));
+
+        uint64_t elapsed = vk_get_time_ns() - start;
+
+        bench_check(done, "textures did not reach full detail");
+        bench_check(streamer.resident <= streamer.budget && streamer.reserved == 0, "texture budget exceeded");
+        for (uint32_t t = 0; t <= BENCH_TEXTURES; t++)
+            bench_check(textures[t]->generation > 0 && textures[t]->view != VK_NULL_HANDLE, "texture has no view");
+
+        vk_destroy_texture_streamer(ctx, &streamer);
+        frames_total += frames;
+
+        if (i >= options->warmup)
+            samples[i - options->warmup] = elapsed;
+    }
+
+    VK_LOGF(LOG_INFO, "bench", "Texture streaming: %.1f frames a load, %u scheduler submissions in %u vkQueueSubmit calls",
+            (double) frames_total / (options->warmup + options->iterations), ctx->scheduler.submissions, ctx->scheduler.submit_calls);
+
+    vk_destroy_uploader(ctx);
+    vk_destroy_frames(ctx);
+    vk_destroy_offscreen_targets(ctx);
+
+    for (uint32_t i = 0; i <= BENCH_TEXTURES; i++)
+        remove(filenames[i]);
+
+    return bench_summarise(name, samples, options->iterations);
+}
+
+static void
+bench_write_results
+(
+    VK_CONTEXT *ctx,
+    const BENCH_OPTIONS *options,
+    const BENCH_RESULT *results,
+    uint32_t results_count
+)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(ctx->physical_device, &properties);
+
+    FILE *file = fopen(options->output, "w");
+    if (file == NULL) {
+        VK_LOG(LOG_WARNING, "Could not open benchmark output file");
+        return;
+    }
+
+    fprintf(file, "{\n  \"device\": \"%s\",\n", properties.deviceName);
+    fprintf(file, "  \"iterations\": %u,\n  \"warmup\": %u,\n  \"pipelines\": %u,\n  \"frames\": %u,\n  \"draws\": %u,\n  \"threads\": %u,\n  \"chunks\": %u,\n",
+            options->iterations, options->warmup, options->pipelines, options->frames, options->draws, options->threads, options->chunks);
+    fputs("  \"scenarios\": [", file);
+
+    for (uint32_t i = 0; i < results_count; i++) {
+        fprintf(file, "%s\n    { \"name\": \"%s\", \"samples\": %u, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f }",
+                (i) ? "," : "", results[i].name, results[i].samples, results[i].mean, results[i].p50, results[i].p99, results[i].max);
+    }
+
+    fputs("\n  ]\n}\n", file);
+    fclose(file);
+}
+
+static void
+bench_usage
+(
+    const char *program
+)
+{
+    fprintf(stderr,
+            "usage: %s [--iterations N] [--warmup N] [--pipelines N] [--frames N] [--draws N]\n"
+            "       [--threads N] [--chunks N] [--output FILE]\n",
+            program);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    BENCH_OPTIONS options = {
+        .iterations = 10,
+        .warmup     = 2,
+        .pipelines  = 64,
+        .frames     = 500,
+        .draws      = 100,
+        .threads    = 0,
+        .chunks     = 32,
+        .output     = "bench.json"
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc)
+            bench_usage(argv[0]);
+
+        const char *value = argv[++i];
+
+        if      (!strcmp(argv[i - 1], "--iterations")) options.iterations = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--warmup"))     options.warmup     = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--pipelines"))  options.pipelines  = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--frames"))     options.frames     = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--draws"))      options.draws      = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--threads"))    options.threads    = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--chunks"))     options.chunks     = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--output"))     options.output     = value;
+        else bench_usage(argv[0]);
+    }
+
+    if (options.iterations == 0 || options.chunks == 0)
+        bench_usage(argv[0]);
+
+    if (options.threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        options.threads = (cpus > 0) ? (uint32_t) cpus : 1;
+    }
+
+    /**
+     * Mesa keeps compiled shaders in an on-disk cache of its own, which would make cold starts warm.
+     * it is read when the devices are enumerated, so it has to be off before the first instance.
+     */
+    setenv("MESA_SHADER_CACHE_DISABLE", "true", 1);
+
+    vk_create_logger(NULL, NULL);
+
+    BENCH_RESULT results[BENCH_MAX_RESULTS];
+    uint32_t results_count = 0;
+
+    results[results_count++] = bench_instance_device(&options);
+
+    /** the remaining scenarios share one device */
+    VK_CONTEXT ctx = {};
+    VK_PIPELINE_SPECIFICATION pipeline_specification;
+
+    bench_create_device(&ctx, NULL);
+    vk_create_job_system(&ctx, options.threads);
+    vk_create_allocator(&ctx, 0);
+    vk_create_scheduler(&ctx);
+    vk_create_shader_cache(&ctx);
+    bench_pipeline_specification(&pipeline_specification, VK_FORMAT_R8G8B8A8_UNORM);
+
+    results[results_count++] = bench_pipelines(&ctx, &options, &pipeline_specification, false);
+    results[results_count++] = bench_pipelines(&ctx, &options, &pipeline_specification, true);
+    results[results_count++] = bench_offscreen_targets(&ctx, &options);
+    /** nothing else is allocated here, so the statistics it compares start at zero */
+    results[results_count++] = bench_allocator_stress(&ctx, &options);
+    results[results_count++] = bench_frames(&ctx, &options, &pipeline_specification, "frames", 0);
+    /** the same secondary buffers recorded on one thread and on all of them, the ratio is the recording speedup */
+    results[results_count++] = bench_frames(&ctx, &options, &pipeline_specification, "frames_secondary_1", 1);
+    results[results_count++] = bench_frames(&ctx, &options, &pipeline_specification, "frames_secondary_n", options.threads);
+    results[results_count++] = bench_frames_indirect(&ctx, &options, &pipeline_specification);
+    /** the device enables no timeline semaphores, so the scheduler emulates them with fences */
+    bench_check(!ctx.scheduler.timeline, "scheduler is not emulating timelines");
+    results[results_count++] = bench_texture_streaming(&ctx, &options, "texture_streaming");
+
+    /** the same uploads on a second device with timeline semaphores enabled */
+    {
+        VK_CONTEXT timeline_ctx = {};
+        VkPhysicalDeviceVulkan12Features features = {
+            .sType             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .timelineSemaphore = VK_TRUE
+        };
+
+        bench_create_device(&timeline_ctx, &features);
+        vk_create_job_system(&timeline_ctx, options.threads);
+        vk_create_allocator(&timeline_ctx, 0);
+        vk_create_scheduler(&timeline_ctx);
+
+        bench_check(timeline_ctx.scheduler.timeline, "scheduler is not using timeline semaphores");
+        results[results_count++] = bench_texture_streaming(&timeline_ctx, &options, "texture_streaming_timeline");
+
+        vk_destroy_scheduler(&timeline_ctx);
+        vk_destroy_allocator(&timeline_ctx);
+        vk_destroy_init_report(&timeline_ctx);
+        vk_destroy_job_system(&timeline_ctx);
+        bench_destroy_device(&timeline_ctx);
+    }
+
+    bench_write_results(&ctx, &options, results, results_count);
+
+    remove(PIPELINE_CACHE_FILE);
+    vk_destroy_scheduler(&ctx);
+    vk_destroy_shader_cache(&ctx);
+    vk_destroy_allocator(&ctx);
+    vk_destroy_init_report(&ctx);
+    vk_destroy_job_system(&ctx);
+    bench_destroy_device(&ctx);
+
+    vk_destroy_logger();
+    return 0;
+}
@@ -0,0 +1,279 @@
+#include "vkInit.h"
+
+void
+vk_create_compute_pipeline
+(
+    VK_CONTEXT *context,
+    VK_COMPUTE_PIPELINE_SPECIFICATION pipeline_specification,
+    const char *filename,
+    VK_COMPUTE_PIPELINE *pipeline
+)
+{
+    VkShaderModule shader_module;
+
+    if (vk_get_shader_stage(filename) != VK_SHADER_STAGE_COMPUTE_BIT)
+    {
+        VK_LOG(LOG_ERROR, "Compute pipeline requires a .comp shader");
+        exit(-1);
+    }
+
+    if (!vk_load_shader_module(context, filename, &shader_module))
+    {
+        VK_LOG(LOG_ERROR, "Could not load compute shader");
+        exit(-1);
+    }
+
+    VkPipelineLayoutCreateInfo layout_create_info = {};
+    layout_create_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.setLayoutCount         = pipeline_specification.descriptor_set_layouts_count;
+    layout_create_info.pSetLayouts            = pipeline_specification.descriptor_set_layouts;
+    layout_create_info.pushConstantRangeCount = pipeline_specification.push_constant_ranges_count;
+    layout_create_info.pPushConstantRanges    = pipeline_specification.push_constant_ranges;
+
+    pipeline->layout = vk_get_pipeline_layout(context, &layout_create_info);
+
+    VkSpecializationInfo specialization_info;
+
+    VkPipelineShaderStageCreateInfo stage_create_info = {};
+    stage_create_info.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stage_create_info.stage               = VK_SHADER_STAGE_COMPUTE_BIT;
+    stage_create_info.module              = shader_module;
+    stage_create_info.pName               = "main";
+    stage_create_info.pSpecializationInfo = vk_get_specialization_info(pipeline_specification.specialization, &specialization_info);
+
+    VkComputePipelineCreateInfo compute_pipeline_create_info = {};
+    compute_pipeline_create_info.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    compute_pipeline_create_info.stage  = stage_create_info;
+    compute_pipeline_create_info.layout = pipeline->layout;
+
+    /** shares the graphics pipeline cache, so compute pipelines are warm on the next run too */
+    uint64_t start = vk_get_time_ns();
+    VK_CHECK(vkCreateComputePipelines(context->logical_device, context->pipeline_cache, 1, &compute_pipeline_create_info, NULL, &pipeline->pipeline));
+    uint64_t elapsed = vk_get_time_ns() - start;
+    vk_record_init_stage(context, "create compute pipeline", start);
+
+    context->pipeline_cache_details.pipeline_time += elapsed;
+    context->pipeline_cache_details.pipeline_count++;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Created Compute Pipeline (%.3f ms)", elapsed / 1e6);
+    VK_LOG(LOG_INFO, msg);
+
+    vk_release_shader_module(context, shader_module);
+}
+
+void
+vk_destroy_compute_pipeline
+(
+    VK_CONTEXT *context,
+    VK_COMPUTE_PIPELINE *pipeline
+)
+{
+    vkDestroyPipeline(context->logical_device, pipeline->pipeline, NULL);
+    vk_release_pipeline_layout(context, pipeline->layout);
+    *pipeline = (VK_COMPUTE_PIPELINE) {};
+}
+
+void
+vk_create_compute
+(
+    VK_CONTEXT *context
+)
+{
+    VK_COMPUTE *compute = &context->compute;
+
+    *compute = (VK_COMPUTE) {};
+
+    /** prefer the async compute family, graphics queues are always able to dispatch */
+    uint32_t role = (context->queue_families.found[COMPUTE]) ? COMPUTE : GRAPHICS;
+
+    compute->queue  = context->queues[role];
+    compute->family = context->queue_families.indicies[role];
+
+    VkCommandPoolCreateInfo pool_create_info = {};
+    pool_create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_create_info.queueFamilyIndex = compute->family;
+
+    VK_CHECK(vkCreateCommandPool(context->logical_device, &pool_create_info, NULL, &compute->command_pool));
+
+    VkCommandBuffer command_buffers[VK_COMPUTE_BATCHES];
+
+    VkCommandBufferAllocateInfo allocate_info = {};
+    allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool        = compute->command_pool;
+    allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = VK_COMPUTE_BATCHES;
+
+    VK_CHECK(vkAllocateCommandBuffers(context->logical_device, &allocate_info, command_buffers));
+
+    VkFenceCreateInfo fence_create_info = {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkSemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < VK_COMPUTE_BATCHES; i++) {
+        VK_COMPUTE_BATCH *batch = &compute->batches[i];
+
+        batch->command_buffer = command_buffers[i];
+        VK_CHECK(vkCreateFence(context->logical_device, &fence_create_info, NULL, &batch->fence));
+        VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &batch->semaphore));
+    }
+
+    if (role == GRAPHICS)
+        VK_LOG(LOG_WARNING, "No dedicated compute queue, dispatching on graphics");
+    VK_LOG(LOG_INFO, "Created Compute");
+}
+
+void
+vk_destroy_compute
+(
+    VK_CONTEXT *context
+)
+{
+    VK_COMPUTE *compute = &context->compute;
+
+    if (compute->command_pool == VK_NULL_HANDLE)
+        return;
+
+    for (uint32_t i = 0; i < VK_COMPUTE_BATCHES; i++) {
+        VK_COMPUTE_BATCH *batch = &compute->batches[i];
+
+        if (batch->submitted)
+            VK_CHECK(vkWaitForFences(context->logical_device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+
+        vkDestroySemaphore(context->logical_device, batch->semaphore, NULL);
+        vkDestroyFence(context->logical_device, batch->fence, NULL);
+    }
+    vkDestroyCommandPool(context->logical_device, compute->command_pool, NULL);
+
+    *compute = (VK_COMPUTE) {};
+}
+
+/** returns the command buffer of the batch being recorded, starting a new one if needed */
+VkCommandBuffer
+vk_get_compute_command_buffer
+(
+    VK_CONTEXT *context
+)
+{
+    VK_COMPUTE_BATCH *batch = &context->compute.batches[context->compute.current_batch];
+
+    if (batch->recording)
+        return batch->command_buffer;
+
+    /** slots are reused round robin, so a submitted slot is always the oldest in flight */
+    if (batch->submitted) {
+        VK_CHECK(vkWaitForFences(context->logical_device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+        VK_CHECK(vkResetFences(context->logical_device, 1, &batch->fence));
+        batch->submitted = false;
+    }
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkResetCommandBuffer(batch->command_buffer, 0));
+    VK_CHECK(vkBeginCommandBuffer(batch->command_buffer, &begin_info));
+
+    batch->recording      = true;
+    batch->dispatch_count = 0;
+
+    return batch->command_buffer;
+}
+
+void
+vk_dispatch_compute
+(
+    VK_CONTEXT *context,
+    VK_COMPUTE_PIPELINE *pipeline,
+    const VkDescriptorSet *descriptor_sets,
+    uint32_t descriptor_sets_count,
+    const void *push_constants,
+    uint32_t push_constants_size,
+    uint32_t group_count_x,
+    uint32_t group_count_y,
+    uint32_t group_count_z
+)
+{
+    VK_COMPUTE_BATCH *batch = &context->compute.batches[context->compute.current_batch];
+    VkCommandBuffer command_buffer = vk_get_compute_command_buffer(context);
+
+    /** dispatches in a batch usually feed each other, make earlier writes visible to later reads */
+    if (batch->dispatch_count > 0) {
+        VkMemoryBarrier barrier = {};
+        barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        vkCmdPipelineBarrier
+        (
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1, &barrier,
+            0, NULL,
+            0, NULL
+        );
+    }
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline);
+
+    if (descriptor_sets_count > 0)
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout, 0, descriptor_sets_count, descriptor_sets, 0, NULL);
+
+    if (push_constants_size > 0)
+        vkCmdPushConstants(command_buffer, pipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, push_constants_size, push_constants);
+
+    vkCmdDispatch(command_buffer, group_count_x, group_count_y, group_count_z);
+    batch->dispatch_count++;
+}
+
+/**
+ * submits the recorded dispatches to the compute queue.
+ * if signal is true the returned semaphore must be waited on exactly once,
+ * usually through vk_frame_wait_semaphore, before this batch slot comes around again.
+ * resources shared with graphics on a different family need VK_SHARING_MODE_CONCURRENT
+ * or ownership barriers recorded by the caller.
+ */
+VkSemaphore
+vk_submit_compute
+(
+    VK_CONTEXT *context,
+    const VkSemaphore *wait_semaphores,
+    const VkPipelineStageFlags *wait_stages,
+    uint32_t wait_semaphores_count,
+    bool signal
+)
+{
+    VK_COMPUTE *compute = &context->compute;
+    VK_COMPUTE_BATCH *batch = &compute->batches[compute->current_batch];
+
+    if (!batch->recording) {
+        VK_LOG(LOG_WARNING, "No compute work recorded, nothing to submit");
+        return VK_NULL_HANDLE;
+    }
+
+    VK_CHECK(vkEndCommandBuffer(batch->command_buffer));
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount   = wait_semaphores_count;
+    submit_info.pWaitSemaphores      = wait_semaphores;
+    submit_info.pWaitDstStageMask    = wait_stages;
+    submit_info.commandBufferCount   = 1;
+    submit_info.pCommandBuffers      = &batch->command_buffer;
+    submit_info.signalSemaphoreCount = (signal) ? 1 : 0;
+    submit_info.pSignalSemaphores    = &batch->semaphore;
+
+    VK_CHECK(vk_queue_submit(context, compute->queue, 1, &submit_info, batch->fence));
+
+    batch->recording = false;
+    batch->submitted = true;
+
+    compute->current_batch = (compute->current_batch + 1) % VK_COMPUTE_BATCHES;
+
+    return (signal) ? batch->semaphore : VK_NULL_HANDLE;
+}
@@ -0,0 +1,198 @@
+#include "vkInit.h"
+
+/**
+ * creates a pool of sets sets, the descriptors of each type are in the ratio counts has to count_sets.
+ * layout_counts are the descriptors of the set that did not fit, a pool always has room for it.
+ */
+static VkDescriptorPool
+vk_create_descriptor_pool
+(
+    VK_CONTEXT *context,
+    uint32_t sets,
+    const uint32_t *counts,
+    uint32_t counts_sets,
+    const uint32_t *layout_counts
+)
+{
+    VkDescriptorPoolSize pool_sizes[VK_DESCRIPTOR_TYPES];
+    uint32_t pool_sizes_count = 0;
+
+    for (uint32_t type = 0; type < VK_DESCRIPTOR_TYPES; type++) {
+        uint64_t count = (counts_sets) ? ((uint64_t) counts[type] * sets + counts_sets - 1) / counts_sets : 0;
+
+        if (layout_counts != NULL && count < layout_counts[type])
+            count = layout_counts[type];
+        if (count == 0)
+            continue;
+
+        pool_sizes[pool_sizes_count++] = (VkDescriptorPoolSize) {
+            .type            = (VkDescriptorType) type,
+            .descriptorCount = (uint32_t) count
+        };
+    }
+
+    /** a pool needs at least one size, even if only sets without bindings are allocated from it */
+    if (pool_sizes_count == 0) {
+        pool_sizes[pool_sizes_count++] = (VkDescriptorPoolSize) {
+            .type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1
+        };
+    }
+
+    VkDescriptorPoolCreateInfo pool_create_info = {};
+    pool_create_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_create_info.maxSets       = sets;
+    pool_create_info.poolSizeCount = pool_sizes_count;
+    pool_create_info.pPoolSizes    = pool_sizes;
+
+    VkDescriptorPool pool;
+    VK_CHECK(vkCreateDescriptorPool(context->logical_device, &pool_create_info, NULL, &pool));
+    return pool;
+}
+
+static void
+vk_push_descriptor_pool
+(
+    VK_DESCRIPTOR_ALLOCATOR *allocator,
+    VkDescriptorPool pool,
+    uint32_t sets
+)
+{
+    if (allocator->pools_count == allocator->pools_capacity) {
+        allocator->pools_capacity = (allocator->pools_capacity) ? allocator->pools_capacity * 2 : 4;
+        allocator->pools = realloc(allocator->pools, sizeof(VkDescriptorPool) * allocator->pools_capacity);
+    }
+    allocator->pools[allocator->pools_count++] = pool;
+    allocator->pool_sets = sets;
+}
+
+/** pools are created on the first allocation, so an unused allocator costs nothing */
+void
+vk_create_descriptor_allocator
+(
+    VK_CONTEXT *context,
+    VK_DESCRIPTOR_ALLOCATOR *allocator
+)
+{
+    (void) context;
+    *allocator = (VK_DESCRIPTOR_ALLOCATOR) {};
+}
+
+/** sets allocated from it must no longer be in use by the GPU */
+void
+vk_destroy_descriptor_allocator
+(
+    VK_CONTEXT *context,
+    VK_DESCRIPTOR_ALLOCATOR *allocator
+)
+{
+    for (uint32_t i = 0; i < allocator->pools_count; i++)
+        vkDestroyDescriptorPool(context->logical_device, allocator->pools[i], NULL);
+    free(allocator->pools);
+
+    *allocator = (VK_DESCRIPTOR_ALLOCATOR) {};
+}
+
+/**
+ * frees every set at once, the sets must no longer be in use by the GPU.
+ * if the sets did not fit one pool the pools are replaced by one sized for what was used, with headroom.
+ */
+void
+vk_reset_descriptor_allocator
+(
+    VK_CONTEXT *context,
+    VK_DESCRIPTOR_ALLOCATOR *allocator
+)
+{
+    if (allocator->pools_count > 1) {
+        for (uint32_t i = 0; i < allocator->pools_count; i++)
+            vkDestroyDescriptorPool(context->logical_device, allocator->pools[i], NULL);
+        allocator->pools_count = 0;
+
+        uint32_t sets = allocator->sets + allocator->sets / 2;
+        if (sets < VK_DESCRIPTOR_POOL_SETS)
+            sets = VK_DESCRIPTOR_POOL_SETS;
+
+        VkDescriptorPool pool = vk_create_descriptor_pool(context, sets, allocator->counts, allocator->sets, NULL);
+        vk_push_descriptor_pool(allocator, pool, sets);
+
+        VK_LOGF(LOG_DEBUG, "vk", "Merged descriptor pools into one of %u sets", sets);
+    } else if (allocator->pools_count == 1) {
+        VK_CHECK(vkResetDescriptorPool(context->logical_device, allocator->pools[0], 0));
+    }
+
+    allocator->sets = 0;
+    memset(allocator->counts, 0, sizeof(allocator->counts));
+}
+
+/**
+ * allocates from the current pool and moves to a new, larger one when it is full.
+ * only layouts from vk_get_descriptor_set_layout count towards pool sizes.
+ */
+VkDescriptorSet
+vk_allocate_descriptor_set
+(
+    VK_CONTEXT *context,
+    VK_DESCRIPTOR_ALLOCATOR *allocator,
+    VkDescriptorSetLayout layout
+)
+{
+    uint32_t layout_counts[VK_DESCRIPTOR_TYPES];
+    vk_get_descriptor_set_layout_counts(context, layout, layout_counts);
+
+    VkDescriptorSetAllocateInfo allocate_info = {};
+    allocate_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts        = &layout;
+
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkResult result = VK_ERROR_OUT_OF_POOL_MEMORY;
+
+    if (allocator->pools_count > 0) {
+        allocate_info.descriptorPool = allocator->pools[allocator->pools_count - 1];
+        result = vkAllocateDescriptorSets(context->logical_device, &allocate_info, &set);
+    }
+
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        /** doubling stops at the max, a merged pool may already be larger and keeps its size */
+        uint32_t max_sets = (allocator->pool_sets > VK_DESCRIPTOR_POOL_MAX_SETS) ? allocator->pool_sets : VK_DESCRIPTOR_POOL_MAX_SETS;
+        uint32_t sets     = allocator->pool_sets * 2;
+        if (sets < VK_DESCRIPTOR_POOL_SETS)
+            sets = VK_DESCRIPTOR_POOL_SETS;
+        if (sets > max_sets)
+            sets = max_sets;
+
+        /** the usage so far plus the set that did not fit, so a new mix of layouts still gets room */
+        uint32_t counts[VK_DESCRIPTOR_TYPES];
+        for (uint32_t type = 0; type < VK_DESCRIPTOR_TYPES; type++)
+            counts[type] = allocator->counts[type] + layout_counts[type];
+
+        VkDescriptorPool pool = vk_create_descriptor_pool(context, sets, counts, allocator->sets + 1, layout_counts);
+        vk_push_descriptor_pool(allocator, pool, sets);
+
+        allocate_info.descriptorPool = pool;
+        result = vkAllocateDescriptorSets(context->logical_device, &allocate_info, &set);
+    }
+
+    if (result != VK_SUCCESS) {
+        VK_LOGF(LOG_ERROR, "vk", "Could not allocate descriptor set (VkResult %d)", result);
+        exit(-1);
+    }
+
+    allocator->sets++;
+    for (uint32_t type = 0; type < VK_DESCRIPTOR_TYPES; type++)
+        allocator->counts[type] += layout_counts[type];
+
+    return set;
+}
+
+/** a set that is valid until the current frame in flight begins again, must be called inside a frame */
+VkDescriptorSet
+vk_allocate_frame_descriptor_set
+(
+    VK_CONTEXT *context,
+    VkDescriptorSetLayout layout
+)
+{
+    return vk_allocate_descriptor_set(context, &context->frames[context->current_frame].descriptors, layout);
+}
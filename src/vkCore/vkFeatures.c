@@ -0,0 +1,131 @@
+#include "vkInit.h"
+
+/** end of the last member, sizeof would count the tail padding of structs with an odd number of members */
+#define VK_FEATURE_STRUCT(type, name, last) { type, offsetof(name, last) + sizeof(VkBool32) }
+
+/** feature structs accepted in a features chain, every member after sType and pNext is a VkBool32 */
+static const struct {
+    VkStructureType type;
+    size_t          end;
+} vk_feature_structs[] = {
+    VK_FEATURE_STRUCT(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,            VkPhysicalDeviceVulkan11Features,            shaderDrawParameters),
+    VK_FEATURE_STRUCT(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,            VkPhysicalDeviceVulkan12Features,            subgroupBroadcastDynamicId),
+    VK_FEATURE_STRUCT(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,            VkPhysicalDeviceVulkan13Features,            maintenance4),
+    VK_FEATURE_STRUCT(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,    VkPhysicalDeviceTimelineSemaphoreFeatures,   timelineSemaphore),
+    VK_FEATURE_STRUCT(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,     VkPhysicalDeviceSynchronization2Features,    synchronization2),
+    VK_FEATURE_STRUCT(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,     VkPhysicalDeviceDynamicRenderingFeatures,    dynamicRendering),
+    VK_FEATURE_STRUCT(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,   VkPhysicalDeviceDescriptorIndexingFeatures,  runtimeDescriptorArray),
+    VK_FEATURE_STRUCT(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES, VkPhysicalDeviceBufferDeviceAddressFeatures, bufferDeviceAddressMultiDevice),
+};
+
+#define VK_FEATURE_STRUCTS_COUNT (sizeof(vk_feature_structs) / sizeof(vk_feature_structs[0]))
+
+/** number of VkBool32 members of a chained feature struct, 0 if the struct is unknown */
+static uint32_t
+vk_get_feature_count
+(
+    VkStructureType type
+)
+{
+    for (uint32_t i = 0; i < VK_FEATURE_STRUCTS_COUNT; i++) {
+        if (vk_feature_structs[i].type == type)
+            return (vk_feature_structs[i].end - sizeof(VkBaseOutStructure)) / sizeof(VkBool32);
+    }
+    return 0;
+}
+
+/** true if every feature set in required is set in supported */
+bool
+vk_check_features
+(
+    const VkBool32 *required,
+    const VkBool32 *supported,
+    uint32_t count
+)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (required[i] && !supported[i])
+            return false;
+    }
+    return true;
+}
+
+/**
+ * queries the device for every struct in the required chain and compares them member by member.
+ * needs a Vulkan 1.1 instance and device for vkGetPhysicalDeviceFeatures2.
+ */
+bool
+vk_check_feature_chain
+(
+    VK_CONTEXT *context,
+    VkPhysicalDevice device,
+    uint32_t device_api_version,
+    const void *required_chain
+)
+{
+    if (required_chain == NULL)
+        return true;
+
+    if (context->api_version < VK_API_VERSION_1_1 || device_api_version < VK_API_VERSION_1_1)
+        return false;
+
+    /** mirror the required chain with zeroed structs of the same types for the driver to fill */
+    uint32_t chain_length = 0;
+    for (const VkBaseInStructure *s = required_chain; s != NULL; s = s->pNext) {
+        if (vk_get_feature_count(s->sType) == 0) {
+            VK_LOG(LOG_ERROR, "Unsupported struct in device features chain");
+            exit(-1);
+        }
+        chain_length++;
+    }
+
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+
+    VkBaseOutStructure *queried[chain_length];
+    VkBaseOutStructure *tail = (VkBaseOutStructure *) &features;
+
+    uint32_t i = 0;
+    for (const VkBaseInStructure *s = required_chain; s != NULL; s = s->pNext, i++) {
+        queried[i] = calloc(1, sizeof(VkBaseOutStructure) + vk_get_feature_count(s->sType) * sizeof(VkBool32));
+        queried[i]->sType = s->sType;
+        tail->pNext = queried[i];
+        tail        = queried[i];
+    }
+
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    bool supported = true;
+
+    i = 0;
+    for (const VkBaseInStructure *s = required_chain; s != NULL; s = s->pNext, i++) {
+        supported &= vk_check_features
+        (
+            (const VkBool32 *) (s + 1),
+            (const VkBool32 *) (queried[i] + 1),
+            vk_get_feature_count(s->sType)
+        );
+        free(queried[i]);
+    }
+    return supported;
+}
+
+/**
+ * returns a feature enabled on the logical device through the features chain, e.g.
+ * vk_get_enabled_feature(context, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+ *                        offsetof(VkPhysicalDeviceVulkan12Features, timelineSemaphore))
+ */
+VkBool32
+vk_get_enabled_feature
+(
+    VK_CONTEXT *context,
+    VkStructureType type,
+    size_t offset
+)
+{
+    for (const VkBaseInStructure *s = context->device_details.features_chain; s != NULL; s = s->pNext) {
+        if (s->sType == type)
+            return *(const VkBool32 *) ((const uint8_t *) s + offset);
+    }
+    return VK_FALSE;
+}
@@ -0,0 +1,275 @@
+#include "vkInit.h"
+
+void
+vk_create_frames
+(
+    VK_CONTEXT *context,
+    uint32_t frames_in_flight
+)
+{
+    uint64_t start = vk_get_time_ns();
+
+    if (frames_in_flight == 0) {
+        VK_LOG(LOG_WARNING, "Zero frames in flight requested, using 1");
+        frames_in_flight = 1;
+    }
+
+    context->frames_count     = frames_in_flight;
+    context->current_frame    = 0;
+    context->frames           = calloc(frames_in_flight, sizeof(VK_FRAME));
+    context->images_in_flight = calloc(context->image_count, sizeof(VkFence));
+
+    /** one pool for all frames, buffers are reset individually when their frame begins */
+    VkCommandPoolCreateInfo pool_create_info = {};
+    pool_create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_create_info.queueFamilyIndex = context->queue_families.indicies[GRAPHICS];
+
+    VK_CHECK(vkCreateCommandPool(context->logical_device, &pool_create_info, NULL, &context->command_pool));
+
+    VkCommandBuffer command_buffers[frames_in_flight];
+
+    VkCommandBufferAllocateInfo allocate_info = {};
+    allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool        = context->command_pool;
+    allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = frames_in_flight;
+
+    VK_CHECK(vkAllocateCommandBuffers(context->logical_device, &allocate_info, command_buffers));
+
+    /** fences start signaled so the first wait on each frame returns immediately */
+    VkFenceCreateInfo fence_create_info = {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    VkSemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        VK_FRAME *frame = &context->frames[i];
+
+        frame->command_buffer = command_buffers[i];
+        VK_CHECK(vkCreateFence(context->logical_device, &fence_create_info, NULL, &frame->in_flight));
+        VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &frame->image_available));
+        vk_create_descriptor_allocator(context, &frame->descriptors);
+    }
+
+    /** presentation holds the semaphore until its image is acquired again, so there is one per image */
+    if (!context->headless) {
+        context->render_finished = calloc(context->image_count, sizeof(VkSemaphore));
+        for (uint32_t i = 0; i < context->image_count; i++)
+            VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &context->render_finished[i]));
+    }
+    vk_record_init_stage(context, "create frames", start);
+    VK_LOG(LOG_INFO, "Created Frames");
+}
+
+VkCommandBuffer
+vk_begin_frame
+(
+    VK_CONTEXT *context
+)
+{
+    VK_FRAME *frame = &context->frames[context->current_frame];
+
+    /** wait for the GPU to finish the last submission that used this frame */
+    uint64_t start = vk_get_time_ns();
+    VK_CHECK(vkWaitForFences(context->logical_device, 1, &frame->in_flight, VK_TRUE, UINT64_MAX));
+    frame->wait_time = vk_get_time_ns() - start;
+
+    /** the sets of the frame's last submission are no longer in use */
+    vk_reset_descriptor_allocator(context, &frame->descriptors);
+    if (context->recorder.enabled)
+        vk_reset_recorder_frame(context);
+
+    /** resources of replaced swapchains can go once no frame in flight uses them */
+    vk_collect_retired_swapchains(context, false);
+
+    if (context->swapchain_out_of_date && !vk_recreate_swapchain(context, context->swapchain_details.extent))
+        return VK_NULL_HANDLE;
+
+    if (context->headless) {
+        /** offscreen targets are used round robin, there is nothing to acquire */
+        context->image_index = context->current_frame % context->image_count;
+    } else {
+        VkResult result = vkAcquireNextImageKHR(context->logical_device, context->swapchain, UINT64_MAX, frame->image_available, VK_NULL_HANDLE, &context->image_index);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            VK_LOG(LOG_WARNING, "Swapchain out of date, skipping frame");
+            context->swapchain_out_of_date = true;
+            return VK_NULL_HANDLE;
+        }
+        assert(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR);
+    }
+
+    /** the image may still be in use by an older frame if images and frames are out of step */
+    VkFence image_fence = context->images_in_flight[context->image_index];
+    if (image_fence != VK_NULL_HANDLE && image_fence != frame->in_flight) {
+        start = vk_get_time_ns();
+        VK_CHECK(vkWaitForFences(context->logical_device, 1, &image_fence, VK_TRUE, UINT64_MAX));
+        frame->wait_time += vk_get_time_ns() - start;
+    }
+    context->images_in_flight[context->image_index] = frame->in_flight;
+
+    /** only reset once work is certain to be submitted, otherwise the next wait would deadlock */
+    VK_CHECK(vkResetFences(context->logical_device, 1, &frame->in_flight));
+    VK_CHECK(vkResetCommandBuffer(frame->command_buffer, 0));
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(frame->command_buffer, &begin_info));
+
+    if (context->profiler.enabled)
+        vk_profile_begin_frame(context, frame->command_buffer);
+
+    /** submit pending uploads and take ownership of them before anything in the frame reads them */
+    if (context->uploader.size) {
+        VkSemaphore          semaphores[VK_UPLOAD_BATCHES];
+        VkPipelineStageFlags stages[VK_UPLOAD_BATCHES];
+
+        uint32_t count = vk_upload_acquire(context, frame->command_buffer, semaphores, stages);
+        for (uint32_t i = 0; i < count; i++)
+            vk_frame_wait_semaphore(context, semaphores[i], stages[i]);
+    }
+    return frame->command_buffer;
+}
+
+void
+vk_frame_wait_semaphore
+(
+    VK_CONTEXT *context,
+    VkSemaphore semaphore,
+    VkPipelineStageFlags stage
+)
+{
+    VK_FRAME *frame = &context->frames[context->current_frame];
+
+    if (frame->wait_semaphores_count == frame->wait_semaphores_capacity) {
+        frame->wait_semaphores_capacity = (frame->wait_semaphores_capacity) ? frame->wait_semaphores_capacity * 2 : 4;
+        frame->wait_semaphores = realloc(frame->wait_semaphores, sizeof(VkSemaphore) * frame->wait_semaphores_capacity);
+        frame->wait_stages     = realloc(frame->wait_stages, sizeof(VkPipelineStageFlags) * frame->wait_semaphores_capacity);
+    }
+
+    frame->wait_semaphores[frame->wait_semaphores_count] = semaphore;
+    frame->wait_stages[frame->wait_semaphores_count]     = stage;
+    frame->wait_semaphores_count++;
+}
+
+void
+vk_frame_signal_semaphore
+(
+    VK_CONTEXT *context,
+    VkSemaphore semaphore
+)
+{
+    VK_FRAME *frame = &context->frames[context->current_frame];
+
+    if (frame->signal_semaphores_count == frame->signal_semaphores_capacity) {
+        frame->signal_semaphores_capacity = (frame->signal_semaphores_capacity) ? frame->signal_semaphores_capacity * 2 : 4;
+        frame->signal_semaphores = realloc(frame->signal_semaphores, sizeof(VkSemaphore) * frame->signal_semaphores_capacity);
+    }
+
+    frame->signal_semaphores[frame->signal_semaphores_count++] = semaphore;
+}
+
+void
+vk_end_frame
+(
+    VK_CONTEXT *context
+)
+{
+    VK_FRAME *frame = &context->frames[context->current_frame];
+
+    VK_CHECK(vkEndCommandBuffer(frame->command_buffer));
+
+    /** headless frames neither acquire nor present, so skip the swapchain semaphores */
+    uint32_t swapchain_semaphores = (context->headless) ? 0 : 1;
+
+    /** the acquired image plus anything added through vk_frame_wait_semaphore */
+    uint32_t             wait_count = frame->wait_semaphores_count + swapchain_semaphores;
+    VkSemaphore          wait_semaphores[wait_count + 1];
+    VkPipelineStageFlags wait_stages[wait_count + 1];
+
+    wait_semaphores[0] = frame->image_available;
+    wait_stages[0]     = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    for (uint32_t i = 0; i < frame->wait_semaphores_count; i++) {
+        wait_semaphores[i + swapchain_semaphores] = frame->wait_semaphores[i];
+        wait_stages[i + swapchain_semaphores]     = frame->wait_stages[i];
+    }
+    frame->wait_semaphores_count = 0;
+
+    /** render_finished is signaled for presentation, others come from vk_frame_signal_semaphore */
+    uint32_t    signal_count = frame->signal_semaphores_count + swapchain_semaphores;
+    VkSemaphore signal_semaphores[signal_count + 1];
+
+    if (!context->headless)
+        signal_semaphores[0] = context->render_finished[context->image_index];
+    for (uint32_t i = 0; i < frame->signal_semaphores_count; i++)
+        signal_semaphores[i + swapchain_semaphores] = frame->signal_semaphores[i];
+    frame->signal_semaphores_count = 0;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount   = wait_count;
+    submit_info.pWaitSemaphores      = wait_semaphores;
+    submit_info.pWaitDstStageMask    = wait_stages;
+    submit_info.commandBufferCount   = 1;
+    submit_info.pCommandBuffers      = &frame->command_buffer;
+    submit_info.signalSemaphoreCount = signal_count;
+    submit_info.pSignalSemaphores    = signal_semaphores;
+
+    VK_CHECK(vk_queue_submit(context, context->queues[GRAPHICS], 1, &submit_info, frame->in_flight));
+    context->frame_serial++;
+
+    if (context->headless) {
+        context->current_frame = (context->current_frame + 1) % context->frames_count;
+        return;
+    }
+
+    VkPresentInfoKHR present_info = {};
+    present_info.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores    = &context->render_finished[context->image_index];
+    present_info.swapchainCount     = 1;
+    present_info.pSwapchains        = &context->swapchain;
+    present_info.pImageIndices      = &context->image_index;
+
+    VkResult result = vk_queue_present(context, context->queues[PRESENT], &present_info);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+        context->swapchain_out_of_date = true;
+    else
+        VK_CHECK(result);
+
+    context->current_frame = (context->current_frame + 1) % context->frames_count;
+}
+
+void
+vk_destroy_frames
+(
+    VK_CONTEXT *context
+)
+{
+    VK_CHECK(vkDeviceWaitIdle(context->logical_device));
+
+    for (uint32_t i = 0; i < context->frames_count; i++) {
+        vkDestroySemaphore(context->logical_device, context->frames[i].image_available, NULL);
+        vkDestroyFence(context->logical_device, context->frames[i].in_flight, NULL);
+        vk_destroy_descriptor_allocator(context, &context->frames[i].descriptors);
+        free(context->frames[i].wait_semaphores);
+        free(context->frames[i].wait_stages);
+        free(context->frames[i].signal_semaphores);
+    }
+    vkDestroyCommandPool(context->logical_device, context->command_pool, NULL);
+
+    for (uint32_t i = 0; context->render_finished != NULL && i < context->image_count; i++)
+        vkDestroySemaphore(context->logical_device, context->render_finished[i], NULL);
+
+    free(context->render_finished);
+    free(context->images_in_flight);
+    free(context->frames);
+    context->render_finished  = NULL;
+    context->images_in_flight = NULL;
+    context->frames           = NULL;
+    context->frames_count     = 0;
+}
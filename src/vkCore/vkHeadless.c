@@ -0,0 +1,262 @@
+#include "vkInit.h"
+
+/** bytes per texel of the color formats usable as readback targets, 0 if unsupported */
+static uint32_t
+vk_format_size
+(
+    VkFormat format
+)
+{
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * headless replacement for vk_create_swapchain and vk_create_image_views.
+ * fills the same context fields, so render passes and framebuffers are created unchanged.
+ * requires the allocator, the surface is left as VK_NULL_HANDLE.
+ */
+void
+vk_create_offscreen_targets
+(
+    VK_CONTEXT *context,
+    VkExtent2D extent,
+    VkFormat format,
+    uint32_t count
+)
+{
+    if (vk_format_size(format) == 0) {
+        VK_LOG(LOG_ERROR, "Offscreen target format cannot be read back");
+        exit(-1);
+    }
+
+    if (count == 0)
+        count = 1;
+
+    context->headless                              = true;
+    context->swapchain                             = VK_NULL_HANDLE;
+    context->swapchain_details.format.format       = format;
+    context->swapchain_details.format.colorSpace   = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    context->swapchain_details.extent              = extent;
+
+    context->image_count       = count;
+    context->images            = malloc(sizeof(VkImage) * count);
+    context->image_views       = malloc(sizeof(VkImageView) * count);
+    context->offscreen_targets = calloc(count, sizeof(VK_IMAGE));
+
+    VkImageCreateInfo image_create_info = {};
+    image_create_info.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.imageType     = VK_IMAGE_TYPE_2D;
+    image_create_info.format        = format;
+    image_create_info.extent        = (VkExtent3D) { extent.width, extent.height, 1 };
+    image_create_info.mipLevels     = 1;
+    image_create_info.arrayLayers   = 1;
+    image_create_info.samples       = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage         = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_create_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    for (uint32_t i = 0; i < count; i++) {
+        vk_create_image(context, &image_create_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &context->offscreen_targets[i]);
+        context->images[i] = context->offscreen_targets[i].image;
+
+        VkImageViewCreateInfo create_info           = {};
+        create_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        create_info.image                           = context->images[i];
+        create_info.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+        create_info.format                          = format;
+        create_info.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        create_info.subresourceRange.baseMipLevel   = 0;
+        create_info.subresourceRange.levelCount     = 1;
+        create_info.subresourceRange.baseArrayLayer = 0;
+        create_info.subresourceRange.layerCount     = 1;
+
+        VK_CHECK(vkCreateImageView(context->logical_device, &create_info, NULL, &context->image_views[i]));
+    }
+    VK_LOG(LOG_INFO, "Created Offscreen Targets");
+}
+
+void
+vk_destroy_offscreen_targets
+(
+    VK_CONTEXT *context
+)
+{
+    if (!context->headless)
+        return;
+
+    for (uint32_t i = 0; i < context->image_count; i++) {
+        vkDestroyImageView(context->logical_device, context->image_views[i], NULL);
+        vk_destroy_image(context, &context->offscreen_targets[i]);
+    }
+
+    free(context->offscreen_targets);
+    free(context->image_views);
+    free(context->images);
+    context->offscreen_targets = NULL;
+    context->image_views       = NULL;
+    context->images            = NULL;
+    context->image_count       = 0;
+}
+
+/** size in bytes of one tightly packed offscreen target */
+VkDeviceSize
+vk_get_offscreen_target_size
+(
+    VK_CONTEXT *context
+)
+{
+    return (VkDeviceSize) context->swapchain_details.extent.width *
+           context->swapchain_details.extent.height *
+           vk_format_size(context->swapchain_details.format.format);
+}
+
+/**
+ * copies an offscreen target into data as tightly packed rows.
+ * layout is the layout the target was left in, usually the render pass final layout,
+ * and is restored afterwards. blocks until the copy completes.
+ */
+void
+vk_read_offscreen_target
+(
+    VK_CONTEXT *context,
+    uint32_t index,
+    VkImageLayout layout,
+    void *data
+)
+{
+    VK_BUFFER    readback;
+    VkDeviceSize size = vk_get_offscreen_target_size(context);
+
+    if (!context->headless || index >= context->image_count) {
+        VK_LOG(LOG_ERROR, "No offscreen target to read back");
+        exit(-1);
+    }
+
+    vk_create_buffer
+    (
+        context,
+        size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &readback
+    );
+
+    VkCommandPool   command_pool;
+    VkCommandBuffer command_buffer;
+    VkFence         fence;
+
+    VkCommandPoolCreateInfo pool_create_info = {};
+    pool_create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_create_info.queueFamilyIndex = context->queue_families.indicies[GRAPHICS];
+
+    VK_CHECK(vkCreateCommandPool(context->logical_device, &pool_create_info, NULL, &command_pool));
+
+    VkCommandBufferAllocateInfo allocate_info = {};
+    allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool        = command_pool;
+    allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = 1;
+
+    VK_CHECK(vkAllocateCommandBuffers(context->logical_device, &allocate_info, &command_buffer));
+
+    VkFenceCreateInfo fence_create_info = {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VK_CHECK(vkCreateFence(context->logical_device, &fence_create_info, NULL, &fence));
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info));
+
+    /** submission order on the graphics queue puts this after the frame that rendered the target */
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask                   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask                   = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout                       = layout;
+    barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image                           = context->images[index];
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel   = 0;
+    barrier.subresourceRange.levelCount     = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount     = 1;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel       = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount     = 1;
+    region.imageExtent                     = (VkExtent3D) {
+        context->swapchain_details.extent.width,
+        context->swapchain_details.extent.height,
+        1
+    };
+
+    vkCmdCopyImageToBuffer(command_buffer, context->images[index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &region);
+
+    /** put the target back so the next frame finds it where the render pass left it */
+    if (layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout     = layout;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+    }
+
+    /** make the copy visible to the host mapping */
+    VkBufferMemoryBarrier host_barrier = {};
+    host_barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    host_barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host_barrier.dstAccessMask       = VK_ACCESS_HOST_READ_BIT;
+    host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host_barrier.buffer              = readback.buffer;
+    host_barrier.offset              = 0;
+    host_barrier.size                = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &host_barrier, 0, NULL);
+
+    VK_CHECK(vkEndCommandBuffer(command_buffer));
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers    = &command_buffer;
+
+    VK_CHECK(vk_queue_submit(context, context->queues[GRAPHICS], 1, &submit_info, fence));
+    VK_CHECK(vkWaitForFences(context->logical_device, 1, &fence, VK_TRUE, UINT64_MAX));
+
+    memcpy(data, readback.allocation.mapped, size);
+
+    vkDestroyFence(context->logical_device, fence, NULL);
+    vkDestroyCommandPool(context->logical_device, command_pool, NULL);
+    vk_destroy_buffer(context, &readback);
+}
@@ -0,0 +1,369 @@
+#include "vkInit.h"
+
+#include <math.h>
+
+/** push constants of the cull shader */
+typedef struct VK_INDIRECT_CONSTANTS {
+    float    planes[6][4];
+    uint32_t objects_count;
+} VK_INDIRECT_CONSTANTS;
+
+/**
+ * left, right, bottom, top, near and far planes of a column major view projection matrix,
+ * normalised so the distance of a point is dot(plane.xyz, point) + plane.w. depth is 0 to 1.
+ */
+static void
+vk_get_frustum_planes
+(
+    const float m[16],
+    float planes[6][4]
+)
+{
+    for (uint32_t i = 0; i < 4; i++) {
+        float row0 = m[i * 4 + 0];
+        float row1 = m[i * 4 + 1];
+        float row2 = m[i * 4 + 2];
+        float row3 = m[i * 4 + 3];
+
+        planes[0][i] = row3 + row0;
+        planes[1][i] = row3 - row0;
+        planes[2][i] = row3 + row1;
+        planes[3][i] = row3 - row1;
+        planes[4][i] = row2;
+        planes[5][i] = row3 - row2;
+    }
+
+    for (uint32_t p = 0; p < 6; p++) {
+        float length = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+        if (length == 0.0f)
+            continue;
+        for (uint32_t i = 0; i < 4; i++)
+            planes[p][i] /= length;
+    }
+}
+
+static void
+vk_write_indirect_sets
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    VK_INDIRECT_FRAME *frame
+)
+{
+    VkDescriptorBufferInfo buffer_infos[5] = {
+        { culler->objects.buffer,    0, VK_WHOLE_SIZE },
+        { frame->transforms.buffer,  0, VK_WHOLE_SIZE },
+        { culler->meshes.buffer,     0, VK_WHOLE_SIZE },
+        { frame->commands.buffer,    0, VK_WHOLE_SIZE },
+        { frame->count.buffer,       0, VK_WHOLE_SIZE },
+    };
+
+    VkWriteDescriptorSet writes[6];
+
+    for (uint32_t i = 0; i < 5; i++) {
+        writes[i] = (VkWriteDescriptorSet) {
+            .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet          = frame->cull_set,
+            .dstBinding      = i,
+            .descriptorCount = 1,
+            .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo     = &buffer_infos[i]
+        };
+    }
+
+    writes[5] = (VkWriteDescriptorSet) {
+        .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet          = frame->draw_set,
+        .dstBinding      = 0,
+        .descriptorCount = 1,
+        .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo     = &buffer_infos[1]
+    };
+
+    vkUpdateDescriptorSets(context->logical_device, 6, writes, 0, NULL);
+}
+
+/**
+ * creates the cull pipeline from filename and the buffers for objects_capacity objects
+ * in every frame in flight, so it must be called after vk_create_frames.
+ * needs the multiDrawIndirect and drawIndirectFirstInstance features and vk_create_uploader.
+ * with the Vulkan 1.2 drawIndirectCount feature enabled the draw reads the surviving count from the GPU.
+ */
+void
+vk_create_indirect_culler
+(
+    VK_CONTEXT *context,
+    const char *filename,
+    uint32_t objects_capacity,
+    uint32_t meshes_capacity,
+    VK_INDIRECT_CULLER *culler
+)
+{
+    uint64_t start = vk_get_time_ns();
+
+    if (!context->device_details.device_features.multiDrawIndirect ||
+        !context->device_details.device_features.drawIndirectFirstInstance) {
+        VK_LOG(LOG_ERROR, "Indirect culling requires the multiDrawIndirect and drawIndirectFirstInstance features");
+        exit(-1);
+    }
+
+    if (context->frames_count == 0 || context->uploader.size == 0) {
+        VK_LOG(LOG_ERROR, "Indirect culling requires vk_create_frames and vk_create_uploader");
+        exit(-1);
+    }
+
+    if (objects_capacity == 0 || meshes_capacity == 0) {
+        VK_LOG(LOG_ERROR, "Indirect culling requires room for at least one object and mesh");
+        exit(-1);
+    }
+
+    *culler = (VK_INDIRECT_CULLER) {
+        .objects_capacity = objects_capacity,
+        .meshes_capacity  = meshes_capacity,
+        .draw_count       = vk_get_enabled_feature(context, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+                                                   offsetof(VkPhysicalDeviceVulkan12Features, drawIndirectCount)),
+        .frames_count     = context->frames_count,
+        .frames           = calloc(context->frames_count, sizeof(VK_INDIRECT_FRAME))
+    };
+
+    /** objects, transforms, meshes, commands and count */
+    VkDescriptorSetLayoutBinding cull_bindings[5];
+    for (uint32_t i = 0; i < 5; i++) {
+        cull_bindings[i] = (VkDescriptorSetLayoutBinding) {
+            .binding         = i,
+            .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT
+        };
+    }
+
+    VkDescriptorSetLayoutBinding draw_binding = {
+        .binding         = 0,
+        .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags      = VK_SHADER_STAGE_VERTEX_BIT
+    };
+
+    culler->cull_set_layout = vk_get_descriptor_set_layout(context, cull_bindings, 5);
+    culler->draw_set_layout = vk_get_descriptor_set_layout(context, &draw_binding, 1);
+
+    VkPushConstantRange push_constant_range = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset     = 0,
+        .size       = sizeof(VK_INDIRECT_CONSTANTS)
+    };
+
+    /** constant 0 is the workgroup size, so the shader always matches the dispatch */
+    uint32_t group_size = VK_INDIRECT_GROUP_SIZE;
+    VkSpecializationMapEntry group_size_entry = {
+        .constantID = 0,
+        .offset     = 0,
+        .size       = sizeof(group_size)
+    };
+
+    VK_SPECIALIZATION_SPECIFICATION specialization = {
+        .stage             = VK_SHADER_STAGE_COMPUTE_BIT,
+        .map_entries_count = 1,
+        .map_entries       = &group_size_entry,
+        .data_size         = sizeof(group_size),
+        .data              = &group_size
+    };
+
+    vk_create_compute_pipeline(context, (VK_COMPUTE_PIPELINE_SPECIFICATION) {
+        .descriptor_set_layouts_count = 1,
+        .descriptor_set_layouts       = &culler->cull_set_layout,
+        .push_constant_ranges_count   = 1,
+        .push_constant_ranges         = &push_constant_range,
+        .specialization               = &specialization
+    }, filename, &culler->pipeline);
+
+    /** objects and meshes change rarely and live in device local memory, written through the uploader */
+    vk_create_buffer(context, sizeof(VK_INDIRECT_OBJECT) * objects_capacity,
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &culler->objects);
+    vk_create_buffer(context, sizeof(VK_INDIRECT_MESH) * meshes_capacity,
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &culler->meshes);
+
+    vk_create_descriptor_allocator(context, &culler->descriptors);
+
+    for (uint32_t i = 0; i < culler->frames_count; i++) {
+        VK_INDIRECT_FRAME *frame = &culler->frames[i];
+
+        vk_create_buffer(context, sizeof(VkDrawIndexedIndirectCommand) * objects_capacity,
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame->commands);
+        vk_create_buffer(context, sizeof(uint32_t),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame->count);
+        /** transforms change every frame, so every frame in flight writes its own copy directly */
+        vk_create_buffer(context, sizeof(float) * 16 * objects_capacity,
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame->transforms);
+
+        frame->cull_set = vk_allocate_descriptor_set(context, &culler->descriptors, culler->cull_set_layout);
+        frame->draw_set = vk_allocate_descriptor_set(context, &culler->descriptors, culler->draw_set_layout);
+        vk_write_indirect_sets(context, culler, frame);
+    }
+
+    vk_record_init_stage(context, "create indirect culler", start);
+    VK_LOGF(LOG_INFO, "vk", "Created Indirect Culler (%u objects, %u meshes, %s)",
+            objects_capacity, meshes_capacity, (culler->draw_count) ? "draw count" : "zeroed slots");
+}
+
+/** the frames in flight may still be drawing, so this idles the device */
+void
+vk_destroy_indirect_culler
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler
+)
+{
+    if (culler->frames == NULL)
+        return;
+
+    VK_CHECK(vkDeviceWaitIdle(context->logical_device));
+
+    for (uint32_t i = 0; i < culler->frames_count; i++) {
+        vk_destroy_buffer(context, &culler->frames[i].commands);
+        vk_destroy_buffer(context, &culler->frames[i].count);
+        vk_destroy_buffer(context, &culler->frames[i].transforms);
+    }
+    free(culler->frames);
+
+    vk_destroy_descriptor_allocator(context, &culler->descriptors);
+    vk_destroy_buffer(context, &culler->objects);
+    vk_destroy_buffer(context, &culler->meshes);
+    vk_destroy_compute_pipeline(context, &culler->pipeline);
+    vk_release_descriptor_set_layout(context, culler->cull_set_layout);
+    vk_release_descriptor_set_layout(context, culler->draw_set_layout);
+
+    *culler = (VK_INDIRECT_CULLER) {};
+}
+
+/** uploads count meshes, no frame in flight may be using the culler, e.g. call it before the first frame */
+void
+vk_set_indirect_meshes
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    const VK_INDIRECT_MESH *meshes,
+    uint32_t count
+)
+{
+    if (count > culler->meshes_capacity) {
+        VK_LOG(LOG_ERROR, "More indirect meshes than the culler was created for");
+        exit(-1);
+    }
+
+    vk_upload_buffer(context, culler->meshes.buffer, 0, meshes, sizeof(VK_INDIRECT_MESH) * count);
+}
+
+/**
+ * uploads count objects, replacing the previous ones. object i is drawn with firstInstance i,
+ * which the vertex shader uses to index the transforms. no frame in flight may be using the culler.
+ */
+void
+vk_set_indirect_objects
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    const VK_INDIRECT_OBJECT *objects,
+    uint32_t count
+)
+{
+    if (count > culler->objects_capacity) {
+        VK_LOG(LOG_ERROR, "More indirect objects than the culler was created for");
+        exit(-1);
+    }
+
+    vk_upload_buffer(context, culler->objects.buffer, 0, objects, sizeof(VK_INDIRECT_OBJECT) * count);
+    culler->objects_count = count;
+}
+
+/**
+ * the 16 floats per object of the current frame in flight, valid between vk_begin_frame and vk_end_frame.
+ * every frame in flight has its own copy, so write every transform each frame.
+ */
+float *
+vk_get_indirect_transforms
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler
+)
+{
+    return culler->frames[context->current_frame].transforms.allocation.mapped;
+}
+
+/**
+ * records the cull pass of the current frame, must be outside a render pass and before vk_draw_indirect.
+ * surviving objects are compacted into the frame's command buffer with one workgroup atomic each.
+ */
+void
+vk_cull_indirect
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    VkCommandBuffer command_buffer,
+    const float view_projection[16]
+)
+{
+    VK_INDIRECT_FRAME *frame = &culler->frames[context->current_frame];
+
+    vkCmdFillBuffer(command_buffer, frame->count.buffer, 0, sizeof(uint32_t), 0);
+    /** without a count the draw reads every slot, zeroed ones draw nothing */
+    if (!culler->draw_count && culler->objects_count > 0)
+        vkCmdFillBuffer(command_buffer, frame->commands.buffer, 0, sizeof(VkDrawIndexedIndirectCommand) * culler->objects_count, 0);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+    if (culler->objects_count > 0) {
+        VK_INDIRECT_CONSTANTS constants = { .objects_count = culler->objects_count };
+        vk_get_frustum_planes(view_projection, constants.planes);
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culler->pipeline.pipeline);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culler->pipeline.layout, 0, 1, &frame->cull_set, 0, NULL);
+        vkCmdPushConstants(command_buffer, culler->pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(command_buffer, (culler->objects_count + VK_INDIRECT_GROUP_SIZE - 1) / VK_INDIRECT_GROUP_SIZE, 1, 1);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+/**
+ * draws the objects that survived vk_cull_indirect with one indirect draw. the graphics pipeline,
+ * its index and vertex buffers must be bound, the transforms are bound at set of layout.
+ */
+void
+vk_draw_indirect
+(
+    VK_CONTEXT *context,
+    VK_INDIRECT_CULLER *culler,
+    VkCommandBuffer command_buffer,
+    VkPipelineLayout layout,
+    uint32_t set
+)
+{
+    VK_INDIRECT_FRAME *frame = &culler->frames[context->current_frame];
+
+    if (culler->objects_count == 0)
+        return;
+
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, set, 1, &frame->draw_set, 0, NULL);
+
+    if (culler->draw_count)
+        vkCmdDrawIndexedIndirectCount(command_buffer, frame->commands.buffer, 0, frame->count.buffer, 0,
+                                      culler->objects_count, sizeof(VkDrawIndexedIndirectCommand));
+    else
+        vkCmdDrawIndexedIndirect(command_buffer, frame->commands.buffer, 0,
+                                 culler->objects_count, sizeof(VkDrawIndexedIndirectCommand));
+}
@@ -0,0 +1,530 @@
+#include "vkInit.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+/** failed attempts to find a job before a waiting thread starts sleeping between attempts */
+#define VK_JOB_SPINS       64
+#define VK_JOB_BACKOFF_NS  50000
+
+/** the worker the current thread runs as, NULL outside every job system */
+static _Thread_local VK_JOB_WORKER *vk_job_worker;
+
+static void
+vk_job_deque_init
+(
+    VK_JOB_DEQUE *deque
+)
+{
+    *deque = (VK_JOB_DEQUE) {
+        .capacity = 64,
+        .jobs     = malloc(sizeof(VK_JOB) * 64)
+    };
+    pthread_mutex_init(&deque->lock, NULL);
+}
+
+static void
+vk_job_deque_push
+(
+    VK_JOB_DEQUE *deque,
+    VK_JOB job
+)
+{
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->count == deque->capacity) {
+        /** unwrap the ring into the front of the larger buffer */
+        VK_JOB *jobs = malloc(sizeof(VK_JOB) * deque->capacity * 2);
+        for (uint32_t i = 0; i < deque->count; i++)
+            jobs[i] = deque->jobs[(deque->front + i) & (deque->capacity - 1)];
+
+        free(deque->jobs);
+        deque->jobs      = jobs;
+        deque->front     = 0;
+        deque->capacity *= 2;
+    }
+
+    deque->jobs[(deque->front + deque->count++) & (deque->capacity - 1)] = job;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+/** newest job first, the owner keeps working on what it just produced while it is hot in cache */
+static bool
+vk_job_deque_pop
+(
+    VK_JOB_DEQUE *deque,
+    VK_JOB *job
+)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count) {
+        *job  = deque->jobs[(deque->front + --deque->count) & (deque->capacity - 1)];
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/** oldest job first, usually the largest piece of work left */
+static bool
+vk_job_deque_steal
+(
+    VK_JOB_DEQUE *deque,
+    VK_JOB *job
+)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count) {
+        *job          = deque->jobs[deque->front];
+        deque->front  = (deque->front + 1) & (deque->capacity - 1);
+        deque->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/** the calling thread's worker, threads outside the pool share workers[0] */
+static VK_JOB_WORKER *
+vk_job_self
+(
+    VK_JOB_SYSTEM *system
+)
+{
+    if (vk_job_worker != NULL && vk_job_worker->system == system)
+        return vk_job_worker;
+    return &system->workers[0];
+}
+
+static void
+vk_job_push
+(
+    VK_JOB_SYSTEM *system,
+    VK_JOB job
+)
+{
+    vk_job_deque_push(&vk_job_self(system)->deque, job);
+    atomic_fetch_add(&system->queued, 1);
+
+    /** queued is raised before sleeping is read and the sleeper does the reverse, so one of them sees the other */
+    if (atomic_load(&system->sleeping)) {
+        pthread_mutex_lock(&system->sleep_lock);
+        pthread_cond_signal(&system->wake);
+        pthread_mutex_unlock(&system->sleep_lock);
+    }
+}
+
+/** finishes one job of the counter and releases its dependents when it was the last */
+static void
+vk_job_counter_done
+(
+    VK_JOB_SYSTEM *system,
+    VK_JOB_COUNTER *counter
+)
+{
+    /** jobs that are not the last of their counter skip the lock */
+    uint32_t pending = atomic_load(&counter->pending);
+    while (pending > 1)
+        if (atomic_compare_exchange_weak(&counter->pending, &pending, pending - 1))
+            return;
+
+    /** under the lock so a waiter that saw zero knows the counter is no longer touched once it takes the lock */
+    pthread_mutex_lock(&system->dependency_lock);
+    VK_JOB_NODE *dependents = NULL;
+    if (atomic_fetch_sub(&counter->pending, 1) == 1) {
+        dependents          = counter->dependents;
+        counter->dependents = NULL;
+    }
+    pthread_mutex_unlock(&system->dependency_lock);
+
+    while (dependents != NULL) {
+        VK_JOB_NODE *next = dependents->next;
+        vk_job_push(system, dependents->job);
+        free(dependents);
+        dependents = next;
+    }
+}
+
+/** runs one job from the worker's own deque or stolen from another, false if there was none */
+static bool
+vk_job_run_one
+(
+    VK_JOB_SYSTEM *system,
+    VK_JOB_WORKER *self
+)
+{
+    VK_JOB job;
+    bool   stolen = false;
+
+    if (!vk_job_deque_pop(&self->deque, &job)) {
+        uint32_t first = atomic_fetch_add_explicit(&system->next_victim, 1, memory_order_relaxed);
+
+        for (uint32_t i = 0; i < system->threads_count && !stolen; i++) {
+            VK_JOB_WORKER *victim = &system->workers[(first + i) % system->threads_count];
+            if (victim != self)
+                stolen = vk_job_deque_steal(&victim->deque, &job);
+        }
+        if (!stolen)
+            return false;
+    }
+    atomic_fetch_sub(&system->queued, 1);
+
+    uint64_t start = vk_get_time_ns();
+    job.function(job.data);
+
+    atomic_fetch_add_explicit(&self->busy_time, vk_get_time_ns() - start, memory_order_relaxed);
+    atomic_fetch_add_explicit(&self->jobs, 1, memory_order_relaxed);
+    if (stolen)
+        atomic_fetch_add_explicit(&self->steals, 1, memory_order_relaxed);
+
+    if (job.counter != NULL)
+        vk_job_counter_done(system, job.counter);
+    return true;
+}
+
+static void *
+vk_job_thread
+(
+    void *arg
+)
+{
+    VK_JOB_WORKER *worker = arg;
+    VK_JOB_SYSTEM *system = worker->system;
+
+    vk_job_worker = worker;
+
+    while (!atomic_load(&system->shutdown)) {
+        if (vk_job_run_one(system, worker))
+            continue;
+
+        pthread_mutex_lock(&system->sleep_lock);
+        atomic_fetch_add(&system->sleeping, 1);
+        while (!atomic_load(&system->queued) && !atomic_load(&system->shutdown))
+            pthread_cond_wait(&system->wake, &system->sleep_lock);
+        atomic_fetch_sub(&system->sleeping, 1);
+        pthread_mutex_unlock(&system->sleep_lock);
+    }
+
+    vk_job_worker = NULL;
+    return NULL;
+}
+
+/**
+ * starts threads - 1 workers, 0 uses one per online CPU. every worker has its own deque and
+ * steals from the others when it runs dry. threads outside the pool run jobs while they wait,
+ * so the creating thread is the remaining worker.
+ */
+void
+vk_create_job_system
+(
+    VK_CONTEXT *context,
+    uint32_t threads
+)
+{
+    VK_JOB_SYSTEM *system = &context->jobs;
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? (uint32_t) cpus : 1;
+    }
+    if (threads > VK_JOB_MAX_THREADS)
+        threads = VK_JOB_MAX_THREADS;
+
+    *system = (VK_JOB_SYSTEM) {
+        .threads_count = threads,
+        .workers       = calloc(threads, sizeof(VK_JOB_WORKER)),
+        .start_time    = vk_get_time_ns()
+    };
+    pthread_mutex_init(&system->sleep_lock, NULL);
+    pthread_cond_init(&system->wake, NULL);
+    pthread_mutex_init(&system->dependency_lock, NULL);
+
+    for (uint32_t i = 0; i < threads; i++) {
+        system->workers[i].system = system;
+        system->workers[i].index  = i;
+        vk_job_deque_init(&system->workers[i].deque);
+    }
+
+    system->enabled = true;
+
+    for (uint32_t i = 1; i < threads; i++) {
+        if (pthread_create(&system->workers[i].thread, NULL, vk_job_thread, &system->workers[i]) != 0) {
+            VK_LOG(LOG_ERROR, "Could not create job worker thread");
+            exit(-1);
+        }
+    }
+
+    VK_LOGF(LOG_INFO, "vk", "Created Job System (%u threads)", threads);
+}
+
+/** jobs still queued are run on the calling thread, every counter should have been waited on before */
+void
+vk_destroy_job_system
+(
+    VK_CONTEXT *context
+)
+{
+    VK_JOB_SYSTEM *system = &context->jobs;
+
+    if (!system->enabled)
+        return;
+
+    pthread_mutex_lock(&system->sleep_lock);
+    atomic_store(&system->shutdown, true);
+    pthread_cond_broadcast(&system->wake);
+    pthread_mutex_unlock(&system->sleep_lock);
+
+    for (uint32_t i = 1; i < system->threads_count; i++)
+        pthread_join(system->workers[i].thread, NULL);
+
+    while (vk_job_run_one(system, &system->workers[0]))
+        ;
+
+    VK_JOB_WORKER_STATS stats[system->threads_count];
+    vk_get_job_stats(context, stats);
+    for (uint32_t i = 0; i < system->threads_count; i++)
+        VK_LOGF(LOG_INFO, "vk", "Job worker %u: %llu jobs, %llu stolen, %.1f%% busy",
+                i, (unsigned long long) stats[i].jobs, (unsigned long long) stats[i].steals, stats[i].utilisation * 100.0);
+
+    for (uint32_t i = 0; i < system->threads_count; i++) {
+        pthread_mutex_destroy(&system->workers[i].deque.lock);
+        free(system->workers[i].deque.jobs);
+    }
+
+    pthread_mutex_destroy(&system->dependency_lock);
+    pthread_cond_destroy(&system->wake);
+    pthread_mutex_destroy(&system->sleep_lock);
+    free(system->workers);
+
+    *system = (VK_JOB_SYSTEM) {};
+}
+
+/**
+ * queues function(data) and counts it on counter, which may be NULL.
+ * without a job system the job runs before this returns.
+ */
+void
+vk_submit_job
+(
+    VK_CONTEXT *context,
+    VK_JOB_FUNCTION function,
+    void *data,
+    VK_JOB_COUNTER *counter
+)
+{
+    VK_JOB_SYSTEM *system = &context->jobs;
+
+    if (!system->enabled) {
+        function(data);
+        return;
+    }
+
+    if (counter != NULL)
+        atomic_fetch_add(&counter->pending, 1);
+
+    vk_job_push(system, (VK_JOB) {
+        .function = function,
+        .data     = data,
+        .counter  = counter
+    });
+}
+
+/** like vk_submit_job, but the job is only queued once every job counted on dependency has finished */
+void
+vk_submit_job_after
+(
+    VK_CONTEXT *context,
+    VK_JOB_COUNTER *dependency,
+    VK_JOB_FUNCTION function,
+    void *data,
+    VK_JOB_COUNTER *counter
+)
+{
+    VK_JOB_SYSTEM *system = &context->jobs;
+
+    if (!system->enabled) {
+        function(data);
+        return;
+    }
+
+    if (counter != NULL)
+        atomic_fetch_add(&counter->pending, 1);
+
+    VK_JOB job = {
+        .function = function,
+        .data     = data,
+        .counter  = counter
+    };
+
+    pthread_mutex_lock(&system->dependency_lock);
+    if (atomic_load(&dependency->pending) == 0) {
+        pthread_mutex_unlock(&system->dependency_lock);
+        vk_job_push(system, job);
+        return;
+    }
+
+    VK_JOB_NODE *node = malloc(sizeof(VK_JOB_NODE));
+    *node = (VK_JOB_NODE) {
+        .job  = job,
+        .next = dependency->dependents
+    };
+    dependency->dependents = node;
+    pthread_mutex_unlock(&system->dependency_lock);
+}
+
+/** runs queued jobs until every job counted on counter has finished */
+void
+vk_wait_job_counter
+(
+    VK_CONTEXT *context,
+    VK_JOB_COUNTER *counter
+)
+{
+    VK_JOB_SYSTEM *system = &context->jobs;
+
+    if (!system->enabled)
+        return;
+
+    VK_JOB_WORKER *self  = vk_job_self(system);
+    uint32_t       spins = 0;
+
+    while (atomic_load(&counter->pending)) {
+        if (vk_job_run_one(system, self)) {
+            spins = 0;
+            continue;
+        }
+
+        /** the remaining jobs are running elsewhere */
+        if (++spins < VK_JOB_SPINS) {
+            sched_yield();
+        } else {
+            struct timespec backoff = { .tv_nsec = VK_JOB_BACKOFF_NS };
+            nanosleep(&backoff, NULL);
+        }
+    }
+
+    /** the last job may still be inside vk_job_counter_done */
+    pthread_mutex_lock(&system->dependency_lock);
+    pthread_mutex_unlock(&system->dependency_lock);
+}
+
+/**
+ * fills stats with one entry per worker and returns the worker count, stats may be NULL to only query it.
+ * entry 0 covers every thread outside the pool that ran jobs while waiting.
+ */
+uint32_t
+vk_get_job_stats
+(
+    VK_CONTEXT *context,
+    VK_JOB_WORKER_STATS *stats
+)
+{
+    VK_JOB_SYSTEM *system = &context->jobs;
+
+    if (stats == NULL)
+        return system->threads_count;
+
+    uint64_t lifetime = vk_get_time_ns() - system->start_time;
+
+    for (uint32_t i = 0; i < system->threads_count; i++) {
+        VK_JOB_WORKER *worker = &system->workers[i];
+
+        stats[i] = (VK_JOB_WORKER_STATS) {
+            .jobs      = atomic_load_explicit(&worker->jobs, memory_order_relaxed),
+            .steals    = atomic_load_explicit(&worker->steals, memory_order_relaxed),
+            .busy_time = atomic_load_explicit(&worker->busy_time, memory_order_relaxed)
+        };
+        stats[i].utilisation = (lifetime) ? (double) stats[i].busy_time / lifetime : 0.0;
+    }
+    return system->threads_count;
+}
+
+/** reads a file once so it sits in the page cache when it is mapped later */
+static void
+vk_prefetch_shader_job
+(
+    void *data
+)
+{
+    const char *filename = data;
+    uint8_t buffer[64 * 1024];
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    while (read(fd, buffer, sizeof(buffer)) > 0)
+        ;
+    close(fd);
+}
+
+/**
+ * reads the shader files on the job system, needs no device, so it can overlap instance and device creation.
+ * filenames must stay valid until counter has been waited on.
+ */
+void
+vk_prefetch_shader_files
+(
+    VK_CONTEXT *context,
+    const char **filenames,
+    uint32_t count,
+    VK_JOB_COUNTER *counter
+)
+{
+    for (uint32_t i = 0; i < count; i++)
+        vk_submit_job(context, vk_prefetch_shader_job, (void *) filenames[i], counter);
+}
+
+typedef struct VK_PRELOAD_SHADER {
+    VK_CONTEXT *context;
+    const char *filename;
+} VK_PRELOAD_SHADER;
+
+static void
+vk_preload_shader_job
+(
+    void *data
+)
+{
+    VK_PRELOAD_SHADER *preload = data;
+    VkShaderModule shader_module;
+
+    /** the cache keeps the released module for the pipeline that loads it next */
+    if (vk_load_shader_module(preload->context, preload->filename, &shader_module))
+        vk_release_shader_module(preload->context, shader_module);
+
+    free(preload);
+}
+
+/**
+ * creates the shader modules on the job system and leaves them in the shader cache,
+ * so the pipelines created afterwards only take a reference. needs the device and the shader cache.
+ */
+void
+vk_preload_shader_modules
+(
+    VK_CONTEXT *context,
+    const char **filenames,
+    uint32_t count,
+    VK_JOB_COUNTER *counter
+)
+{
+    if (!context->shader_cache.enabled) {
+        VK_LOG(LOG_WARNING, "Preloading shader modules requires the shader cache, skipping");
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        VK_PRELOAD_SHADER *preload = malloc(sizeof(VK_PRELOAD_SHADER));
+        *preload = (VK_PRELOAD_SHADER) {
+            .context  = context,
+            .filename = filenames[i]
+        };
+        vk_submit_job(context, vk_preload_shader_job, preload, counter);
+    }
+}
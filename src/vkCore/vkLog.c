@@ -0,0 +1,355 @@
+#include "vkInit.h"
+
+#include <stdarg.h>
+#include <stdatomic.h>
+
+/** records buffered per thread, a power of two, and the longest message kept */
+#define VK_LOG_RING_SIZE    256
+#define VK_LOG_MESSAGE_SIZE 240
+
+typedef struct VK_LOG_ENTRY {
+    uint64_t    time;
+    int         level;
+    const char *category;
+    char        message[VK_LOG_MESSAGE_SIZE];
+} VK_LOG_ENTRY;
+
+/** single producer, single consumer ring, the owning thread writes head and the drain writes tail */
+typedef struct VK_LOG_RING {
+    _Atomic uint32_t    head;
+    _Atomic uint32_t    tail;
+    _Atomic uint32_t    dropped; // records lost to a full ring since the last drain
+    uint32_t            thread;
+    struct VK_LOG_RING *next;
+    VK_LOG_ENTRY        entries[VK_LOG_RING_SIZE];
+} VK_LOG_RING;
+
+static struct {
+    _Atomic bool    running;
+    pthread_t       thread;
+    pthread_mutex_t lock;       // ring registration and draining, never taken by a buffered write
+    VK_LOG_RING    *rings;
+    uint32_t        rings_count;
+    uint32_t        generation; // bumped on destruction so threads register new rings
+    VK_LOG_CALLBACK callback;
+    void           *user_data;
+} vk_logger = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static _Thread_local VK_LOG_RING *vk_log_ring;
+static _Thread_local uint32_t     vk_log_ring_generation;
+
+static const char *vk_log_level_names[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+/** hands a record to the callback or writes it to stderr, called with the lock held */
+static void
+vk_log_emit
+(
+    const VK_LOG_ENTRY *entry,
+    uint32_t thread
+)
+{
+    VK_LOG_RECORD record = {
+        .time     = entry->time,
+        .level    = entry->level,
+        .thread   = thread,
+        .category = entry->category,
+        .message  = entry->message
+    };
+
+    if (vk_logger.callback != NULL) {
+        vk_logger.callback(&record, vk_logger.user_data);
+        return;
+    }
+
+    fprintf(stderr, "[%.6f][%s][%s]: %s\n", record.time / 1e9, vk_log_level_names[record.level], record.category, record.message);
+}
+
+static void
+vk_log_drain_locked
+(
+    void
+)
+{
+    for (VK_LOG_RING *ring = vk_logger.rings; ring != NULL; ring = ring->next) {
+        uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        for (; tail != head; tail++)
+            vk_log_emit(&ring->entries[tail & (VK_LOG_RING_SIZE - 1)], ring->thread);
+
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+        uint32_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if (dropped) {
+            VK_LOG_ENTRY entry = {
+                .time     = vk_get_time_ns(),
+                .level    = LOG_WARNING,
+                .category = "log"
+            };
+            snprintf(entry.message, sizeof(entry.message), "%u records dropped, log ring full", dropped);
+            vk_log_emit(&entry, ring->thread);
+        }
+    }
+}
+
+static VK_LOG_RING *
+vk_log_get_ring
+(
+    void
+)
+{
+    if (vk_log_ring != NULL && vk_log_ring_generation == vk_logger.generation)
+        return vk_log_ring;
+
+    VK_LOG_RING *ring = calloc(1, sizeof(VK_LOG_RING));
+
+    pthread_mutex_lock(&vk_logger.lock);
+    ring->thread       = ++vk_logger.rings_count;
+    ring->next         = vk_logger.rings;
+    vk_logger.rings    = ring;
+    vk_log_ring_generation = vk_logger.generation;
+    pthread_mutex_unlock(&vk_logger.lock);
+
+    vk_log_ring = ring;
+    return ring;
+}
+
+static void *
+vk_log_drain_thread
+(
+    void *arg
+)
+{
+    (void) arg;
+
+    const struct timespec interval = { .tv_sec = 0, .tv_nsec = 1000000 };
+
+    while (atomic_load_explicit(&vk_logger.running, memory_order_acquire)) {
+        pthread_mutex_lock(&vk_logger.lock);
+        vk_log_drain_locked();
+        pthread_mutex_unlock(&vk_logger.lock);
+
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * called through VK_LOG and VK_LOGF. while the logger runs a record costs a
+ * vsnprintf into the calling thread's ring, a full ring drops the record.
+ * errors, and everything before vk_create_logger, are written immediately,
+ * behind whatever is still buffered, since an error is usually followed by exit.
+ */
+void
+vk_log_write
+(
+    int level,
+    const char *category,
+    const char *format,
+    ...
+)
+{
+    va_list args;
+    uint64_t now = vk_get_time_ns();
+
+    if (level < LOG_DEBUG || level > LOG_ERROR)
+        level = LOG_ERROR;
+
+    if (level == LOG_ERROR || !atomic_load_explicit(&vk_logger.running, memory_order_acquire)) {
+        VK_LOG_ENTRY entry = {
+            .time     = now,
+            .level    = level,
+            .category = category
+        };
+
+        va_start(args, format);
+        vsnprintf(entry.message, sizeof(entry.message), format, args);
+        va_end(args);
+
+        pthread_mutex_lock(&vk_logger.lock);
+        vk_log_drain_locked();
+        vk_log_emit(&entry, (vk_log_ring != NULL && vk_log_ring_generation == vk_logger.generation) ? vk_log_ring->thread : 0);
+        pthread_mutex_unlock(&vk_logger.lock);
+        return;
+    }
+
+    VK_LOG_RING *ring = vk_log_get_ring();
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail == VK_LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    VK_LOG_ENTRY *entry = &ring->entries[head & (VK_LOG_RING_SIZE - 1)];
+    entry->time     = now;
+    entry->level    = level;
+    entry->category = category;
+
+    va_start(args, format);
+    vsnprintf(entry->message, sizeof(entry->message), format, args);
+    va_end(args);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * starts the background thread that drains the per thread rings into the sink.
+ * callback receives every record on that thread, NULL writes them to stderr.
+ */
+void
+vk_create_logger
+(
+    VK_LOG_CALLBACK callback,
+    void *user_data
+)
+{
+    if (atomic_load(&vk_logger.running)) {
+        VK_LOG(LOG_WARNING, "Logger already created");
+        return;
+    }
+
+    pthread_mutex_lock(&vk_logger.lock);
+    vk_logger.callback  = callback;
+    vk_logger.user_data = user_data;
+    pthread_mutex_unlock(&vk_logger.lock);
+
+    atomic_store(&vk_logger.running, true);
+
+    if (pthread_create(&vk_logger.thread, NULL, vk_log_drain_thread, NULL) != 0)
+    {
+        atomic_store(&vk_logger.running, false);
+        VK_LOG(LOG_ERROR, "Could not create logger thread");
+        exit(-1);
+    }
+
+    VK_LOG(LOG_INFO, "Created Logger");
+}
+
+/** writes out every buffered record now */
+void
+vk_flush_logger
+(
+    void
+)
+{
+    pthread_mutex_lock(&vk_logger.lock);
+    vk_log_drain_locked();
+    pthread_mutex_unlock(&vk_logger.lock);
+}
+
+/** stops the drain thread and writes out what is left, other threads must have stopped logging */
+void
+vk_destroy_logger
+(
+    void
+)
+{
+    if (!atomic_load(&vk_logger.running))
+        return;
+
+    atomic_store(&vk_logger.running, false);
+    pthread_join(vk_logger.thread, NULL);
+
+    pthread_mutex_lock(&vk_logger.lock);
+    vk_log_drain_locked();
+
+    while (vk_logger.rings != NULL) {
+        VK_LOG_RING *next = vk_logger.rings->next;
+        free(vk_logger.rings);
+        vk_logger.rings = next;
+    }
+    vk_logger.rings_count = 0;
+    vk_logger.generation++;
+    vk_logger.callback    = NULL;
+    vk_logger.user_data   = NULL;
+    pthread_mutex_unlock(&vk_logger.lock);
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL
+vk_debug_messenger_callback
+(
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT types,
+    const VkDebugUtilsMessengerCallbackDataEXT *callback_data,
+    void *user_data
+)
+{
+    (void) user_data;
+
+    int level = LOG_DEBUG;
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+        level = LOG_ERROR;
+    else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+        level = LOG_WARNING;
+    else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+        level = LOG_INFO;
+
+    const char *category = "general";
+    if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT)
+        category = "validation";
+    else if (types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT)
+        category = "performance";
+
+    VK_LOGF(level, category, "%s", callback_data->pMessage);
+    return VK_FALSE;
+}
+
+/**
+ * routes VK_EXT_debug_utils messages into the log, the instance must have been created with
+ * VK_EXT_DEBUG_UTILS_EXTENSION_NAME. severities below VK_LOG_MIN_LEVEL are not requested.
+ */
+void
+vk_create_debug_messenger
+(
+    VK_CONTEXT *context
+)
+{
+    PFN_vkCreateDebugUtilsMessengerEXT create_debug_messenger =
+        (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(context->instance, "vkCreateDebugUtilsMessengerEXT");
+
+    if (create_debug_messenger == NULL)
+    {
+        VK_LOG(LOG_WARNING, "VK_EXT_debug_utils not enabled, validation messages are not logged");
+        return;
+    }
+
+    VkDebugUtilsMessageSeverityFlagsEXT severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    if (VK_LOG_MIN_LEVEL <= LOG_WARNING)
+        severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+    if (VK_LOG_MIN_LEVEL <= LOG_INFO)
+        severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+    if (VK_LOG_MIN_LEVEL <= LOG_DEBUG)
+        severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+
+    VkDebugUtilsMessengerCreateInfoEXT create_info = {};
+    create_info.sType           = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    create_info.messageSeverity = severities;
+    create_info.messageType     = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                                  VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                                  VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    create_info.pfnUserCallback = vk_debug_messenger_callback;
+
+    VK_CHECK(create_debug_messenger(context->instance, &create_info, NULL, &context->debug_messenger));
+    VK_LOG(LOG_INFO, "Created Debug Messenger");
+}
+
+void
+vk_destroy_debug_messenger
+(
+    VK_CONTEXT *context
+)
+{
+    if (context->debug_messenger == VK_NULL_HANDLE)
+        return;
+
+    PFN_vkDestroyDebugUtilsMessengerEXT destroy_debug_messenger =
+        (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(context->instance, "vkDestroyDebugUtilsMessengerEXT");
+
+    destroy_debug_messenger(context->instance, context->debug_messenger, NULL);
+    context->debug_messenger = VK_NULL_HANDLE;
+}
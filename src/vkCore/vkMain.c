@@ -13,6 +13,17 @@ vk_create_instance
     const uint32_t required_layers_count
 )
 {
+    // 1.0 loaders do not export vkEnumerateInstanceVersion
+    uint32_t instance_version = VK_API_VERSION_1_0;
+    PFN_vkEnumerateInstanceVersion enumerate_instance_version =
+        (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+    if (enumerate_instance_version != NULL)
+        VK_CHECK(enumerate_instance_version(&instance_version));
+
+    // use the requested version if the loader has it, otherwise the newest the library knows
+    uint32_t requested_version = (context->api_version) ? context->api_version : VK_API_VERSION_1_3;
+    context->api_version = (requested_version < instance_version) ? requested_version : instance_version;
+
     VkApplicationInfo app_info = {};
     app_info = (VkApplicationInfo) {
         .sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO,
@@ -20,19 +31,25 @@ vk_create_instance
         .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
         .pEngineName        = engine_name,
         .engineVersion      = VK_MAKE_VERSION(1, 0, 0),
-        .apiVersion         = VK_API_VERSION_1_0
+        .apiVersion         = context->api_version
     };
 
     // ennumerate all supported extensions and layers untill all required have been found
+    uint64_t start = vk_get_time_ns();
     uint32_t extension_count = 0;
     VK_CHECK(vkEnumerateInstanceExtensionProperties(NULL, &extension_count, NULL));
     VkExtensionProperties extension_properties[extension_count];
     VK_CHECK(vkEnumerateInstanceExtensionProperties(NULL, &extension_count, extension_properties));
 
+    // required extensions may be listed in any order
     uint32_t supported_extensions_count = 0;
-    for (uint32_t ex = 0; supported_extensions_count < required_extensions_count && ex < extension_count; ex++) {
-        if (!strncmp(required_extensions[supported_extensions_count], extension_properties[ex].extensionName, strlen(required_extensions[supported_extensions_count])))
-            supported_extensions_count++;
+    for (uint32_t re = 0; re < required_extensions_count; re++) {
+        for (uint32_t ex = 0; ex < extension_count; ex++) {
+            if (!strcmp(required_extensions[re], extension_properties[ex].extensionName)) {
+                supported_extensions_count++;
+                break;
+            }
+        }
     }
 
     if (supported_extensions_count != required_extensions_count) {
@@ -58,6 +75,8 @@ vk_create_instance
         exit(-1);
     }
 
+    vk_record_init_stage(context, "enumerate instance extensions and layers", start);
+
     VkInstanceCreateInfo create_info = {};
     create_info = (VkInstanceCreateInfo) {
         .sType                   = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
@@ -68,7 +87,9 @@ vk_create_instance
         .ppEnabledLayerNames     = required_layers
     };
 
+    start = vk_get_time_ns();
     VK_CHECK(vkCreateInstance(&create_info, NULL, &context->instance));
+    vk_record_init_stage(context, "create instance", start);
     VK_LOG(LOG_INFO, "Created Instance");
 }
 
@@ -78,10 +99,152 @@ vk_create_surface
     VK_CONTEXT *context
 )
 {
+    uint64_t start = vk_get_time_ns();
     SDL_CHECK(SDL_Vulkan_CreateSurface(context->window, context->instance, &context->surface));
+    vk_record_init_stage(context, "create surface", start);
     VK_LOG(LOG_INFO, "Created Surface");
 }
 
+/** default score per VkPhysicalDeviceType: other, integrated, discrete, virtual, cpu */
+static const uint32_t vk_default_type_scores[5] = { 0, 500, 1000, 250, 100 };
+
+/**
+ * scores a device that passed the filters. the type score dominates, then
+ * 1 point per 64 MiB of device local memory, 1 per 64 compute invocations,
+ * and 100/50 for a dedicated compute/transfer family.
+ */
+static VK_DEVICE_SCORE
+vk_score_physical_device
+(
+    VkPhysicalDevice device,
+    const VkPhysicalDeviceProperties *properties,
+    const VkQueueFamilyProperties *queue_families,
+    uint32_t queue_family_count,
+    const VK_DEVICE_SPECIFICATION *requirements
+)
+{
+    VK_DEVICE_SCORE score = {
+        .type                    = properties->deviceType,
+        .max_compute_invocations = properties->limits.maxComputeWorkGroupInvocations
+    };
+    memcpy(score.name, properties->deviceName, VK_MAX_PHYSICAL_DEVICE_NAME_SIZE);
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            score.device_local_bytes += memory_properties.memoryHeaps[i].size;
+    }
+
+    for (uint32_t i = 0; i < queue_family_count; i++) {
+        VkQueueFlags flags = queue_families[i].queueFlags;
+
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+            score.dedicated_compute = true;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            score.dedicated_transfer = true;
+    }
+
+    bool custom_types = false;
+    for (uint32_t i = 0; i < 5; i++)
+        custom_types |= requirements->type_scores[i] != 0;
+
+    const uint32_t *type_scores = (custom_types) ? requirements->type_scores : vk_default_type_scores;
+
+    score.score  = (score.type < 5) ? type_scores[score.type] : 0;
+    score.score += score.device_local_bytes / (64ull * 1024 * 1024);
+    score.score += score.max_compute_invocations / 64;
+    score.score += (score.dedicated_compute) ? 100 : 0;
+    score.score += (score.dedicated_transfer) ? 50 : 0;
+
+    return score;
+}
+
+/**
+ * maps every queue role to a family. compute and transfer prefer the family with
+ * the fewest other capabilities, so they run beside graphics instead of behind it.
+ * graphics prefers a family that can also present, present prefers the graphics family.
+ * with shared every role the graphics family supports is mapped to it instead.
+ */
+static void
+vk_find_queue_families
+(
+    VK_CONTEXT *context,
+    VkPhysicalDevice device,
+    const VkQueueFamilyProperties *queue_families,
+    uint32_t queue_family_count,
+    bool shared,
+    VK_SUPPORTED_QUEUE_FAMILIES *supported
+)
+{
+    static const VkQueueFlags role_flags[4] = {
+        VK_QUEUE_GRAPHICS_BIT,
+        VK_QUEUE_COMPUTE_BIT,
+        VK_QUEUE_TRANSFER_BIT,
+        VK_QUEUE_SPARSE_BINDING_BIT
+    };
+    const VkQueueFlags capabilities = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+
+    uint32_t best_cost[4];
+    VkBool32 present_support[queue_family_count];
+
+    *supported = (VK_SUPPORTED_QUEUE_FAMILIES) {};
+
+    for (uint32_t j = 0; j < queue_family_count; j++) {
+        /** headless contexts have no surface and never present */
+        present_support[j] = VK_FALSE;
+        if (context->surface != VK_NULL_HANDLE)
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, j, context->surface, &present_support[j]);
+
+        if (queue_families[j].queueCount == 0)
+            continue;
+
+        // graphics and compute families can always transfer
+        VkQueueFlags flags = queue_families[j].queueFlags;
+        if (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+            flags |= VK_QUEUE_TRANSFER_BIT;
+
+        for (uint32_t role = 0; role < 4; role++) {
+            if (!(flags & role_flags[role]))
+                continue;
+
+            uint32_t cost = (role == GRAPHICS) ? !present_support[j] : (uint32_t) __builtin_popcount(flags & capabilities & ~role_flags[role]);
+
+            if (supported->found[role] && cost >= best_cost[role])
+                continue;
+
+            best_cost[role]              = cost;
+            supported->found[role]       = true;
+            supported->indicies[role]    = j;
+        }
+    }
+
+    if (shared && supported->found[GRAPHICS]) {
+        VkQueueFlags graphics_flags = queue_families[supported->indicies[GRAPHICS]].queueFlags | VK_QUEUE_TRANSFER_BIT;
+
+        for (uint32_t role = 1; role < 4; role++) {
+            if (graphics_flags & role_flags[role])
+                supported->indicies[role] = supported->indicies[GRAPHICS];
+        }
+    }
+
+    if (supported->found[GRAPHICS] && present_support[supported->indicies[GRAPHICS]]) {
+        supported->found[PRESENT]    = true;
+        supported->indicies[PRESENT] = supported->indicies[GRAPHICS];
+    } else {
+        for (uint32_t j = 0; j < queue_family_count && !supported->found[PRESENT]; j++) {
+            supported->found[PRESENT]    = present_support[j];
+            supported->indicies[PRESENT] = j;
+        }
+    }
+
+    for (uint32_t role = 0; role < 5; role++) {
+        if (supported->found[role])
+            supported->family_queue_counts[role] = queue_families[supported->indicies[role]].queueCount;
+    }
+}
+
 void
 vk_select_physical_device
 (
@@ -91,13 +254,24 @@ vk_select_physical_device
     uint32_t required_extensions_count
 )
 {
-    VkPhysicalDevice selected_device = VK_NULL_HANDLE;
+    uint64_t                    start                   = vk_get_time_ns();
+    VkPhysicalDevice            selected_device         = VK_NULL_HANDLE;
+    uint32_t                    selected_index          = 0;
+    VkPhysicalDeviceFeatures    selected_features       = {};
+    VK_SUPPORTED_QUEUE_FAMILIES selected_queue_families = {};
+
+    /** a pinned device is taken as soon as it passes the filters */
+    bool pinned = requirements.device_name != NULL || requirements.pin_uuid;
 
     uint32_t device_count = 0;
     VK_CHECK(vkEnumeratePhysicalDevices(context->instance, &device_count, NULL));
     VkPhysicalDevice physical_devices[device_count];
     VK_CHECK(vkEnumeratePhysicalDevices(context->instance, &device_count, physical_devices));
 
+    free(context->device_scores);
+    context->device_scores_count = 0;
+    context->device_scores       = calloc(device_count, sizeof(VK_DEVICE_SCORE));
+
     for (uint32_t i = 0; i < device_count; i++) {
         bool selected = true;
 
@@ -121,64 +295,36 @@ vk_select_physical_device
 
         context->device_details.supported_types[device_properties.deviceType] = true;
 
+        // if the user pinned a device skip every other one
+        if (requirements.device_name != NULL && strstr(device_properties.deviceName, requirements.device_name) == NULL)
+            continue;
+        if (requirements.pin_uuid) {
+            /** deviceUUID tells identical GPUs apart, pipelineCacheUUID only names the driver build */
+            if (context->api_version < VK_API_VERSION_1_1 || device_properties.apiVersion < VK_API_VERSION_1_1)
+                continue;
+
+            VkPhysicalDeviceIDProperties id_properties = {};
+            id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+            VkPhysicalDeviceProperties2 properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties.pNext = &id_properties;
+
+            vkGetPhysicalDeviceProperties2(device, &properties);
+            if (memcmp(requirements.device_uuid, id_properties.deviceUUID, VK_UUID_SIZE))
+                continue;
+        }
+
         // if specified by the user and feature is not supported continue to next device
-        if (requirements.device_features.robustBufferAccess                      && !device_features.robustBufferAccess                      ) continue;
-        if (requirements.device_features.fullDrawIndexUint32                     && !device_features.fullDrawIndexUint32                     ) continue;
-        if (requirements.device_features.imageCubeArray                          && !device_features.imageCubeArray                          ) continue;
-        if (requirements.device_features.independentBlend                        && !device_features.independentBlend                        ) continue;
-        if (requirements.device_features.geometryShader                          && !device_features.geometryShader                          ) continue;
-        if (requirements.device_features.tessellationShader                      && !device_features.tessellationShader                      ) continue;
-        if (requirements.device_features.sampleRateShading                       && !device_features.sampleRateShading                       ) continue;
-        if (requirements.device_features.dualSrcBlend                            && !device_features.dualSrcBlend                            ) continue;
-        if (requirements.device_features.logicOp                                 && !device_features.logicOp                                 ) continue;
-        if (requirements.device_features.multiDrawIndirect                       && !device_features.multiDrawIndirect                       ) continue;
-        if (requirements.device_features.drawIndirectFirstInstance               && !device_features.drawIndirectFirstInstance               ) continue;
-        if (requirements.device_features.depthClamp                              && !device_features.depthClamp                              ) continue;
-        if (requirements.device_features.depthBiasClamp                          && !device_features.depthBiasClamp                          ) continue;
-        if (requirements.device_features.fillModeNonSolid                        && !device_features.fillModeNonSolid                        ) continue;
-        if (requirements.device_features.depthBounds                             && !device_features.depthBounds                             ) continue;
-        if (requirements.device_features.wideLines                               && !device_features.wideLines                               ) continue;
-        if (requirements.device_features.largePoints                             && !device_features.largePoints                             ) continue;
-        if (requirements.device_features.alphaToOne                              && !device_features.alphaToOne                              ) continue;
-        if (requirements.device_features.multiViewport                           && !device_features.multiViewport                           ) continue;
-        if (requirements.device_features.samplerAnisotropy                       && !device_features.samplerAnisotropy                       ) continue;
-        if (requirements.device_features.textureCompressionETC2                  && !device_features.textureCompressionETC2                  ) continue;
-        if (requirements.device_features.textureCompressionASTC_LDR              && !device_features.textureCompressionASTC_LDR              ) continue;
-        if (requirements.device_features.textureCompressionBC                    && !device_features.textureCompressionBC                    ) continue;
-        if (requirements.device_features.occlusionQueryPrecise                   && !device_features.occlusionQueryPrecise                   ) continue;
-        if (requirements.device_features.pipelineStatisticsQuery                 && !device_features.pipelineStatisticsQuery                 ) continue;
-        if (requirements.device_features.vertexPipelineStoresAndAtomics          && !device_features.vertexPipelineStoresAndAtomics          ) continue;
-        if (requirements.device_features.fragmentStoresAndAtomics                && !device_features.fragmentStoresAndAtomics                ) continue;
-        if (requirements.device_features.shaderTessellationAndGeometryPointSize  && !device_features.shaderTessellationAndGeometryPointSize  ) continue;
-        if (requirements.device_features.shaderImageGatherExtended               && !device_features.shaderImageGatherExtended               ) continue;
-        if (requirements.device_features.shaderStorageImageExtendedFormats       && !device_features.shaderStorageImageExtendedFormats       ) continue;
-        if (requirements.device_features.shaderStorageImageMultisample           && !device_features.shaderStorageImageMultisample           ) continue;
-        if (requirements.device_features.shaderStorageImageReadWithoutFormat     && !device_features.shaderStorageImageReadWithoutFormat     ) continue;
-        if (requirements.device_features.shaderStorageImageWriteWithoutFormat    && !device_features.shaderStorageImageWriteWithoutFormat    ) continue;
-        if (requirements.device_features.shaderUniformBufferArrayDynamicIndexing && !device_features.shaderUniformBufferArrayDynamicIndexing ) continue;
-        if (requirements.device_features.shaderSampledImageArrayDynamicIndexing  && !device_features.shaderSampledImageArrayDynamicIndexing  ) continue;
-        if (requirements.device_features.shaderStorageBufferArrayDynamicIndexing && !device_features.shaderStorageBufferArrayDynamicIndexing ) continue;
-        if (requirements.device_features.shaderStorageImageArrayDynamicIndexing  && !device_features.shaderStorageImageArrayDynamicIndexing  ) continue;
-        if (requirements.device_features.shaderClipDistance                      && !device_features.shaderClipDistance                      ) continue;
-        if (requirements.device_features.shaderCullDistance                      && !device_features.shaderCullDistance                      ) continue;
-        if (requirements.device_features.shaderFloat64                           && !device_features.shaderFloat64                           ) continue;
-        if (requirements.device_features.shaderInt64                             && !device_features.shaderInt64                             ) continue;
-        if (requirements.device_features.shaderInt16                             && !device_features.shaderInt16                             ) continue;
-        if (requirements.device_features.shaderResourceResidency                 && !device_features.shaderResourceResidency                 ) continue;
-        if (requirements.device_features.shaderResourceMinLod                    && !device_features.shaderResourceMinLod                    ) continue;
-        if (requirements.device_features.sparseBinding                           && !device_features.sparseBinding                           ) continue;
-        if (requirements.device_features.sparseResidencyBuffer                   && !device_features.sparseResidencyBuffer                   ) continue;
-        if (requirements.device_features.sparseResidencyImage2D                  && !device_features.sparseResidencyImage2D                  ) continue;
-        if (requirements.device_features.sparseResidencyImage3D                  && !device_features.sparseResidencyImage3D                  ) continue;
-        if (requirements.device_features.sparseResidency2Samples                 && !device_features.sparseResidency2Samples                 ) continue;
-        if (requirements.device_features.sparseResidency4Samples                 && !device_features.sparseResidency4Samples                 ) continue;
-        if (requirements.device_features.sparseResidency8Samples                 && !device_features.sparseResidency8Samples                 ) continue;
-        if (requirements.device_features.sparseResidency16Samples                && !device_features.sparseResidency16Samples                ) continue;
-        if (requirements.device_features.sparseResidencyAliased                  && !device_features.sparseResidencyAliased                  ) continue;
-        if (requirements.device_features.variableMultisampleRate                 && !device_features.variableMultisampleRate                 ) continue;
-        if (requirements.device_features.inheritedQueries                        && !device_features.inheritedQueries                        ) continue;
-
-        context->device_details.device_features = device_features;
+        if (!vk_check_features((const VkBool32 *) &requirements.device_features,
+                               (const VkBool32 *) &device_features,
+                               sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32)))
+        {
+            continue;
+        }
+
+        if (!vk_check_feature_chain(context, device, device_properties.apiVersion, requirements.features_chain))
+            continue;
 
         // check the device extension support
         uint32_t extension_count = 0;
@@ -205,54 +351,33 @@ vk_select_physical_device
         VkQueueFamilyProperties queue_families[queue_family_count];
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families);
 
-        uint32_t max_supported_queue_types = 0;
-        for (uint32_t j = 0; j < queue_family_count; j++) {
-            VkBool32 present_support;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, j, context->surface, &present_support);
-
-            VkQueueFamilyProperties queue_family = queue_families[j];
-
-            // count number of supported queue types
-            uint32_t current_supported_queue_types = present_support;
-            for (uint32_t k = 0; k < 4; k++)
-                current_supported_queue_types += (queue_family.queueFlags >> k) & 0x1;
-
-            // compare to maximum number of supported queue types for a queue
-            if (max_supported_queue_types >= current_supported_queue_types)
-                continue;
-
-            // if this one supports more types
-            max_supported_queue_types = current_supported_queue_types;
-
-            // update corresponding indicies
-            for (uint32_t l = 0; l < 4; l++) {
-                bool flag = max_supported_queue_types >> l;
-
-                if (!flag) continue;
-
-                context->queue_families.found[l]    = flag;
-                context->queue_families.indicies[l] = j;
-            }
-
-            if (!present_support) continue;
-
-            context->queue_families.found[4]    = present_support;
-            context->queue_families.indicies[4] = j;
-        }
+        VK_SUPPORTED_QUEUE_FAMILIES supported_queue_families;
+        vk_find_queue_families(context, device, queue_families, queue_family_count, requirements.shared_queues, &supported_queue_families);
 
         // check if the minimum queue requirements have been met
         for (uint32_t j = 0; j < 5; j++) {
-            if (requirements.specified_queues[j] && !context->queue_families.found[j]) {
+            if (requirements.specified_queues[j] && !supported_queue_families.found[j]) {
                 selected = false;
                 break;
             }
         }
 
-        // if the device is deemed worthy select it and break;
-        if (selected) {
-            selected_device = device;
-            break;
+        if (!selected)
+            continue;
+
+        uint32_t index = context->device_scores_count++;
+        context->device_scores[index] = vk_score_physical_device(device, &device_properties, queue_families, queue_family_count, &requirements);
+
+        // in scored mode keep the best device, otherwise the first worthy device is selected
+        if (selected_device == VK_NULL_HANDLE || context->device_scores[index].score > context->device_scores[selected_index].score) {
+            selected_device         = device;
+            selected_index          = index;
+            selected_features       = device_features;
+            selected_queue_families = supported_queue_families;
         }
+
+        if (!requirements.scored || pinned)
+            break;
     }
 
     // if no device is suitable throw an error
@@ -262,7 +387,27 @@ vk_select_physical_device
         exit(-1);
     }
 
-    context->physical_device = selected_device;
+    context->physical_device                = selected_device;
+    context->device_details.device_features = selected_features;
+    context->device_details.features_chain  = requirements.features_chain;
+    context->device_details.shared_queues   = requirements.shared_queues;
+    memcpy(context->device_details.queue_counts, requirements.queue_counts, sizeof(requirements.queue_counts));
+    memcpy(context->device_details.queue_priorities, requirements.queue_priorities, sizeof(requirements.queue_priorities));
+    context->queue_families                 = selected_queue_families;
+    context->device_scores[selected_index].selected = true;
+
+    /** report every candidate so the choice can be checked */
+    for (uint32_t i = 0; i < context->device_scores_count; i++) {
+        char msg[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE + 128];
+        VK_DEVICE_SCORE *score = &context->device_scores[i];
+
+        snprintf(msg, sizeof(msg), "%s Device %s: score %llu, %llu MiB device local, %u compute invocations, dedicated compute %s, dedicated transfer %s",
+                 (score->selected) ? "*" : " ", score->name, (unsigned long long) score->score,
+                 (unsigned long long) (score->device_local_bytes >> 20), score->max_compute_invocations,
+                 (score->dedicated_compute) ? "yes" : "no", (score->dedicated_transfer) ? "yes" : "no");
+        VK_LOG(LOG_INFO, msg);
+    }
+    vk_record_init_stage(context, "select physical device", start);
     VK_LOG(LOG_INFO, "Selected Physical Device");
 }
 
@@ -274,54 +419,91 @@ vk_create_logical_device
     uint32_t extension_count
 )
 {
-    // Find the unique queue indicies
+    uint64_t start = vk_get_time_ns();
+    VK_SUPPORTED_QUEUE_FAMILIES *families = &context->queue_families;
+
+    // Find the unique queue families and hand out queues of each to the roles mapped to it
     uint32_t queue_create_info_count = 0;
     uint32_t queue_create_info_indicies[5];
+    uint32_t queue_create_info_used[5] = {};
+    float    queue_priorities[5][5 * VK_MAX_QUEUES_PER_ROLE];
 
-    for (uint32_t i = 0; i < 5; i++) {
-        if (!context->queue_families.found[i])
+    for (uint32_t role = 0; role < 5; role++) {
+        if (!families->found[role])
             continue;
 
-        bool unique = true;
-        for (uint32_t j = 0; j < queue_create_info_count; j++) {
-            if (context->queue_families.indicies[i] == queue_create_info_indicies[j]) {
-                unique = false;
-                break;
-            }
+        // present shares the graphics queue whenever the family is the same
+        if (role == PRESENT && families->found[GRAPHICS] && families->indicies[PRESENT] == families->indicies[GRAPHICS]) {
+            families->first_queue[PRESENT] = families->first_queue[GRAPHICS];
+            families->queue_count[PRESENT] = 1;
+            continue;
+        }
+
+        uint32_t unique = 0;
+        while (unique < queue_create_info_count && queue_create_info_indicies[unique] != families->indicies[role])
+            unique++;
+
+        if (unique == queue_create_info_count) {
+            queue_create_info_indicies[queue_create_info_count] = families->indicies[role];
+            queue_create_info_count++;
         }
 
-        if (!unique)
+        uint32_t available = families->family_queue_counts[role];
+        uint32_t used      = queue_create_info_used[unique];
+        uint32_t wanted    = (role == PRESENT || context->device_details.queue_counts[role] == 0) ? 1 : context->device_details.queue_counts[role];
+        wanted = VK_CLAMP(wanted, VK_MAX_QUEUES_PER_ROLE);
+
+        if (used == available) {
+            // the family is exhausted, share the queues already handed out
+            VK_LOG(LOG_WARNING, "Not enough queues in family, sharing queues between roles");
+            families->first_queue[role] = 0;
+            families->queue_count[role] = VK_CLAMP(wanted, available);
             continue;
+        }
 
-        queue_create_info_count++;
-        queue_create_info_indicies[queue_create_info_count] = i;
+        families->first_queue[role] = used;
+        families->queue_count[role] = VK_CLAMP(wanted, available - used);
+
+        const float *priorities = (role == PRESENT) ? NULL : context->device_details.queue_priorities[role];
+        for (uint32_t i = 0; i < families->queue_count[role]; i++)
+            queue_priorities[unique][used + i] = (priorities) ? priorities[i] : 1.0f;
+
+        queue_create_info_used[unique] += families->queue_count[role];
     }
 
-    // define create infos for all the unique queue indicies and create them
-    float queue_priorities[queue_create_info_count];
+    // define create infos for all the unique queue families and create them
     VkDeviceQueueCreateInfo queue_create_infos[queue_create_info_count];
 
     for (uint32_t i = 0; i < queue_create_info_count; i++) {
-        queue_priorities[i]   = 1.0f;
         queue_create_infos[i] = (VkDeviceQueueCreateInfo) {
             .sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-            .pQueuePriorities = &queue_priorities[i],
+            .pQueuePriorities = queue_priorities[i],
             .queueFamilyIndex = queue_create_info_indicies[i],
-            .queueCount       = 1
+            .queueCount       = queue_create_info_used[i]
         };
     }
 
+    // with a features chain the core features move into VkPhysicalDeviceFeatures2
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext    = context->device_details.features_chain;
+    features.features = context->device_details.device_features;
+
+    bool chained = context->device_details.features_chain != NULL;
+
     VkDeviceCreateInfo logical_device_create_info = {};
     logical_device_create_info   = (VkDeviceCreateInfo) {
         .sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext                   = (chained) ? &features : NULL,
         .queueCreateInfoCount    = queue_create_info_count,
         .pQueueCreateInfos       = queue_create_infos,
-        .pEnabledFeatures        = &context->device_details.device_features,
+        .pEnabledFeatures        = (chained) ? NULL : &context->device_details.device_features,
         .enabledExtensionCount   = extension_count,
         .ppEnabledExtensionNames = extensions,
     };
 
     VK_CHECK(vkCreateDevice(context->physical_device, &logical_device_create_info, NULL, &context->logical_device));
+    vk_record_init_stage(context, "create logical device", start);
     VK_LOG(LOG_INFO, "Created Logical Device");
 }
 
@@ -331,15 +513,113 @@ vk_create_queues
     VK_CONTEXT *context
 )
 {
+    VK_SUPPORTED_QUEUE_FAMILIES *families = &context->queue_families;
+
     for (uint32_t i = 0; i < 5; i++) {
-        if (!context->device_details.specified_queues[i])
+        if (!families->found[i])
             continue;
 
-        vkGetDeviceQueue(context->logical_device, context->queue_families.indicies[i], 0, &context->queues[i]);
+        for (uint32_t j = 0; j < families->queue_count[i]; j++) {
+            VkQueue queue;
+            vkGetDeviceQueue(context->logical_device, families->indicies[i], families->first_queue[i] + j, &queue);
+            context->role_queues[i][j] = queue;
+
+            /** shared queues get a single lock */
+            uint32_t k = 0;
+            while (k < context->queue_locks_count && context->locked_queues[k] != queue)
+                k++;
+
+            if (k == context->queue_locks_count) {
+                context->locked_queues[k] = queue;
+                pthread_mutex_init(&context->queue_locks[k], NULL);
+                context->queue_locks_count++;
+            }
+        }
+
+        context->queues[i] = context->role_queues[i][0];
     }
     VK_LOG(LOG_INFO, "Retrived Queues");
 }
 
+void
+vk_destroy_queues
+(
+    VK_CONTEXT *context
+)
+{
+    for (uint32_t i = 0; i < context->queue_locks_count; i++)
+        pthread_mutex_destroy(&context->queue_locks[i]);
+    context->queue_locks_count = 0;
+}
+
+static pthread_mutex_t *
+vk_get_queue_lock
+(
+    VK_CONTEXT *context,
+    VkQueue queue
+)
+{
+    for (uint32_t i = 0; i < context->queue_locks_count; i++) {
+        if (context->locked_queues[i] == queue)
+            return &context->queue_locks[i];
+    }
+
+    VK_LOG(LOG_ERROR, "Queue was not retrieved by vk_create_queues");
+    exit(-1);
+}
+
+/** vkQueueSubmit under the lock of the queue, safe from any thread even when roles share the queue */
+VkResult
+vk_queue_submit
+(
+    VK_CONTEXT *context,
+    VkQueue queue,
+    uint32_t submit_count,
+    const VkSubmitInfo *submits,
+    VkFence fence
+)
+{
+    pthread_mutex_t *lock = vk_get_queue_lock(context, queue);
+
+    pthread_mutex_lock(lock);
+    VkResult result = vkQueueSubmit(queue, submit_count, submits, fence);
+    pthread_mutex_unlock(lock);
+    return result;
+}
+
+/** vkQueuePresentKHR under the lock of the queue, the present queue is usually the graphics queue */
+VkResult
+vk_queue_present
+(
+    VK_CONTEXT *context,
+    VkQueue queue,
+    const VkPresentInfoKHR *present_info
+)
+{
+    pthread_mutex_t *lock = vk_get_queue_lock(context, queue);
+
+    pthread_mutex_lock(lock);
+    VkResult result = vkQueuePresentKHR(queue, present_info);
+    pthread_mutex_unlock(lock);
+    return result;
+}
+
+/** queue index of a role, e.g. one per submitting thread, wraps around the queues created for the role */
+VkQueue
+vk_get_queue
+(
+    VK_CONTEXT *context,
+    uint32_t role,
+    uint32_t index
+)
+{
+    if (role >= 5 || context->queue_families.queue_count[role] == 0) {
+        VK_LOGF(LOG_ERROR, "vk", "No queues were created for role %u", role);
+        exit(-1);
+    }
+    return context->role_queues[role][index % context->queue_families.queue_count[role]];
+}
+
 void
 vk_create_swapchain
 (
@@ -347,6 +627,7 @@ vk_create_swapchain
     VK_SWAPCHAIN_SUPPORT_DETAILS swapchain_specification
 )
 {
+    uint64_t start = vk_get_time_ns();
 
     VkPresentModeKHR   present_mode;
     VkSurfaceFormatKHR format       = {};
@@ -419,8 +700,10 @@ vk_create_swapchain
 
         SDL_Vulkan_GetDrawableSize(context->window, (int *) &width, (int *) &height);
 
-        extent.width = VK_CLAMP(width, capabilities.minImageExtent.width);
-        extent.height = VK_CLAMP(height, capabilities.minImageExtent.height);
+        extent.width = VK_CLAMP(width, capabilities.maxImageExtent.width);
+        extent.height = VK_CLAMP(height, capabilities.maxImageExtent.height);
+        extent.width = (extent.width < capabilities.minImageExtent.width) ? capabilities.minImageExtent.width : extent.width;
+        extent.height = (extent.height < capabilities.minImageExtent.height) ? capabilities.minImageExtent.height : extent.height;
     }
 
     context->swapchain_details.capabilities = capabilities;
@@ -430,6 +713,8 @@ vk_create_swapchain
     create_info.sType            = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     create_info.surface          = context->surface;
     create_info.minImageCount    = capabilities.minImageCount + 1; // spec recommendation
+    if (capabilities.maxImageCount && create_info.minImageCount > capabilities.maxImageCount)
+        create_info.minImageCount = capabilities.maxImageCount;
     create_info.imageExtent      = extent;
     create_info.imageExtent      = extent;
     create_info.imageFormat      = format.format;
@@ -456,9 +741,11 @@ vk_create_swapchain
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.presentMode    = present_mode;
     create_info.clipped        = VK_TRUE;
-    create_info.oldSwapchain   = NULL;
+    /** hand over from the current swapchain, VK_NULL_HANDLE on first creation */
+    create_info.oldSwapchain   = context->swapchain;
 
-    vkCreateSwapchainKHR(context->logical_device, &create_info, NULL, &context->swapchain);
+    VK_CHECK(vkCreateSwapchainKHR(context->logical_device, &create_info, NULL, &context->swapchain));
+    vk_record_init_stage(context, "create swapchain", start);
     VK_LOG(LOG_INFO, "Created Swapchain");
 
 }
@@ -469,6 +756,8 @@ vk_create_image_views
     VK_CONTEXT *context
 )
 {
+    uint64_t start = vk_get_time_ns();
+
     /** get the images of the swapchain */
     vkGetSwapchainImagesKHR(context->logical_device, context->swapchain, &context->image_count, NULL);
     context->images      = malloc(sizeof(VkImage) * context->image_count);
@@ -501,6 +790,7 @@ vk_create_image_views
 
         VK_CHECK(vkCreateImageView(context->logical_device, &create_info, NULL, &context->image_views[i]));
     }
+    vk_record_init_stage(context, "create image views", start);
     VK_LOG(LOG_INFO, "Created Images and Image Views");
 }
 
@@ -574,199 +864,372 @@ vk_create_subpass
 }
 
 void
-vk_create_pipeline
+vk_create_subpass_dependency
 (
-    VK_CONTEXT *context,
-    VK_PIPELINE_SPECIFICATION pipeline_specification,
-    const char **filenames,
-    const uint32_t count
+    VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    VK_SUBPASS_DEPENDENCY_SPECIFICATION dependency_specification
 )
 {
-    /** shader stage create infos */
-    uint32_t shader_stage_create_info_count = 0; /** will contain number of actually created shader stage infos */
-
-    VkShaderModule                  shader_modules[count];
-    VkPipelineShaderStageCreateInfo shader_stage_create_info[count];
+    /** create and add a subpass dependency to the pipeline specification */
+    pipeline_specification->subpass_dependencies_count++;
+    pipeline_specification->subpass_dependencies = realloc(pipeline_specification->subpass_dependencies, sizeof(VkSubpassDependency) * pipeline_specification->subpass_dependencies_count);
+    pipeline_specification->subpass_dependencies[pipeline_specification->subpass_dependencies_count - 1] = (VkSubpassDependency) {
+        .srcSubpass      = dependency_specification.src_subpass,
+        .dstSubpass      = dependency_specification.dst_subpass,
+        .srcStageMask    = dependency_specification.src_stage_mask,
+        .dstStageMask    = dependency_specification.dst_stage_mask,
+        .srcAccessMask   = dependency_specification.src_access_mask,
+        .dstAccessMask   = dependency_specification.dst_access_mask,
+        .dependencyFlags = dependency_specification.dependency_flags
+    };
+    VK_LOG(LOG_INFO, "Created Subpass Dependency");
+}
 
-    for (uint32_t i = 0; i < count; i++)
+/**
+ * sets constant_id to value in every stage of stages, replacing an earlier value of the same id and size.
+ * value is copied, so it can live on the stack.
+ */
+void
+vk_create_specialization_constant
+(
+    VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    VkShaderStageFlags stages,
+    uint32_t constant_id,
+    const void *value,
+    size_t size
+)
+{
+    for (VkShaderStageFlags remaining = stages & VK_SHADER_STAGE_ALL_GRAPHICS; remaining; remaining &= remaining - 1)
     {
-        size_t  size;
-        char *buffer;
-        bool fragtype = false;
-        bool verttype = false;
-
-        /** read and load shaders from files*/
-        FILE *f = fopen(filenames[i], "rb");
+        VkShaderStageFlagBits stage = remaining & -remaining;
+        VK_SPECIALIZATION_SPECIFICATION *specialization = NULL;
 
-        VK_CHECK_FILETYPE(filenames[i], ".frag", strlen(filenames[i]), 5, fragtype);
-        VK_CHECK_FILETYPE(filenames[i], ".vert", strlen(filenames[i]), 5, verttype);
+        for (uint32_t i = 0; i < pipeline_specification->specializations_count; i++)
+        {
+            if (pipeline_specification->specializations[i].stage == stage)
+                specialization = &pipeline_specification->specializations[i];
+        }
 
-        if (!verttype && !fragtype)
+        if (specialization == NULL)
         {
-            VK_LOG(LOG_WARNING, "Unsupported file type, skipping");
-            continue;
+            pipeline_specification->specializations_count++;
+            pipeline_specification->specializations = realloc(pipeline_specification->specializations, sizeof(VK_SPECIALIZATION_SPECIFICATION) * pipeline_specification->specializations_count);
+            specialization = &pipeline_specification->specializations[pipeline_specification->specializations_count - 1];
+            *specialization = (VK_SPECIALIZATION_SPECIFICATION) {
+                .stage = stage
+            };
         }
 
-        /** if not found continue */
-        if (f == NULL)
+        VkSpecializationMapEntry *entry = NULL;
+        for (uint32_t i = 0; i < specialization->map_entries_count; i++)
         {
-            VK_LOG(LOG_WARNING, "file not found, skipping");
-            continue;
+            if (specialization->map_entries[i].constantID == constant_id)
+                entry = &specialization->map_entries[i];
         }
 
-        fseek(f, 0, SEEK_END);
-        size = ftell(f);
-        fseek(f, 0, SEEK_SET);
+        /** a constant has one type in the shader, so its size never changes */
+        if (entry != NULL && entry->size != size)
+        {
+            VK_LOGF(LOG_ERROR, "vk", "Specialization constant %u set with %zu bytes, was %zu", constant_id, size, entry->size);
+            exit(-1);
+        }
 
-        /** fix alignment for uint32_t cast when passed to create info */
-        size = (size % 4 == 0) ? size: size + 4 - (size % 4);
+        /** a new value is appended to data, a replaced one is written in place */
+        if (entry == NULL)
+        {
+            specialization->map_entries_count++;
+            specialization->map_entries = realloc(specialization->map_entries, sizeof(VkSpecializationMapEntry) * specialization->map_entries_count);
+            entry = &specialization->map_entries[specialization->map_entries_count - 1];
+            *entry = (VkSpecializationMapEntry) {
+                .constantID = constant_id,
+                .offset     = specialization->data_size,
+                .size       = size
+            };
+
+            specialization->data_size += size;
+            specialization->data = realloc(specialization->data, specialization->data_size);
+        }
+        memcpy((uint8_t *) specialization->data + entry->offset, value, size);
+    }
+}
 
-        buffer = malloc(size * sizeof(buffer));
+/** points info at the constants of a specialization, NULL when there are none */
+const VkSpecializationInfo *
+vk_get_specialization_info
+(
+    const VK_SPECIALIZATION_SPECIFICATION *specialization,
+    VkSpecializationInfo *info
+)
+{
+    if (specialization == NULL || specialization->map_entries_count == 0)
+        return NULL;
 
-        /** if file exists but cant read exit */
-        if (fread(buffer, 1, size, f) != size)
+    for (uint32_t i = 0; i < specialization->map_entries_count; i++)
+    {
+        const VkSpecializationMapEntry *entry = &specialization->map_entries[i];
+        if (entry->offset + entry->size > specialization->data_size)
         {
-            VK_LOG(LOG_ERROR, "Could not read file");
+            VK_LOG(LOG_ERROR, "Specialization constant lies outside its data");
             exit(-1);
         }
-        fclose(f);
+    }
 
-        VkShaderModuleCreateInfo shader_create_info = {};
-        shader_create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        shader_create_info.codeSize = size;
-        shader_create_info.pCode    = (uint32_t *) buffer;
+    *info = (VkSpecializationInfo) {
+        .mapEntryCount = specialization->map_entries_count,
+        .pMapEntries   = specialization->map_entries,
+        .dataSize      = specialization->data_size,
+        .pData         = specialization->data
+    };
+    return info;
+}
 
-        /** create shader modules */
-        VK_CHECK(vkCreateShaderModule(context->logical_device, &shader_create_info, NULL, &shader_modules[shader_stage_create_info_count]));
-        VK_LOG(LOG_INFO, "Created Shader Module");
+VkShaderStageFlagBits
+vk_get_shader_stage
+(
+    const char *filename
+)
+{
+    bool fragtype = false;
+    bool verttype = false;
+    bool comptype = false;
+
+    VK_CHECK_FILETYPE(filename, ".frag", strlen(filename), 5, fragtype);
+    VK_CHECK_FILETYPE(filename, ".vert", strlen(filename), 5, verttype);
+    VK_CHECK_FILETYPE(filename, ".comp", strlen(filename), 5, comptype);
+
+    if (fragtype) return VK_SHADER_STAGE_FRAGMENT_BIT;
+    if (verttype) return VK_SHADER_STAGE_VERTEX_BIT;
+    if (comptype) return VK_SHADER_STAGE_COMPUTE_BIT;
+    return 0;
+}
 
-        VkPipelineShaderStageCreateInfo stage_create_info = {};
-        stage_create_info.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        stage_create_info.stage  = (fragtype) ? VK_SHADER_STAGE_FRAGMENT_BIT: stage_create_info.stage;
-        stage_create_info.stage  = (verttype) ?   VK_SHADER_STAGE_VERTEX_BIT: stage_create_info.stage;
-        stage_create_info.module = shader_modules[shader_stage_create_info_count];
-        stage_create_info.pName  = "main";
+/**
+ * fills state with everything vkCreateGraphicsPipelines reads for one specification,
+ * loading the shader modules and creating the layout and render pass.
+ * the create info points into state, so state must outlive the pipeline creation.
+ */
+void
+vk_create_pipeline_state
+(
+    VK_CONTEXT *context,
+    const VK_PIPELINE_SPECIFICATION *pipeline_specification,
+    const char **filenames,
+    uint32_t count,
+    VK_PIPELINE_STATE *state
+)
+{
+    *state = (VK_PIPELINE_STATE) {};
+
+    /** shader stage create infos */
+    for (uint32_t i = 0; i < count; i++)
+    {
+        VkShaderStageFlagBits stage = vk_get_shader_stage(filenames[i]);
 
-        shader_stage_create_info[shader_stage_create_info_count] = stage_create_info;
-        shader_stage_create_info_count++;
+        if (!(stage & VK_SHADER_STAGE_ALL_GRAPHICS))
+        {
+            VK_LOG(LOG_WARNING, "Unsupported file type, skipping");
+            continue;
+        }
 
-        // vkDestroyShaderModule(context->logical_device, shader_module, NULL);
-        free(buffer);
+        if (state->stages_count == VK_PIPELINE_MAX_STAGES)
+        {
+            VK_LOG(LOG_WARNING, "Too many shader stages, skipping");
+            break;
+        }
+
+        if (!vk_load_shader_module(context, filenames[i], &state->shader_modules[state->stages_count]))
+            continue;
+
+        const VK_SPECIALIZATION_SPECIFICATION *specialization = NULL;
+        for (uint32_t j = 0; j < pipeline_specification->specializations_count; j++)
+        {
+            if (pipeline_specification->specializations[j].stage == stage)
+                specialization = &pipeline_specification->specializations[j];
+        }
+
+        VkPipelineShaderStageCreateInfo stage_create_info = {};
+        stage_create_info.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage_create_info.stage               = stage;
+        stage_create_info.module              = state->shader_modules[state->stages_count];
+        stage_create_info.pName               = "main";
+        stage_create_info.pSpecializationInfo = vk_get_specialization_info(specialization, &state->specializations[state->stages_count]);
+
+        state->stages[state->stages_count] = stage_create_info;
+        state->stages_count++;
     }
 
     /** vertex input create infos */
-    VkPipelineVertexInputStateCreateInfo vertex_create_info = {};
-    vertex_create_info.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_create_info.vertexBindingDescriptionCount   = pipeline_specification.vertex_binding_descriptions_count;
-    vertex_create_info.pVertexBindingDescriptions      = pipeline_specification.vertex_binding_descriptions;
-    vertex_create_info.vertexAttributeDescriptionCount = pipeline_specification.vertex_attribute_descriptions_count;
-    vertex_create_info.pVertexAttributeDescriptions    = pipeline_specification.vertex_attribute_descriptions;
+    state->vertex_input.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    state->vertex_input.vertexBindingDescriptionCount   = pipeline_specification->vertex_binding_descriptions_count;
+    state->vertex_input.pVertexBindingDescriptions      = pipeline_specification->vertex_binding_descriptions;
+    state->vertex_input.vertexAttributeDescriptionCount = pipeline_specification->vertex_attribute_descriptions_count;
+    state->vertex_input.pVertexAttributeDescriptions    = pipeline_specification->vertex_attribute_descriptions;
 
     /** input assembly create infos */
-    VkPipelineInputAssemblyStateCreateInfo input_assembly_create_info = {};
-    input_assembly_create_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly_create_info.topology               = pipeline_specification.topology;
-    input_assembly_create_info.primitiveRestartEnable = pipeline_specification.primitive_restart_enable;
+    state->input_assembly.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    state->input_assembly.topology               = pipeline_specification->topology;
+    state->input_assembly.primitiveRestartEnable = pipeline_specification->primitive_restart_enable;
 
     /** Viewport definition */
-    VkViewport viewport = {};
-    viewport.x      = pipeline_specification.x;
-    viewport.y      = pipeline_specification.y;
-    viewport.width  = pipeline_specification.width;
-    viewport.height = pipeline_specification.height;
+    state->viewport.x        = pipeline_specification->x;
+    state->viewport.y        = pipeline_specification->y;
+    state->viewport.width    = pipeline_specification->width;
+    state->viewport.height   = pipeline_specification->height;
+    state->viewport.minDepth = pipeline_specification->min_depth;
+    state->viewport.maxDepth = pipeline_specification->max_depth;
 
     /** scissor */
-    VkRect2D scissor = pipeline_specification.scissor;
+    state->scissor = pipeline_specification->scissor;
 
-    VkPipelineViewportStateCreateInfo viewport_state_create_info = {};
-    viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_state_create_info.viewportCount = 1;
-    viewport_state_create_info.pViewports = &viewport;
-    viewport_state_create_info.scissorCount = 1;
-    viewport_state_create_info.pScissors = &scissor;
+    state->viewport_state.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    state->viewport_state.viewportCount = 1;
+    state->viewport_state.pViewports    = &state->viewport;
+    state->viewport_state.scissorCount  = 1;
+    state->viewport_state.pScissors     = &state->scissor;
 
     /** rasterizer create info */
-    VkPipelineRasterizationStateCreateInfo rasterizer_create_info = {};
-    rasterizer_create_info.sType                   = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer_create_info.depthClampEnable        = pipeline_specification.depth_clamp_enable;
-    rasterizer_create_info.rasterizerDiscardEnable = pipeline_specification.rasterizer_discard_enable;
-    rasterizer_create_info.polygonMode             = pipeline_specification.polygon_mode;
-    rasterizer_create_info.cullMode                = pipeline_specification.cull_mode;
-    rasterizer_create_info.frontFace               = pipeline_specification.front_face;
-    rasterizer_create_info.depthBiasEnable         = pipeline_specification.depth_bias_enable;
-    rasterizer_create_info.depthBiasConstantFactor = pipeline_specification.depth_bias_constant_factor;
-    rasterizer_create_info.depthBiasClamp          = pipeline_specification.depth_bias_clamp;
-    rasterizer_create_info.depthBiasSlopeFactor    = pipeline_specification.depth_bias_slope_factor;
-    rasterizer_create_info.lineWidth               = pipeline_specification.line_width;
+    state->rasterization.sType                   = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    state->rasterization.depthClampEnable        = pipeline_specification->depth_clamp_enable;
+    state->rasterization.rasterizerDiscardEnable = pipeline_specification->rasterizer_discard_enable;
+    state->rasterization.polygonMode             = pipeline_specification->polygon_mode;
+    state->rasterization.cullMode                = pipeline_specification->cull_mode;
+    state->rasterization.frontFace               = pipeline_specification->front_face;
+    state->rasterization.depthBiasEnable         = pipeline_specification->depth_bias_enable;
+    state->rasterization.depthBiasConstantFactor = pipeline_specification->depth_bias_constant_factor;
+    state->rasterization.depthBiasClamp          = pipeline_specification->depth_bias_clamp;
+    state->rasterization.depthBiasSlopeFactor    = pipeline_specification->depth_bias_slope_factor;
+    state->rasterization.lineWidth               = pipeline_specification->line_width;
 
     /** TODO: multisampler create info */
-    VkPipelineMultisampleStateCreateInfo multisample_create_info = {};
-    multisample_create_info.sType                 = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisample_create_info.sampleShadingEnable   = pipeline_specification.sample_shading_enable;
-    multisample_create_info.rasterizationSamples  = pipeline_specification.rasterization_samples;
-    multisample_create_info.minSampleShading      = pipeline_specification.min_sample_shading;
-    multisample_create_info.pSampleMask           = pipeline_specification.p_sample_mask;
-    multisample_create_info.alphaToCoverageEnable = pipeline_specification.alpha_to_coverage_enable;
-    multisample_create_info.alphaToOneEnable      = pipeline_specification.alpha_to_one_enable;
+    state->multisample.sType                 = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    state->multisample.sampleShadingEnable   = pipeline_specification->sample_shading_enable;
+    state->multisample.rasterizationSamples  = pipeline_specification->rasterization_samples;
+    state->multisample.minSampleShading      = pipeline_specification->min_sample_shading;
+    state->multisample.pSampleMask           = pipeline_specification->p_sample_mask;
+    state->multisample.alphaToCoverageEnable = pipeline_specification->alpha_to_coverage_enable;
+    state->multisample.alphaToOneEnable      = pipeline_specification->alpha_to_one_enable;
 
     /** TODO: Depth buffering */
 
     /** TODO: Color blending */
-    VkPipelineColorBlendStateCreateInfo color_blending_create_info = {};
-    color_blending_create_info.sType             = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    color_blending_create_info.logicOpEnable     = pipeline_specification.logic_op_enable;
-    color_blending_create_info.logicOp           = pipeline_specification.logic_op;
-    color_blending_create_info.attachmentCount   = pipeline_specification.color_blend_attachment_states_count;
-    color_blending_create_info.pAttachments      = pipeline_specification.color_blend_attachment_states;
-    color_blending_create_info.blendConstants[0] = pipeline_specification.blend_constants[0];
-    color_blending_create_info.blendConstants[1] = pipeline_specification.blend_constants[1];
-    color_blending_create_info.blendConstants[2] = pipeline_specification.blend_constants[2];
-    color_blending_create_info.blendConstants[3] = pipeline_specification.blend_constants[3];
+    state->color_blend.sType             = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    state->color_blend.logicOpEnable     = pipeline_specification->logic_op_enable;
+    state->color_blend.logicOp           = pipeline_specification->logic_op;
+    state->color_blend.attachmentCount   = pipeline_specification->color_blend_attachment_states_count;
+    state->color_blend.pAttachments      = pipeline_specification->color_blend_attachment_states;
+    state->color_blend.blendConstants[0] = pipeline_specification->blend_constants[0];
+    state->color_blend.blendConstants[1] = pipeline_specification->blend_constants[1];
+    state->color_blend.blendConstants[2] = pipeline_specification->blend_constants[2];
+    state->color_blend.blendConstants[3] = pipeline_specification->blend_constants[3];
+
+    /** dynamic viewport and scissor, recorded per frame instead of baked into the pipeline */
+    state->dynamic_states[0] = VK_DYNAMIC_STATE_VIEWPORT;
+    state->dynamic_states[1] = VK_DYNAMIC_STATE_SCISSOR;
+
+    state->dynamic_state.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    state->dynamic_state.dynamicStateCount = 2;
+    state->dynamic_state.pDynamicStates    = state->dynamic_states;
 
     /** VkPipeline create info */
     VkPipelineLayoutCreateInfo layout_create_info = {};
-    layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.setLayoutCount         = pipeline_specification->descriptor_set_layouts_count;
+    layout_create_info.pSetLayouts            = pipeline_specification->descriptor_set_layouts;
+    layout_create_info.pushConstantRangeCount = pipeline_specification->push_constant_ranges_count;
+    layout_create_info.pPushConstantRanges    = pipeline_specification->push_constant_ranges;
 
-    VK_CHECK(vkCreatePipelineLayout(context->logical_device, &layout_create_info, NULL, &context->pipeline_layout));
-    VK_LOG(LOG_INFO, "Created Pipeline Layout");
+    /** layouts and render passes are shared by equal descriptions, the caller owns a reference to each */
+    uint64_t start = vk_get_time_ns();
+    state->layout = vk_get_pipeline_layout(context, &layout_create_info);
+    vk_record_init_stage(context, "create pipeline layout", start);
 
     /** Create VkRenderPass */
     VkRenderPassCreateInfo render_pass_create_info = {};
     render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_create_info.attachmentCount = pipeline_specification.attachment_descriptions_count;
-    render_pass_create_info.pAttachments    = pipeline_specification.attachment_descriptions;
-    render_pass_create_info.subpassCount    = pipeline_specification.subpass_descriptions_count;
-    render_pass_create_info.pSubpasses      = pipeline_specification.subpass_descriptions;
-
-    VK_CHECK(vkCreateRenderPass(context->logical_device, &render_pass_create_info, NULL, &context->render_pass));
-    VK_LOG(LOG_INFO, "Created Render Pass");
+    render_pass_create_info.attachmentCount = pipeline_specification->attachment_descriptions_count;
+    render_pass_create_info.pAttachments    = pipeline_specification->attachment_descriptions;
+    render_pass_create_info.subpassCount    = pipeline_specification->subpass_descriptions_count;
+    render_pass_create_info.pSubpasses      = pipeline_specification->subpass_descriptions;
+    render_pass_create_info.dependencyCount = pipeline_specification->subpass_dependencies_count;
+    render_pass_create_info.pDependencies   = pipeline_specification->subpass_dependencies;
+
+    start = vk_get_time_ns();
+    state->render_pass = vk_get_render_pass(context, &render_pass_create_info);
+    vk_record_init_stage(context, "create render pass", start);
+
+    /** Graphics Pipeline create info */
+    state->create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    state->create_info.stageCount = state->stages_count;
+    state->create_info.pStages    = state->stages;
+    state->create_info.pVertexInputState = &state->vertex_input;
+    state->create_info.pInputAssemblyState = &state->input_assembly;
+    state->create_info.pViewportState = &state->viewport_state;
+    state->create_info.pRasterizationState = &state->rasterization;
+    state->create_info.pMultisampleState = &state->multisample;
+    state->create_info.pDepthStencilState = NULL;
+    state->create_info.pColorBlendState = &state->color_blend;
+    state->create_info.pDynamicState = (pipeline_specification->dynamic_viewport) ? &state->dynamic_state : NULL;
+    state->create_info.layout = state->layout;
+    state->create_info.renderPass = state->render_pass;
+    state->create_info.subpass = 0;
+    state->create_info.basePipelineHandle = VK_NULL_HANDLE;
+    state->create_info.basePipelineIndex = -1;
+}
 
-    /** Create Graphics Pipeline */
-    VkGraphicsPipelineCreateInfo graphics_pipeline_create_info = {};
-    graphics_pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    graphics_pipeline_create_info.stageCount = shader_stage_create_info_count;
-    graphics_pipeline_create_info.pStages    = shader_stage_create_info;
-    graphics_pipeline_create_info.pVertexInputState = &vertex_create_info;
-    graphics_pipeline_create_info.pInputAssemblyState = &input_assembly_create_info;
-    graphics_pipeline_create_info.pViewportState = &viewport_state_create_info;
-    graphics_pipeline_create_info.pRasterizationState = &rasterizer_create_info;
-    graphics_pipeline_create_info.pMultisampleState = &multisample_create_info;
-    graphics_pipeline_create_info.pDepthStencilState = NULL;
-    graphics_pipeline_create_info.pColorBlendState = &color_blending_create_info;
-    graphics_pipeline_create_info.pDynamicState = NULL;
-    graphics_pipeline_create_info.layout = context->pipeline_layout;
-    graphics_pipeline_create_info.renderPass = context->render_pass;
-    graphics_pipeline_create_info.subpass = 0;
-    graphics_pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
-    graphics_pipeline_create_info.basePipelineIndex = -1;
-
-    VK_CHECK(vkCreateGraphicsPipelines(context->logical_device, VK_NULL_HANDLE, 1, &graphics_pipeline_create_info, NULL, &context->pipeline));
-    VK_LOG(LOG_INFO, "Created Graphics Pipeline");
-
-    for (uint32_t i = 0; i < shader_stage_create_info_count; i++)
+/** releases the shader modules of a state once its pipeline has been created */
+void
+vk_destroy_pipeline_state
+(
+    VK_CONTEXT *context,
+    VK_PIPELINE_STATE *state
+)
+{
+    /** modules stay cached for the next pipeline that uses the same code */
+    for (uint32_t i = 0; i < state->stages_count; i++)
     {
-        vkDestroyShaderModule(context->logical_device, shader_modules[i], NULL);
+        vk_release_shader_module(context, state->shader_modules[i]);
     }
+    state->stages_count = 0;
+}
+
+void
+vk_create_pipeline
+(
+    VK_CONTEXT *context,
+    VK_PIPELINE_SPECIFICATION pipeline_specification,
+    const char **filenames,
+    const uint32_t count
+)
+{
+    VK_PIPELINE_STATE state;
+
+    vk_create_pipeline_state(context, &pipeline_specification, filenames, count, &state);
+
+    /** the previous pipeline's references, equal descriptions got the same handles back */
+    if (context->pipeline_layout != VK_NULL_HANDLE)
+        vk_release_pipeline_layout(context, context->pipeline_layout);
+    if (context->render_pass != VK_NULL_HANDLE)
+        vk_release_render_pass(context, context->render_pass);
+
+    context->pipeline_layout = state.layout;
+    context->render_pass     = state.render_pass;
+    VK_LOG(LOG_INFO, "Created Pipeline Layout");
+    VK_LOG(LOG_INFO, "Created Render Pass");
+
+    /** pipeline_cache is VK_NULL_HANDLE unless vk_create_pipeline_cache was called */
+    uint64_t start = vk_get_time_ns();
+    VK_CHECK(vkCreateGraphicsPipelines(context->logical_device, context->pipeline_cache, 1, &state.create_info, NULL, &context->pipeline));
+    uint64_t elapsed = vk_get_time_ns() - start;
+    vk_record_init_stage(context, "create graphics pipeline", start);
+
+    context->pipeline_cache_details.pipeline_time += elapsed;
+    context->pipeline_cache_details.pipeline_count++;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Created Graphics Pipeline (%.3f ms)", elapsed / 1e6);
+    VK_LOG(LOG_INFO, msg);
+
+    vk_destroy_pipeline_state(context, &state);
 }
 
 void
@@ -775,6 +1238,8 @@ vk_create_framebuffers
     VK_CONTEXT *context
 )
 {
+    uint64_t start = vk_get_time_ns();
+
     context->framebuffers_count = context->image_count;
     context->framebuffers = malloc(sizeof(VkFramebuffer) * context->framebuffers_count);
 
@@ -796,4 +1261,5 @@ vk_create_framebuffers
         VK_CHECK(vkCreateFramebuffer(context->logical_device, &create_info, NULL, &context->framebuffers[i]));
         VK_LOG(LOG_INFO, "Created Framebuffer");
     }
+    vk_record_init_stage(context, "create framebuffers", start);
 }
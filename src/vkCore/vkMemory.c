@@ -0,0 +1,434 @@
+#include "vkInit.h"
+
+/** returns the buddy order that fits size bytes */
+static uint32_t
+vk_buddy_order
+(
+    VkDeviceSize size
+)
+{
+    uint32_t order = 0;
+    while ((VK_ALLOCATOR_MIN_SIZE << order) < size)
+        order++;
+    return order;
+}
+
+/** fills a fresh tree so every node is one free buddy of its level */
+static uint8_t *
+vk_buddy_create
+(
+    uint32_t max_order
+)
+{
+    uint8_t *tree = malloc((2ull << max_order) - 1);
+
+    for (uint32_t depth = 0; depth <= max_order; depth++) {
+        uint32_t first = (1u << depth) - 1;
+        memset(&tree[first], max_order - depth + 1, 1u << depth);
+    }
+    return tree;
+}
+
+/** returns the offset in units of VK_ALLOCATOR_MIN_SIZE or UINT32_MAX if there is no room */
+static uint32_t
+vk_buddy_allocate
+(
+    uint8_t *tree,
+    uint32_t max_order,
+    uint32_t order
+)
+{
+    if (tree[0] < order + 1)
+        return UINT32_MAX;
+
+    /** descend into the tightest child that still fits to keep large buddies whole */
+    uint32_t node = 0;
+    uint32_t node_order = max_order;
+    while (node_order != order) {
+        uint32_t left  = 2 * node + 1;
+        uint32_t right = left + 1;
+
+        if (tree[left] < order + 1)
+            node = right;
+        else if (tree[right] < order + 1)
+            node = left;
+        else
+            node = (tree[right] < tree[left]) ? right : left;
+
+        node_order--;
+    }
+
+    tree[node] = 0;
+    uint32_t offset = ((node + 1) << node_order) - (1u << max_order);
+
+    while (node) {
+        node = (node - 1) / 2;
+        uint8_t left  = tree[2 * node + 1];
+        uint8_t right = tree[2 * node + 2];
+        tree[node] = (left > right) ? left : right;
+    }
+    return offset;
+}
+
+static void
+vk_buddy_free
+(
+    uint8_t *tree,
+    uint32_t max_order,
+    uint32_t order,
+    uint32_t offset
+)
+{
+    uint32_t node = (offset >> order) + (1u << (max_order - order)) - 1;
+    uint32_t node_order = order;
+
+    tree[node] = node_order + 1;
+
+    /** merge with the buddy whenever both halves are free again */
+    while (node) {
+        node = (node - 1) / 2;
+        node_order++;
+
+        uint8_t left  = tree[2 * node + 1];
+        uint8_t right = tree[2 * node + 2];
+
+        if (left == node_order && right == node_order)
+            tree[node] = node_order + 1;
+        else
+            tree[node] = (left > right) ? left : right;
+    }
+}
+
+void
+vk_create_allocator
+(
+    VK_CONTEXT *context,
+    VkDeviceSize block_size
+)
+{
+    VK_ALLOCATOR *allocator = &context->allocator;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+
+    *allocator = (VK_ALLOCATOR) {};
+    vkGetPhysicalDeviceMemoryProperties(context->physical_device, &allocator->memory_properties);
+    pthread_mutex_init(&allocator->lock, NULL);
+
+    /** buddies need a power of two block */
+    allocator->max_order   = vk_buddy_order((block_size) ? block_size : VK_ALLOCATOR_BLOCK_SIZE);
+    allocator->block_size  = VK_ALLOCATOR_MIN_SIZE << allocator->max_order;
+    allocator->granularity = properties.limits.bufferImageGranularity;
+
+    VK_LOG(LOG_INFO, "Created Allocator");
+}
+
+void
+vk_destroy_allocator
+(
+    VK_CONTEXT *context
+)
+{
+    VK_ALLOCATOR *allocator = &context->allocator;
+
+    if (allocator->statistics.allocation_count || allocator->statistics.dedicated_count)
+        VK_LOG(LOG_WARNING, "Destroying allocator with live allocations");
+
+    for (uint32_t i = 0; i < allocator->blocks_count; i++) {
+        vkFreeMemory(context->logical_device, allocator->blocks[i].memory, NULL);
+        free(allocator->blocks[i].tree);
+    }
+    free(allocator->blocks);
+    pthread_mutex_destroy(&allocator->lock);
+
+    *allocator = (VK_ALLOCATOR) {};
+}
+
+uint32_t
+vk_find_memory_type
+(
+    VK_CONTEXT *context,
+    uint32_t type_bits,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred
+)
+{
+    VkPhysicalDeviceMemoryProperties *properties = &context->allocator.memory_properties;
+    uint32_t fallback = UINT32_MAX;
+
+    for (uint32_t i = 0; i < properties->memoryTypeCount; i++) {
+        VkMemoryPropertyFlags flags = properties->memoryTypes[i].propertyFlags;
+
+        if (!(type_bits & (1u << i)) || (flags & required) != required)
+            continue;
+
+        if ((flags & preferred) == preferred)
+            return i;
+
+        if (fallback == UINT32_MAX)
+            fallback = i;
+    }
+    return fallback;
+}
+
+/** allocates device memory of one type and maps it if it is host visible */
+static VkResult
+vk_allocate_device_memory
+(
+    VK_CONTEXT *context,
+    uint32_t memory_type,
+    VkDeviceSize size,
+    VkDeviceMemory *memory,
+    void **mapped
+)
+{
+    VkMemoryAllocateInfo allocate_info = {};
+    allocate_info.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize  = size;
+    allocate_info.memoryTypeIndex = memory_type;
+
+    VkResult result = vkAllocateMemory(context->logical_device, &allocate_info, NULL, memory);
+    if (result != VK_SUCCESS)
+        return result;
+
+    *mapped = NULL;
+    if (context->allocator.memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        VK_CHECK(vkMapMemory(context->logical_device, *memory, 0, VK_WHOLE_SIZE, 0, mapped));
+
+    return VK_SUCCESS;
+}
+
+void
+vk_allocate_memory
+(
+    VK_CONTEXT *context,
+    VkMemoryRequirements requirements,
+    VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred,
+    bool linear,
+    VK_ALLOCATION *allocation
+)
+{
+    VK_ALLOCATOR *allocator = &context->allocator;
+    VkDeviceSize size       = requirements.size;
+    VkDeviceSize alignment  = requirements.alignment;
+
+    uint32_t memory_type = vk_find_memory_type(context, requirements.memoryTypeBits, required, preferred | required);
+    if (memory_type == UINT32_MAX) {
+        VK_LOG(LOG_ERROR, "Could not find suitable memory type");
+        exit(-1);
+    }
+
+    /** optimal images take whole granularity pages so they never share one with a linear resource */
+    if (!linear) {
+        size      = (size + allocator->granularity - 1) & ~(allocator->granularity - 1);
+        alignment = (alignment > allocator->granularity) ? alignment : allocator->granularity;
+    }
+
+    /** buddies are aligned to their size, so fitting the alignment is enough */
+    uint32_t order = vk_buddy_order((size > alignment) ? size : alignment);
+
+    *allocation = (VK_ALLOCATION) {
+        .size        = requirements.size,
+        .memory_type = memory_type,
+        .block       = -1,
+        .order       = order
+    };
+
+    pthread_mutex_lock(&allocator->lock);
+    allocator->statistics.total_allocations++;
+
+    if ((VK_ALLOCATOR_MIN_SIZE << order) <= allocator->block_size / 2) {
+        uint32_t offset = UINT32_MAX;
+        uint32_t b;
+
+        for (b = 0; b < allocator->blocks_count; b++) {
+            if (allocator->blocks[b].memory_type != memory_type)
+                continue;
+
+            offset = vk_buddy_allocate(allocator->blocks[b].tree, allocator->max_order, order);
+            if (offset != UINT32_MAX)
+                break;
+        }
+
+        if (offset == UINT32_MAX) {
+            VK_MEMORY_BLOCK block = { .memory_type = memory_type };
+
+            if (vk_allocate_device_memory(context, memory_type, allocator->block_size, &block.memory, &block.mapped) == VK_SUCCESS) {
+                block.tree = vk_buddy_create(allocator->max_order);
+
+                b = allocator->blocks_count++;
+                allocator->blocks = realloc(allocator->blocks, sizeof(VK_MEMORY_BLOCK) * allocator->blocks_count);
+                allocator->blocks[b] = block;
+
+                allocator->statistics.block_count++;
+                allocator->statistics.block_bytes += allocator->block_size;
+
+                offset = vk_buddy_allocate(block.tree, allocator->max_order, order);
+                VK_LOG(LOG_INFO, "Created Memory Block");
+            } else {
+                VK_LOG(LOG_WARNING, "Could not allocate memory block, falling back to a dedicated allocation");
+            }
+        }
+
+        if (offset != UINT32_MAX) {
+            VK_MEMORY_BLOCK *block = &allocator->blocks[b];
+            VkDeviceSize allocated = VK_ALLOCATOR_MIN_SIZE << order;
+
+            block->used += allocated;
+
+            allocation->memory = block->memory;
+            allocation->offset = (VkDeviceSize) offset * VK_ALLOCATOR_MIN_SIZE;
+            allocation->mapped = (block->mapped) ? (uint8_t *) block->mapped + allocation->offset : NULL;
+            allocation->block  = (int32_t) b;
+
+            allocator->statistics.allocation_count++;
+            allocator->statistics.used_bytes      += allocated;
+            allocator->statistics.requested_bytes += requirements.size;
+
+            pthread_mutex_unlock(&allocator->lock);
+            return;
+        }
+    }
+
+    /** very large resources get their own allocation instead of pinning a whole block */
+    if (vk_allocate_device_memory(context, memory_type, requirements.size, &allocation->memory, &allocation->mapped) != VK_SUCCESS) {
+        VK_LOG(LOG_ERROR, "Could not allocate device memory");
+        exit(-1);
+    }
+
+    allocator->statistics.dedicated_count++;
+    allocator->statistics.dedicated_bytes += requirements.size;
+    pthread_mutex_unlock(&allocator->lock);
+}
+
+void
+vk_free_memory
+(
+    VK_CONTEXT *context,
+    VK_ALLOCATION *allocation
+)
+{
+    VK_ALLOCATOR *allocator = &context->allocator;
+
+    if (allocation->memory == VK_NULL_HANDLE)
+        return;
+
+    pthread_mutex_lock(&allocator->lock);
+    allocator->statistics.total_frees++;
+
+    if (allocation->block < 0) {
+        vkFreeMemory(context->logical_device, allocation->memory, NULL);
+
+        allocator->statistics.dedicated_count--;
+        allocator->statistics.dedicated_bytes -= allocation->size;
+    } else {
+        VK_MEMORY_BLOCK *block = &allocator->blocks[allocation->block];
+        VkDeviceSize allocated = VK_ALLOCATOR_MIN_SIZE << allocation->order;
+
+        vk_buddy_free(block->tree, allocator->max_order, allocation->order, (uint32_t) (allocation->offset / VK_ALLOCATOR_MIN_SIZE));
+        block->used -= allocated;
+
+        allocator->statistics.allocation_count--;
+        allocator->statistics.used_bytes      -= allocated;
+        allocator->statistics.requested_bytes -= allocation->size;
+    }
+    pthread_mutex_unlock(&allocator->lock);
+
+    *allocation = (VK_ALLOCATION) { .block = -1 };
+}
+
+void
+vk_create_buffer
+(
+    VK_CONTEXT *context,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VK_BUFFER *buffer
+)
+{
+    VkBufferCreateInfo create_info = {};
+    create_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    create_info.size        = size;
+    create_info.usage       = usage;
+    create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VK_CHECK(vkCreateBuffer(context->logical_device, &create_info, NULL, &buffer->buffer));
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(context->logical_device, buffer->buffer, &requirements);
+
+    vk_allocate_memory(context, requirements, properties, 0, true, &buffer->allocation);
+    VK_CHECK(vkBindBufferMemory(context->logical_device, buffer->buffer, buffer->allocation.memory, buffer->allocation.offset));
+}
+
+void
+vk_destroy_buffer
+(
+    VK_CONTEXT *context,
+    VK_BUFFER *buffer
+)
+{
+    vkDestroyBuffer(context->logical_device, buffer->buffer, NULL);
+    vk_free_memory(context, &buffer->allocation);
+    buffer->buffer = VK_NULL_HANDLE;
+}
+
+void
+vk_create_image
+(
+    VK_CONTEXT *context,
+    const VkImageCreateInfo *create_info,
+    VkMemoryPropertyFlags properties,
+    VK_IMAGE *image
+)
+{
+    VK_CHECK(vkCreateImage(context->logical_device, create_info, NULL, &image->image));
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(context->logical_device, image->image, &requirements);
+
+    vk_allocate_memory(context, requirements, properties, 0, create_info->tiling == VK_IMAGE_TILING_LINEAR, &image->allocation);
+    VK_CHECK(vkBindImageMemory(context->logical_device, image->image, image->allocation.memory, image->allocation.offset));
+}
+
+void
+vk_destroy_image
+(
+    VK_CONTEXT *context,
+    VK_IMAGE *image
+)
+{
+    vkDestroyImage(context->logical_device, image->image, NULL);
+    vk_free_memory(context, &image->allocation);
+    image->image = VK_NULL_HANDLE;
+}
+
+void
+vk_get_allocator_statistics
+(
+    VK_CONTEXT *context,
+    VK_ALLOCATOR_STATISTICS *statistics
+)
+{
+    VK_ALLOCATOR *allocator = &context->allocator;
+    VkDeviceSize largest_sum = 0;
+
+    pthread_mutex_lock(&allocator->lock);
+    *statistics = allocator->statistics;
+    statistics->largest_free = 0;
+
+    for (uint32_t i = 0; i < allocator->blocks_count; i++) {
+        uint8_t root = allocator->blocks[i].tree[0];
+        VkDeviceSize largest = (root) ? VK_ALLOCATOR_MIN_SIZE << (root - 1) : 0;
+
+        largest_sum += largest;
+        if (largest > statistics->largest_free)
+            statistics->largest_free = largest;
+    }
+    pthread_mutex_unlock(&allocator->lock);
+
+    VkDeviceSize free_bytes = statistics->block_bytes - statistics->used_bytes;
+    statistics->fragmentation = (free_bytes) ? 1.0f - (float) largest_sum / (float) free_bytes : 0.0f;
+}
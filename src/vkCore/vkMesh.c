@@ -0,0 +1,351 @@
+#include "vkInit.h"
+
+/** takes count from the first free run that fits, returns false if none does */
+static bool
+vk_mesh_range_allocate
+(
+    VK_MESH_RANGE *ranges,
+    uint32_t *ranges_count,
+    uint32_t count,
+    uint32_t *offset
+)
+{
+    for (uint32_t i = 0; i < *ranges_count; i++) {
+        if (ranges[i].count < count)
+            continue;
+
+        *offset = ranges[i].offset;
+        ranges[i].offset += count;
+        ranges[i].count  -= count;
+
+        if (ranges[i].count == 0) {
+            memmove(&ranges[i], &ranges[i + 1], sizeof(VK_MESH_RANGE) * (*ranges_count - i - 1));
+            (*ranges_count)--;
+        }
+        return true;
+    }
+    return false;
+}
+
+/** gives a run back, merging it with the free runs either side */
+static void
+vk_mesh_range_free
+(
+    VK_MESH_RANGE **ranges,
+    uint32_t *ranges_count,
+    uint32_t *ranges_capacity,
+    uint32_t offset,
+    uint32_t count
+)
+{
+    uint32_t i = 0;
+    while (i < *ranges_count && (*ranges)[i].offset < offset)
+        i++;
+
+    bool merge_previous = i > 0 && (*ranges)[i - 1].offset + (*ranges)[i - 1].count == offset;
+    bool merge_next     = i < *ranges_count && offset + count == (*ranges)[i].offset;
+
+    if (merge_previous && merge_next) {
+        (*ranges)[i - 1].count += count + (*ranges)[i].count;
+        memmove(&(*ranges)[i], &(*ranges)[i + 1], sizeof(VK_MESH_RANGE) * (*ranges_count - i - 1));
+        (*ranges_count)--;
+    } else if (merge_previous) {
+        (*ranges)[i - 1].count += count;
+    } else if (merge_next) {
+        (*ranges)[i].offset  = offset;
+        (*ranges)[i].count  += count;
+    } else {
+        if (*ranges_count == *ranges_capacity) {
+            *ranges_capacity = (*ranges_capacity) ? *ranges_capacity * 2 : 16;
+            *ranges = realloc(*ranges, sizeof(VK_MESH_RANGE) * *ranges_capacity);
+        }
+        memmove(&(*ranges)[i + 1], &(*ranges)[i], sizeof(VK_MESH_RANGE) * (*ranges_count - i));
+        (*ranges)[i] = (VK_MESH_RANGE) { .offset = offset, .count = count };
+        (*ranges_count)++;
+    }
+}
+
+/** bytes of each vertex that are not position, 0 when interleaved */
+static uint32_t
+vk_mesh_attribute_size
+(
+    const VK_MESH_STORE *store
+)
+{
+    return (store->layout == VK_MESH_SPLIT_POSITIONS) ? store->vertex_size - store->position_size : 0;
+}
+
+/**
+ * creates device local buffers for vertices_capacity vertices of vertex_size bytes and indices_capacity
+ * uint32 indices. every vertex starts with position_size bytes of position, with VK_MESH_SPLIT_POSITIONS
+ * those go to their own buffer so depth only passes fetch nothing else. needs vk_create_uploader.
+ */
+void
+vk_create_mesh_store
+(
+    VK_CONTEXT *context,
+    uint32_t layout,
+    uint32_t vertex_size,
+    uint32_t position_size,
+    uint32_t vertices_capacity,
+    uint32_t indices_capacity,
+    VK_MESH_STORE *store
+)
+{
+    uint64_t start = vk_get_time_ns();
+
+    if (context->uploader.size == 0) {
+        VK_LOG(LOG_ERROR, "Mesh store requires vk_create_uploader");
+        exit(-1);
+    }
+
+    if (vertex_size == 0 || position_size == 0 || position_size > vertex_size ||
+        vertices_capacity == 0 || indices_capacity == 0) {
+        VK_LOG(LOG_ERROR, "Invalid mesh store sizes");
+        exit(-1);
+    }
+
+    *store = (VK_MESH_STORE) {
+        .layout            = layout,
+        .vertex_size       = vertex_size,
+        .position_size     = position_size,
+        .vertices_capacity = vertices_capacity,
+        .indices_capacity  = indices_capacity
+    };
+    pthread_mutex_init(&store->lock, NULL);
+
+    uint32_t attribute_size = vk_mesh_attribute_size(store);
+    uint32_t stream_size    = (layout == VK_MESH_SPLIT_POSITIONS) ? position_size : vertex_size;
+
+    vk_create_buffer(context, (VkDeviceSize) stream_size * vertices_capacity,
+                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &store->vertices);
+    if (attribute_size > 0)
+        vk_create_buffer(context, (VkDeviceSize) attribute_size * vertices_capacity,
+                         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &store->attributes);
+    vk_create_buffer(context, sizeof(uint32_t) * (VkDeviceSize) indices_capacity,
+                     VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &store->indices);
+
+    vk_mesh_range_free(&store->free_vertices, &store->free_vertices_count, &store->free_vertices_capacity, 0, vertices_capacity);
+    vk_mesh_range_free(&store->free_indices, &store->free_indices_count, &store->free_indices_capacity, 0, indices_capacity);
+
+    vk_record_init_stage(context, "create mesh store", start);
+    VK_LOGF(LOG_INFO, "vk", "Created Mesh Store (%u vertices of %u bytes, %u indices, %s)",
+            vertices_capacity, vertex_size, indices_capacity,
+            (layout == VK_MESH_SPLIT_POSITIONS) ? "split positions" : "interleaved");
+}
+
+/** no frame in flight may still be drawing from the store */
+void
+vk_destroy_mesh_store
+(
+    VK_CONTEXT *context,
+    VK_MESH_STORE *store
+)
+{
+    if (store->vertices.buffer == VK_NULL_HANDLE)
+        return;
+
+    vk_destroy_buffer(context, &store->vertices);
+    if (store->attributes.buffer != VK_NULL_HANDLE)
+        vk_destroy_buffer(context, &store->attributes);
+    vk_destroy_buffer(context, &store->indices);
+
+    free(store->free_vertices);
+    free(store->free_indices);
+    pthread_mutex_destroy(&store->lock);
+
+    *store = (VK_MESH_STORE) {};
+}
+
+/**
+ * copies a mesh into the store through the uploader, it can be drawn once the next frame has begun.
+ * vertices are interleaved, vertex_size bytes each, and split on the way in when the layout asks for it.
+ * returns false if the store has no run large enough left, safe to call from jobs.
+ */
+bool
+vk_add_mesh
+(
+    VK_CONTEXT *context,
+    VK_MESH_STORE *store,
+    const void *vertices,
+    uint32_t vertex_count,
+    const uint32_t *indices,
+    uint32_t index_count,
+    VK_MESH *mesh
+)
+{
+    *mesh = (VK_MESH) {
+        .vertex_count = vertex_count,
+        .index_count  = index_count
+    };
+
+    if (vertex_count == 0 || index_count == 0) {
+        VK_LOG(LOG_WARNING, "Empty mesh, nothing added to the mesh store");
+        return false;
+    }
+
+    pthread_mutex_lock(&store->lock);
+
+    if (!vk_mesh_range_allocate(store->free_vertices, &store->free_vertices_count, vertex_count, &mesh->first_vertex)) {
+        pthread_mutex_unlock(&store->lock);
+        VK_LOGF(LOG_WARNING, "vk", "Mesh store has no room for %u vertices", vertex_count);
+        return false;
+    }
+
+    if (!vk_mesh_range_allocate(store->free_indices, &store->free_indices_count, index_count, &mesh->first_index)) {
+        vk_mesh_range_free(&store->free_vertices, &store->free_vertices_count, &store->free_vertices_capacity, mesh->first_vertex, vertex_count);
+        pthread_mutex_unlock(&store->lock);
+        VK_LOGF(LOG_WARNING, "vk", "Mesh store has no room for %u indices", index_count);
+        return false;
+    }
+
+    store->vertices_used += vertex_count;
+    store->indices_used  += index_count;
+    store->meshes_count++;
+
+    pthread_mutex_unlock(&store->lock);
+
+    uint32_t attribute_size = vk_mesh_attribute_size(store);
+
+    if (store->layout == VK_MESH_SPLIT_POSITIONS) {
+        uint8_t *positions  = malloc((size_t) store->position_size * vertex_count);
+        uint8_t *attributes = (attribute_size) ? malloc((size_t) attribute_size * vertex_count) : NULL;
+
+        for (uint32_t i = 0; i < vertex_count; i++) {
+            const uint8_t *vertex = (const uint8_t *) vertices + (size_t) i * store->vertex_size;
+
+            memcpy(positions + (size_t) i * store->position_size, vertex, store->position_size);
+            if (attribute_size)
+                memcpy(attributes + (size_t) i * attribute_size, vertex + store->position_size, attribute_size);
+        }
+
+        vk_upload_buffer(context, store->vertices.buffer, (VkDeviceSize) mesh->first_vertex * store->position_size,
+                         positions, (VkDeviceSize) vertex_count * store->position_size);
+        if (attribute_size)
+            vk_upload_buffer(context, store->attributes.buffer, (VkDeviceSize) mesh->first_vertex * attribute_size,
+                             attributes, (VkDeviceSize) vertex_count * attribute_size);
+
+        free(attributes);
+        free(positions);
+    } else {
+        vk_upload_buffer(context, store->vertices.buffer, (VkDeviceSize) mesh->first_vertex * store->vertex_size,
+                         vertices, (VkDeviceSize) vertex_count * store->vertex_size);
+    }
+
+    vk_upload_buffer(context, store->indices.buffer, sizeof(uint32_t) * (VkDeviceSize) mesh->first_index,
+                     indices, sizeof(uint32_t) * (VkDeviceSize) index_count);
+    return true;
+}
+
+/** gives the mesh's runs back to the store, no frame in flight may still be drawing it */
+void
+vk_remove_mesh
+(
+    VK_CONTEXT *context,
+    VK_MESH_STORE *store,
+    const VK_MESH *mesh
+)
+{
+    (void) context;
+
+    pthread_mutex_lock(&store->lock);
+    vk_mesh_range_free(&store->free_vertices, &store->free_vertices_count, &store->free_vertices_capacity, mesh->first_vertex, mesh->vertex_count);
+    vk_mesh_range_free(&store->free_indices, &store->free_indices_count, &store->free_indices_capacity, mesh->first_index, mesh->index_count);
+
+    store->vertices_used -= mesh->vertex_count;
+    store->indices_used  -= mesh->index_count;
+    store->meshes_count--;
+    pthread_mutex_unlock(&store->lock);
+}
+
+/**
+ * vertex input for a pipeline drawing from the store. attributes describe the interleaved vertex,
+ * their offsets are moved to the buffer each ends up in. with positions_only only attributes within
+ * the position are kept. returns the bindings count, bindings needs room for 2 and store_attributes
+ * for attributes_count.
+ */
+uint32_t
+vk_get_mesh_store_input
+(
+    const VK_MESH_STORE *store,
+    const VkVertexInputAttributeDescription *attributes,
+    uint32_t attributes_count,
+    bool positions_only,
+    VkVertexInputBindingDescription *bindings,
+    VkVertexInputAttributeDescription *store_attributes,
+    uint32_t *store_attributes_count
+)
+{
+    uint32_t attribute_size = vk_mesh_attribute_size(store);
+    bool     split          = store->layout == VK_MESH_SPLIT_POSITIONS;
+    uint32_t bindings_count = 1;
+
+    bindings[0] = (VkVertexInputBindingDescription) {
+        .binding   = 0,
+        .stride    = (split) ? store->position_size : store->vertex_size,
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+    };
+
+    if (split && attribute_size > 0 && !positions_only) {
+        bindings[bindings_count++] = (VkVertexInputBindingDescription) {
+            .binding   = 1,
+            .stride    = attribute_size,
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        };
+    }
+
+    *store_attributes_count = 0;
+    for (uint32_t i = 0; i < attributes_count; i++) {
+        VkVertexInputAttributeDescription attribute = attributes[i];
+        bool position = attribute.offset < store->position_size;
+
+        if (positions_only && !position)
+            continue;
+
+        attribute.binding = 0;
+        if (split && !position) {
+            attribute.binding = 1;
+            attribute.offset -= store->position_size;
+        }
+        store_attributes[(*store_attributes_count)++] = attribute;
+    }
+    return bindings_count;
+}
+
+/** binds the store's vertex and index buffers, one bind for every mesh drawn after it */
+void
+vk_bind_mesh_store
+(
+    VK_CONTEXT *context,
+    VK_MESH_STORE *store,
+    VkCommandBuffer command_buffer,
+    bool positions_only
+)
+{
+    (void) context;
+
+    VkBuffer     buffers[2] = { store->vertices.buffer, store->attributes.buffer };
+    VkDeviceSize offsets[2] = { 0, 0 };
+    uint32_t     count      = (store->attributes.buffer != VK_NULL_HANDLE && !positions_only) ? 2 : 1;
+
+    vkCmdBindVertexBuffers(command_buffer, 0, count, buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, store->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void
+vk_draw_mesh
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer,
+    const VK_MESH *mesh,
+    uint32_t instance_count,
+    uint32_t first_instance
+)
+{
+    (void) context;
+
+    vkCmdDrawIndexed(command_buffer, mesh->index_count, instance_count, mesh->first_index, (int32_t) mesh->first_vertex, first_instance);
+}
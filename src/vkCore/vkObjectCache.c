@@ -0,0 +1,575 @@
+#include "vkInit.h"
+
+/** pipeline table batches create layouts and render passes concurrently on the job system */
+static pthread_mutex_t vk_object_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** a description flattened into bytes, pointers are followed so equal contents give equal keys */
+typedef struct VK_OBJECT_KEY {
+    size_t   size;
+    size_t   capacity;
+    uint8_t *data;
+} VK_OBJECT_KEY;
+
+static void
+vk_key_append
+(
+    VK_OBJECT_KEY *key,
+    const void *data,
+    size_t size
+)
+{
+    if (size == 0)
+        return;
+
+    if (key->size + size > key->capacity) {
+        key->capacity = (key->capacity) ? key->capacity * 2 : 256;
+        if (key->capacity < key->size + size)
+            key->capacity = key->size + size;
+        key->data = realloc(key->data, key->capacity);
+    }
+    memcpy(key->data + key->size, data, size);
+    key->size += size;
+}
+
+static void
+vk_key_append_u32
+(
+    VK_OBJECT_KEY *key,
+    uint32_t value
+)
+{
+    vk_key_append(key, &value, sizeof(value));
+}
+
+static void
+vk_key_descriptor_set_layout
+(
+    VK_OBJECT_KEY *key,
+    const VkDescriptorSetLayoutCreateInfo *create_info
+)
+{
+    vk_key_append_u32(key, create_info->flags);
+    vk_key_append_u32(key, create_info->bindingCount);
+
+    for (uint32_t i = 0; i < create_info->bindingCount; i++) {
+        const VkDescriptorSetLayoutBinding *binding = &create_info->pBindings[i];
+
+        vk_key_append_u32(key, binding->binding);
+        vk_key_append_u32(key, binding->descriptorType);
+        vk_key_append_u32(key, binding->descriptorCount);
+        vk_key_append_u32(key, binding->stageFlags);
+        vk_key_append_u32(key, binding->pImmutableSamplers != NULL);
+        if (binding->pImmutableSamplers != NULL)
+            vk_key_append(key, binding->pImmutableSamplers, sizeof(VkSampler) * binding->descriptorCount);
+    }
+}
+
+/** set layouts come from the cache too, so equal handles mean equal layouts */
+static void
+vk_key_pipeline_layout
+(
+    VK_OBJECT_KEY *key,
+    const VkPipelineLayoutCreateInfo *create_info
+)
+{
+    vk_key_append_u32(key, create_info->flags);
+    vk_key_append_u32(key, create_info->setLayoutCount);
+    vk_key_append(key, create_info->pSetLayouts, sizeof(VkDescriptorSetLayout) * create_info->setLayoutCount);
+    vk_key_append_u32(key, create_info->pushConstantRangeCount);
+    vk_key_append(key, create_info->pPushConstantRanges, sizeof(VkPushConstantRange) * create_info->pushConstantRangeCount);
+}
+
+static void
+vk_key_attachment_references
+(
+    VK_OBJECT_KEY *key,
+    const VkAttachmentReference *references,
+    uint32_t count
+)
+{
+    vk_key_append_u32(key, references != NULL);
+    if (references != NULL)
+        vk_key_append(key, references, sizeof(VkAttachmentReference) * count);
+}
+
+static void
+vk_key_render_pass
+(
+    VK_OBJECT_KEY *key,
+    const VkRenderPassCreateInfo *create_info
+)
+{
+    vk_key_append_u32(key, create_info->flags);
+    vk_key_append_u32(key, create_info->attachmentCount);
+    vk_key_append(key, create_info->pAttachments, sizeof(VkAttachmentDescription) * create_info->attachmentCount);
+
+    vk_key_append_u32(key, create_info->subpassCount);
+    for (uint32_t i = 0; i < create_info->subpassCount; i++) {
+        const VkSubpassDescription *subpass = &create_info->pSubpasses[i];
+
+        vk_key_append_u32(key, subpass->flags);
+        vk_key_append_u32(key, subpass->pipelineBindPoint);
+        vk_key_append_u32(key, subpass->inputAttachmentCount);
+        vk_key_attachment_references(key, subpass->pInputAttachments, subpass->inputAttachmentCount);
+        vk_key_append_u32(key, subpass->colorAttachmentCount);
+        vk_key_attachment_references(key, subpass->pColorAttachments, subpass->colorAttachmentCount);
+        vk_key_attachment_references(key, subpass->pResolveAttachments, subpass->colorAttachmentCount);
+        vk_key_attachment_references(key, subpass->pDepthStencilAttachment, 1);
+        vk_key_append_u32(key, subpass->preserveAttachmentCount);
+        vk_key_append(key, subpass->pPreserveAttachments, sizeof(uint32_t) * subpass->preserveAttachmentCount);
+    }
+
+    vk_key_append_u32(key, create_info->dependencyCount);
+    vk_key_append(key, create_info->pDependencies, sizeof(VkSubpassDependency) * create_info->dependencyCount);
+}
+
+#define VK_OBJECT_CACHE_MIN_BUCKETS 64
+
+/** non-dispatchable handles share one representation, so the handle union is hashed and compared as bytes */
+#define VK_OBJECT_HANDLE_SIZE sizeof(VkRenderPass)
+
+static uint64_t
+vk_object_cache_handle_hash
+(
+    uint32_t type,
+    const void *handle
+)
+{
+    return vk_fnv1a(handle, VK_OBJECT_HANDLE_SIZE) + type;
+}
+
+static void
+vk_object_cache_link
+(
+    VK_OBJECT_CACHE *cache,
+    VK_OBJECT_CACHE_ENTRY *entry
+)
+{
+    uint32_t mask = cache->buckets_count - 1;
+    VK_OBJECT_CACHE_ENTRY **key_bucket    = &cache->key_buckets[entry->hash & mask];
+    VK_OBJECT_CACHE_ENTRY **handle_bucket = &cache->handle_buckets[entry->handle_hash & mask];
+
+    entry->next_by_key    = *key_bucket;
+    *key_bucket           = entry;
+    entry->next_by_handle = *handle_bucket;
+    *handle_bucket        = entry;
+}
+
+/** must be called with the lock held, the entry stays allocated */
+static void
+vk_object_cache_unlink
+(
+    VK_OBJECT_CACHE *cache,
+    VK_OBJECT_CACHE_ENTRY *entry
+)
+{
+    uint32_t mask = cache->buckets_count - 1;
+    VK_OBJECT_CACHE_ENTRY **link;
+
+    for (link = &cache->key_buckets[entry->hash & mask]; *link != entry; link = &(*link)->next_by_key);
+    *link = entry->next_by_key;
+
+    for (link = &cache->handle_buckets[entry->handle_hash & mask]; *link != entry; link = &(*link)->next_by_handle);
+    *link = entry->next_by_handle;
+
+    cache->entries_count--;
+}
+
+/** doubles both tables once entries outnumber buckets, so chains stay short */
+static void
+vk_object_cache_grow
+(
+    VK_OBJECT_CACHE *cache
+)
+{
+    uint32_t                old_count       = cache->buckets_count;
+    VK_OBJECT_CACHE_ENTRY **old_key_buckets = cache->key_buckets;
+
+    free(cache->handle_buckets);
+    cache->buckets_count  = (old_count) ? old_count * 2 : VK_OBJECT_CACHE_MIN_BUCKETS;
+    cache->key_buckets    = calloc(cache->buckets_count, sizeof(VK_OBJECT_CACHE_ENTRY *));
+    cache->handle_buckets = calloc(cache->buckets_count, sizeof(VK_OBJECT_CACHE_ENTRY *));
+
+    for (uint32_t i = 0; i < old_count; i++) {
+        for (VK_OBJECT_CACHE_ENTRY *entry = old_key_buckets[i], *next; entry != NULL; entry = next) {
+            next = entry->next_by_key;
+            vk_object_cache_link(cache, entry);
+        }
+    }
+    free(old_key_buckets);
+}
+
+/** must be called with the lock held */
+static VK_OBJECT_CACHE_ENTRY *
+vk_object_cache_find
+(
+    VK_OBJECT_CACHE *cache,
+    uint32_t type,
+    uint64_t hash,
+    const VK_OBJECT_KEY *key
+)
+{
+    if (cache->buckets_count == 0)
+        return NULL;
+
+    VK_OBJECT_CACHE_ENTRY *entry = cache->key_buckets[hash & (cache->buckets_count - 1)];
+    for (; entry != NULL; entry = entry->next_by_key) {
+        if (entry->type != type || entry->hash != hash || entry->unique || entry->key_size != key->size)
+            continue;
+        if (!memcmp(entry->key, key->data, key->size))
+            return entry;
+    }
+    return NULL;
+}
+
+/** must be called with the lock held, handle points at a handle of the entry's type */
+static VK_OBJECT_CACHE_ENTRY *
+vk_object_cache_find_handle
+(
+    VK_OBJECT_CACHE *cache,
+    uint32_t type,
+    const void *handle
+)
+{
+    if (cache->buckets_count == 0)
+        return NULL;
+
+    uint64_t handle_hash = vk_object_cache_handle_hash(type, handle);
+
+    VK_OBJECT_CACHE_ENTRY *entry = cache->handle_buckets[handle_hash & (cache->buckets_count - 1)];
+    for (; entry != NULL; entry = entry->next_by_handle) {
+        if (entry->type == type && !memcmp(&entry->descriptor_set_layout, handle, VK_OBJECT_HANDLE_SIZE))
+            return entry;
+    }
+    return NULL;
+}
+
+/** must be called with the lock held, takes ownership of the key */
+static VK_OBJECT_CACHE_ENTRY *
+vk_object_cache_insert
+(
+    VK_OBJECT_CACHE *cache,
+    uint32_t type,
+    uint64_t hash,
+    VK_OBJECT_KEY *key,
+    bool unique,
+    const void *handle
+)
+{
+    if (cache->entries_count >= cache->buckets_count)
+        vk_object_cache_grow(cache);
+
+    VK_OBJECT_CACHE_ENTRY *entry = malloc(sizeof(VK_OBJECT_CACHE_ENTRY));
+    *entry = (VK_OBJECT_CACHE_ENTRY) {
+        .type        = type,
+        .hash        = hash,
+        .handle_hash = vk_object_cache_handle_hash(type, handle),
+        .key_size    = key->size,
+        .key         = key->data,
+        .unique      = unique,
+        .references  = 1
+    };
+    memcpy(&entry->descriptor_set_layout, handle, VK_OBJECT_HANDLE_SIZE);
+    *key = (VK_OBJECT_KEY) {};
+
+    vk_object_cache_link(cache, entry);
+    cache->entries_count++;
+    return entry;
+}
+
+static void
+vk_object_cache_destroy_entry
+(
+    VK_CONTEXT *context,
+    VK_OBJECT_CACHE_ENTRY *entry
+)
+{
+    switch (entry->type) {
+        case VK_CACHED_DESCRIPTOR_SET_LAYOUT:
+            vkDestroyDescriptorSetLayout(context->logical_device, entry->descriptor_set_layout, NULL);
+            break;
+        case VK_CACHED_PIPELINE_LAYOUT:
+            vkDestroyPipelineLayout(context->logical_device, entry->pipeline_layout, NULL);
+            break;
+        case VK_CACHED_RENDER_PASS:
+            vkDestroyRenderPass(context->logical_device, entry->render_pass, NULL);
+            break;
+    }
+    free(entry->key);
+    free(entry);
+}
+
+/** drops a reference, the object stays cached for the next equal description until the cache is trimmed */
+static void
+vk_object_cache_release
+(
+    VK_CONTEXT *context,
+    uint32_t type,
+    const void *handle
+)
+{
+    pthread_mutex_lock(&vk_object_cache_lock);
+
+    VK_OBJECT_CACHE_ENTRY *entry = vk_object_cache_find_handle(&context->object_cache, type, handle);
+    if (entry != NULL) {
+        if (entry->references == 0)
+            VK_LOG(LOG_WARNING, "Cached object released more often than it was acquired");
+        else
+            entry->references--;
+    }
+    pthread_mutex_unlock(&vk_object_cache_lock);
+}
+
+/**
+ * returns the set layout for the bindings, created on first use and shared by every equal binding list.
+ * the descriptor allocators size their pools from the descriptor counts recorded here.
+ * every call must be paired with vk_release_descriptor_set_layout.
+ */
+VkDescriptorSetLayout
+vk_get_descriptor_set_layout
+(
+    VK_CONTEXT *context,
+    const VkDescriptorSetLayoutBinding *bindings,
+    uint32_t bindings_count
+)
+{
+    VK_OBJECT_CACHE *cache = &context->object_cache;
+    VK_OBJECT_KEY key = {};
+
+    VkDescriptorSetLayoutCreateInfo create_info = {};
+    create_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    create_info.bindingCount = bindings_count;
+    create_info.pBindings    = bindings;
+
+    vk_key_descriptor_set_layout(&key, &create_info);
+    uint64_t hash = vk_fnv1a(key.data, key.size);
+
+    /** creation stays under the lock so two threads never create the same object */
+    pthread_mutex_lock(&vk_object_cache_lock);
+
+    VK_OBJECT_CACHE_ENTRY *entry = vk_object_cache_find(cache, VK_CACHED_DESCRIPTOR_SET_LAYOUT, hash, &key);
+    if (entry != NULL) {
+        entry->references++;
+        cache->hits++;
+
+        VkDescriptorSetLayout layout = entry->descriptor_set_layout;
+        pthread_mutex_unlock(&vk_object_cache_lock);
+        free(key.data);
+        return layout;
+    }
+
+    VkDescriptorSetLayout layout;
+    VK_CHECK(vkCreateDescriptorSetLayout(context->logical_device, &create_info, NULL, &layout));
+
+    entry = vk_object_cache_insert(cache, VK_CACHED_DESCRIPTOR_SET_LAYOUT, hash, &key, false, &layout);
+    cache->misses++;
+
+    for (uint32_t i = 0; i < bindings_count; i++) {
+        if ((uint32_t) bindings[i].descriptorType >= VK_DESCRIPTOR_TYPES) {
+            VK_LOG(LOG_WARNING, "Descriptor type is not pooled by the descriptor allocator");
+            continue;
+        }
+        entry->descriptor_counts[bindings[i].descriptorType] += bindings[i].descriptorCount;
+    }
+
+    pthread_mutex_unlock(&vk_object_cache_lock);
+    return layout;
+}
+
+void
+vk_release_descriptor_set_layout
+(
+    VK_CONTEXT *context,
+    VkDescriptorSetLayout layout
+)
+{
+    vk_object_cache_release(context, VK_CACHED_DESCRIPTOR_SET_LAYOUT, &layout);
+}
+
+/** copies the descriptors of each type a set of layout uses, false if the layout did not come from the cache */
+bool
+vk_get_descriptor_set_layout_counts
+(
+    VK_CONTEXT *context,
+    VkDescriptorSetLayout layout,
+    uint32_t *counts
+)
+{
+    pthread_mutex_lock(&vk_object_cache_lock);
+
+    VK_OBJECT_CACHE_ENTRY *entry = vk_object_cache_find_handle(&context->object_cache, VK_CACHED_DESCRIPTOR_SET_LAYOUT, &layout);
+    if (entry != NULL)
+        memcpy(counts, entry->descriptor_counts, sizeof(entry->descriptor_counts));
+    else
+        memset(counts, 0, sizeof(uint32_t) * VK_DESCRIPTOR_TYPES);
+
+    pthread_mutex_unlock(&vk_object_cache_lock);
+    return entry != NULL;
+}
+
+/**
+ * returns the pipeline layout for the create info, shared by every equal description.
+ * create infos with a pNext chain are not compared and always get their own layout.
+ * every call must be paired with vk_release_pipeline_layout.
+ */
+VkPipelineLayout
+vk_get_pipeline_layout
+(
+    VK_CONTEXT *context,
+    const VkPipelineLayoutCreateInfo *create_info
+)
+{
+    VK_OBJECT_CACHE *cache = &context->object_cache;
+    VK_OBJECT_KEY key = {};
+    bool unique = create_info->pNext != NULL;
+
+    vk_key_pipeline_layout(&key, create_info);
+    uint64_t hash = vk_fnv1a(key.data, key.size);
+
+    pthread_mutex_lock(&vk_object_cache_lock);
+
+    VK_OBJECT_CACHE_ENTRY *entry = (unique) ? NULL : vk_object_cache_find(cache, VK_CACHED_PIPELINE_LAYOUT, hash, &key);
+    if (entry != NULL) {
+        entry->references++;
+        cache->hits++;
+
+        VkPipelineLayout layout = entry->pipeline_layout;
+        pthread_mutex_unlock(&vk_object_cache_lock);
+        free(key.data);
+        return layout;
+    }
+
+    VkPipelineLayout layout;
+    VK_CHECK(vkCreatePipelineLayout(context->logical_device, create_info, NULL, &layout));
+
+    vk_object_cache_insert(cache, VK_CACHED_PIPELINE_LAYOUT, hash, &key, unique, &layout);
+    cache->misses++;
+
+    pthread_mutex_unlock(&vk_object_cache_lock);
+    return layout;
+}
+
+void
+vk_release_pipeline_layout
+(
+    VK_CONTEXT *context,
+    VkPipelineLayout layout
+)
+{
+    vk_object_cache_release(context, VK_CACHED_PIPELINE_LAYOUT, &layout);
+}
+
+/**
+ * returns the render pass for the create info, built from its attachments, subpasses and dependencies.
+ * equal descriptions share one handle, so pipelines and framebuffers made with them are compatible.
+ * every call must be paired with vk_release_render_pass.
+ */
+VkRenderPass
+vk_get_render_pass
+(
+    VK_CONTEXT *context,
+    const VkRenderPassCreateInfo *create_info
+)
+{
+    VK_OBJECT_CACHE *cache = &context->object_cache;
+    VK_OBJECT_KEY key = {};
+    bool unique = create_info->pNext != NULL;
+
+    vk_key_render_pass(&key, create_info);
+    uint64_t hash = vk_fnv1a(key.data, key.size);
+
+    pthread_mutex_lock(&vk_object_cache_lock);
+
+    VK_OBJECT_CACHE_ENTRY *entry = (unique) ? NULL : vk_object_cache_find(cache, VK_CACHED_RENDER_PASS, hash, &key);
+    if (entry != NULL) {
+        entry->references++;
+        cache->hits++;
+
+        VkRenderPass render_pass = entry->render_pass;
+        pthread_mutex_unlock(&vk_object_cache_lock);
+        free(key.data);
+        return render_pass;
+    }
+
+    VkRenderPass render_pass;
+    VK_CHECK(vkCreateRenderPass(context->logical_device, create_info, NULL, &render_pass));
+
+    vk_object_cache_insert(cache, VK_CACHED_RENDER_PASS, hash, &key, unique, &render_pass);
+    cache->misses++;
+
+    pthread_mutex_unlock(&vk_object_cache_lock);
+    return render_pass;
+}
+
+void
+vk_release_render_pass
+(
+    VK_CONTEXT *context,
+    VkRenderPass render_pass
+)
+{
+    vk_object_cache_release(context, VK_CACHED_RENDER_PASS, &render_pass);
+}
+
+/**
+ * destroys the cached objects nothing holds a reference to.
+ * pipeline layouts go before the set layouts they are made from.
+ */
+void
+vk_trim_object_cache
+(
+    VK_CONTEXT *context
+)
+{
+    VK_OBJECT_CACHE *cache = &context->object_cache;
+
+    pthread_mutex_lock(&vk_object_cache_lock);
+    for (uint32_t type = VK_CACHED_RENDER_PASS + 1; type-- > 0;) {
+        for (uint32_t i = 0; i < cache->buckets_count; i++) {
+            for (VK_OBJECT_CACHE_ENTRY *entry = cache->key_buckets[i], *next; entry != NULL; entry = next) {
+                next = entry->next_by_key;
+
+                if (entry->type != type || entry->references)
+                    continue;
+
+                vk_object_cache_unlink(cache, entry);
+                vk_object_cache_destroy_entry(context, entry);
+            }
+        }
+    }
+    pthread_mutex_unlock(&vk_object_cache_lock);
+}
+
+/** destroys every cached object, called before the logical device is destroyed */
+void
+vk_destroy_object_cache
+(
+    VK_CONTEXT *context
+)
+{
+    VK_OBJECT_CACHE *cache = &context->object_cache;
+
+    pthread_mutex_lock(&vk_object_cache_lock);
+    for (uint32_t type = VK_CACHED_RENDER_PASS + 1; type-- > 0;) {
+        for (uint32_t i = 0; i < cache->buckets_count; i++) {
+            for (VK_OBJECT_CACHE_ENTRY *entry = cache->key_buckets[i], *next; entry != NULL; entry = next) {
+                next = entry->next_by_key;
+
+                if (entry->type != type)
+                    continue;
+                if (entry->references)
+                    VK_LOG(LOG_WARNING, "Cached object still referenced on cache destruction");
+
+                vk_object_cache_unlink(cache, entry);
+                vk_object_cache_destroy_entry(context, entry);
+            }
+        }
+    }
+
+    VK_LOGF(LOG_INFO, "vk", "Object cache: %u hits, %u misses", cache->hits, cache->misses);
+
+    free(cache->key_buckets);
+    free(cache->handle_buckets);
+    *cache = (VK_OBJECT_CACHE) {};
+    pthread_mutex_unlock(&vk_object_cache_lock);
+}
@@ -0,0 +1,188 @@
+#include "vkInit.h"
+
+#define VK_PIPELINE_CACHE_MAGIC   0x43504B56 // "VKPC"
+#define VK_PIPELINE_CACHE_VERSION 1
+
+/** header written in front of the driver blob, a mismatch on any field discards the file */
+typedef struct VK_PIPELINE_CACHE_FILE_HEADER {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t  uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+    uint64_t checksum;
+} VK_PIPELINE_CACHE_FILE_HEADER;
+
+/** returns the validated driver blob of the cache file or NULL if it is missing or stale */
+static uint8_t *
+vk_pipeline_cache_read
+(
+    const char *filename,
+    const VkPhysicalDeviceProperties *properties,
+    size_t *size
+)
+{
+    VK_PIPELINE_CACHE_FILE_HEADER header;
+    uint8_t *data;
+
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        VK_LOG(LOG_INFO, "Pipeline cache file not found, starting cold");
+        return NULL;
+    }
+
+    if (fread(&header, sizeof(header), 1, f) != 1) {
+        VK_LOG(LOG_WARNING, "Pipeline cache file truncated, discarding");
+        fclose(f);
+        return NULL;
+    }
+
+    if (header.magic          != VK_PIPELINE_CACHE_MAGIC      ||
+        header.version        != VK_PIPELINE_CACHE_VERSION    ||
+        header.vendor_id      != properties->vendorID         ||
+        header.device_id      != properties->deviceID         ||
+        header.driver_version != properties->driverVersion    ||
+        memcmp(header.uuid, properties->pipelineCacheUUID, VK_UUID_SIZE))
+    {
+        VK_LOG(LOG_WARNING, "Pipeline cache file is stale (device or driver changed), discarding");
+        fclose(f);
+        return NULL;
+    }
+
+    data = malloc(header.data_size);
+    if (header.data_size == 0 || data == NULL || fread(data, 1, header.data_size, f) != header.data_size) {
+        VK_LOG(LOG_WARNING, "Pipeline cache file truncated, discarding");
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+
+    if (vk_fnv1a(data, header.data_size) != header.checksum) {
+        VK_LOG(LOG_WARNING, "Pipeline cache file corrupted, discarding");
+        free(data);
+        return NULL;
+    }
+
+    *size = header.data_size;
+    return data;
+}
+
+void
+vk_create_pipeline_cache
+(
+    VK_CONTEXT *context,
+    const char *filename
+)
+{
+    char msg[128];
+    size_t size = 0;
+    uint8_t *data = NULL;
+    uint64_t start = vk_get_time_ns();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+
+    context->pipeline_cache_details = (VK_PIPELINE_CACHE_DETAILS) {
+        .filename = filename
+    };
+
+    if (filename != NULL)
+        data = vk_pipeline_cache_read(filename, &properties, &size);
+
+    VkPipelineCacheCreateInfo create_info = {};
+    create_info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = size;
+    create_info.pInitialData    = data;
+
+    VK_CHECK(vkCreatePipelineCache(context->logical_device, &create_info, NULL, &context->pipeline_cache));
+
+    context->pipeline_cache_details.warm      = data != NULL;
+    context->pipeline_cache_details.load_time = vk_get_time_ns() - start;
+    vk_record_init_stage(context, "load pipeline cache", start);
+    free(data);
+
+    snprintf(msg, sizeof(msg), "Created Pipeline Cache (%s, %zu bytes, %.3f ms)",
+             context->pipeline_cache_details.warm ? "warm" : "cold", size,
+             context->pipeline_cache_details.load_time / 1e6);
+    VK_LOG(LOG_INFO, msg);
+}
+
+/** writes the driver blob behind a validation header to the cache file */
+static void
+vk_pipeline_cache_write
+(
+    VK_CONTEXT *context,
+    const char *filename
+)
+{
+    size_t size = 0;
+    uint8_t *data;
+
+    VK_CHECK(vkGetPipelineCacheData(context->logical_device, context->pipeline_cache, &size, NULL));
+    data = malloc(size);
+    VK_CHECK(vkGetPipelineCacheData(context->logical_device, context->pipeline_cache, &size, data));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+
+    VK_PIPELINE_CACHE_FILE_HEADER header = {
+        .magic          = VK_PIPELINE_CACHE_MAGIC,
+        .version        = VK_PIPELINE_CACHE_VERSION,
+        .vendor_id      = properties.vendorID,
+        .device_id      = properties.deviceID,
+        .driver_version = properties.driverVersion,
+        .data_size      = size,
+        .checksum       = vk_fnv1a(data, size)
+    };
+    memcpy(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    /** write to a temporary file and rename so a crash never leaves a half written cache */
+    char tmpname[strlen(filename) + 5];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+
+    FILE *f = fopen(tmpname, "wb");
+    if (f == NULL) {
+        VK_LOG(LOG_WARNING, "Could not open pipeline cache file for writing");
+        free(data);
+        return;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                   fwrite(data, 1, size, f) == size;
+    written = (fclose(f) == 0) && written;
+    free(data);
+
+    if (!written || rename(tmpname, filename) != 0) {
+        VK_LOG(LOG_WARNING, "Could not write pipeline cache file");
+        remove(tmpname);
+        return;
+    }
+    VK_LOG(LOG_INFO, "Saved Pipeline Cache");
+}
+
+void
+vk_destroy_pipeline_cache
+(
+    VK_CONTEXT *context
+)
+{
+    char msg[128];
+    VK_PIPELINE_CACHE_DETAILS *details = &context->pipeline_cache_details;
+
+    if (context->pipeline_cache == VK_NULL_HANDLE)
+        return;
+
+    snprintf(msg, sizeof(msg), "Pipeline cache %s start: load %.3f ms, %u pipelines in %.3f ms",
+             details->warm ? "warm" : "cold", details->load_time / 1e6,
+             details->pipeline_count, details->pipeline_time / 1e6);
+    VK_LOG(LOG_INFO, msg);
+
+    if (details->filename != NULL)
+        vk_pipeline_cache_write(context, details->filename);
+
+    vkDestroyPipelineCache(context->logical_device, context->pipeline_cache, NULL);
+    context->pipeline_cache = VK_NULL_HANDLE;
+}
@@ -0,0 +1,147 @@
+#include "vkInit.h"
+
+/** work shared by the batches of one pipeline table */
+typedef struct VK_PIPELINE_TABLE_JOB {
+    pthread_mutex_t                  lock;
+    VK_CONTEXT                      *context;
+    const VK_PIPELINE_SPECIFICATION *pipeline_specifications;
+    VK_PIPELINE_TABLE               *table;
+    uint32_t                         batches_count;
+    uint64_t                         pipeline_time; // summed over all vkCreateGraphicsPipelines calls
+} VK_PIPELINE_TABLE_JOB;
+
+static void
+vk_pipeline_table_batch
+(
+    VK_PIPELINE_TABLE_JOB *job,
+    uint32_t batch
+)
+{
+    VK_CONTEXT *context = job->context;
+
+    uint32_t first = batch * VK_PIPELINE_BATCH_SIZE;
+    uint32_t count = job->table->pipelines_count - first;
+    if (count > VK_PIPELINE_BATCH_SIZE)
+        count = VK_PIPELINE_BATCH_SIZE;
+
+    VK_PIPELINE_STATE           *states = malloc(sizeof(VK_PIPELINE_STATE) * count);
+    VkGraphicsPipelineCreateInfo create_infos[count];
+
+    for (uint32_t i = 0; i < count; i++) {
+        const VK_PIPELINE_SPECIFICATION *specification = &job->pipeline_specifications[first + i];
+
+        vk_create_pipeline_state(context, specification, specification->shader_files, specification->shader_files_count, &states[i]);
+        create_infos[i] = states[i].create_info;
+
+        job->table->layouts[first + i]       = states[i].layout;
+        job->table->render_passes[first + i] = states[i].render_pass;
+    }
+
+    /** vkCreateGraphicsPipelines synchronises access to the shared cache internally */
+    uint64_t start = vk_get_time_ns();
+    VK_CHECK(vkCreateGraphicsPipelines(context->logical_device, context->pipeline_cache, count, create_infos, NULL, &job->table->pipelines[first]));
+    uint64_t elapsed = vk_get_time_ns() - start;
+
+    for (uint32_t i = 0; i < count; i++)
+        vk_destroy_pipeline_state(context, &states[i]);
+    free(states);
+
+    pthread_mutex_lock(&job->lock);
+    job->pipeline_time += elapsed;
+    pthread_mutex_unlock(&job->lock);
+}
+
+/** one batch handed to the job system */
+typedef struct VK_PIPELINE_TABLE_BATCH {
+    VK_PIPELINE_TABLE_JOB *job;
+    uint32_t               batch;
+} VK_PIPELINE_TABLE_BATCH;
+
+static void
+vk_pipeline_table_job
+(
+    void *data
+)
+{
+    VK_PIPELINE_TABLE_BATCH *batch = data;
+    vk_pipeline_table_batch(batch->job, batch->batch);
+}
+
+/**
+ * creates one pipeline per specification, shaders come from the specification's shader_files.
+ * layouts and render passes come from the object cache, so equal specifications share them.
+ * specifications are split into batches of VK_PIPELINE_BATCH_SIZE, each batch is a job on the
+ * job system, or runs on the calling thread without one. all batches share the context pipeline cache.
+ */
+void
+vk_create_pipeline_table
+(
+    VK_CONTEXT *context,
+    const VK_PIPELINE_SPECIFICATION *pipeline_specifications,
+    uint32_t count,
+    VK_PIPELINE_TABLE *table
+)
+{
+    char msg[128];
+
+    *table = (VK_PIPELINE_TABLE) {
+        .pipelines_count = count,
+        .pipelines       = calloc(count, sizeof(VkPipeline)),
+        .layouts         = calloc(count, sizeof(VkPipelineLayout)),
+        .render_passes   = calloc(count, sizeof(VkRenderPass))
+    };
+
+    if (count == 0)
+        return;
+
+    VK_PIPELINE_TABLE_JOB job = {
+        .context                 = context,
+        .pipeline_specifications = pipeline_specifications,
+        .table                   = table,
+        .batches_count           = (count + VK_PIPELINE_BATCH_SIZE - 1) / VK_PIPELINE_BATCH_SIZE
+    };
+    pthread_mutex_init(&job.lock, NULL);
+
+    uint64_t start = vk_get_time_ns();
+
+    VK_PIPELINE_TABLE_BATCH batches[job.batches_count];
+    VK_JOB_COUNTER counter = {};
+
+    for (uint32_t i = 0; i < job.batches_count; i++) {
+        batches[i] = (VK_PIPELINE_TABLE_BATCH) {
+            .job   = &job,
+            .batch = i
+        };
+        vk_submit_job(context, vk_pipeline_table_job, &batches[i], &counter);
+    }
+    vk_wait_job_counter(context, &counter);
+
+    uint64_t elapsed = vk_get_time_ns() - start;
+    vk_record_init_stage(context, "create pipeline table", start);
+    pthread_mutex_destroy(&job.lock);
+
+    context->pipeline_cache_details.pipeline_time  += job.pipeline_time;
+    context->pipeline_cache_details.pipeline_count += count;
+
+    snprintf(msg, sizeof(msg), "Created Pipeline Table (%u pipelines, %u batches, %.3f ms)", count, job.batches_count, elapsed / 1e6);
+    VK_LOG(LOG_INFO, msg);
+}
+
+void
+vk_destroy_pipeline_table
+(
+    VK_CONTEXT *context,
+    VK_PIPELINE_TABLE *table
+)
+{
+    for (uint32_t i = 0; i < table->pipelines_count; i++) {
+        vkDestroyPipeline(context->logical_device, table->pipelines[i], NULL);
+        vk_release_pipeline_layout(context, table->layouts[i]);
+        vk_release_render_pass(context, table->render_passes[i]);
+    }
+
+    free(table->pipelines);
+    free(table->layouts);
+    free(table->render_passes);
+    *table = (VK_PIPELINE_TABLE) {};
+}
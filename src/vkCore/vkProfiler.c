@@ -0,0 +1,320 @@
+#include "vkInit.h"
+
+/** marks a scope that did not fit in the frame, its end is ignored */
+#define VK_PROFILE_DROPPED UINT32_MAX
+
+/** writes a JSON string body, names are expected to be plain labels */
+static void
+vk_profile_write_name
+(
+    FILE *file,
+    const char *name
+)
+{
+    for (const char *c = name; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if ((unsigned char) *c >= ' ')
+            fputc(*c, file);
+    }
+}
+
+static void
+vk_profile_write_event
+(
+    VK_PROFILER *profiler,
+    const char *name,
+    uint32_t tid,
+    int64_t begin,
+    int64_t end
+)
+{
+    if (profiler->trace_events++)
+        fputs(",\n", profiler->trace);
+
+    fputs("{\"name\":\"", profiler->trace);
+    vk_profile_write_name(profiler->trace, name);
+    fprintf(profiler->trace, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            tid, (begin - (int64_t) profiler->trace_origin) / 1e3, (end - begin) / 1e3);
+}
+
+/**
+ * reads back the timestamps of a frame slot. the slot's frame fence has been waited on,
+ * so the results are available and the read never stalls.
+ */
+static void
+vk_profile_resolve
+(
+    VK_CONTEXT *context,
+    uint32_t slot
+)
+{
+    VK_PROFILER      *profiler = &context->profiler;
+    VK_PROFILE_FRAME *frame    = &profiler->frames[slot];
+
+    if (frame->scopes_count == 0)
+        return;
+
+    if (frame->queries_count > 0) {
+        /** value and availability per query */
+        uint64_t results[frame->queries_count][2];
+
+        VkResult result = vkGetQueryPoolResults
+        (
+            context->logical_device,
+            profiler->query_pool,
+            slot * VK_PROFILE_MAX_SCOPES * 2,
+            frame->queries_count,
+            sizeof(results),
+            results,
+            sizeof(results[0]),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+        );
+
+        uint32_t base = slot * VK_PROFILE_MAX_SCOPES * 2;
+        for (uint32_t i = 0; i < frame->scopes_count; i++) {
+            VK_PROFILE_SCOPE *scope = &frame->scopes[i];
+
+            if (!scope->gpu)
+                continue;
+
+            uint64_t *begin = results[scope->query - base];
+            uint64_t *end   = results[scope->query - base + 1];
+
+            scope->gpu = (result == VK_SUCCESS || result == VK_NOT_READY) && begin[1] && end[1];
+            if (!scope->gpu)
+                continue;
+
+            scope->gpu_begin = (uint64_t) ((begin[0] & profiler->timestamp_mask) * (double) profiler->timestamp_period);
+            scope->gpu_end   = (uint64_t) ((end[0] & profiler->timestamp_mask) * (double) profiler->timestamp_period);
+        }
+    }
+
+    profiler->results = *frame;
+
+    if (profiler->trace == NULL)
+        return;
+
+    for (uint32_t i = 0; i < frame->scopes_count; i++) {
+        VK_PROFILE_SCOPE *scope = &frame->scopes[i];
+
+        vk_profile_write_event(profiler, scope->name, 1, scope->cpu_begin, scope->cpu_end);
+
+        if (!scope->gpu)
+            continue;
+
+        /** the device clock is unrelated to the CPU clock, line the first GPU scope up with its CPU scope */
+        if (!profiler->gpu_aligned) {
+            profiler->gpu_offset  = (int64_t) scope->cpu_begin - (int64_t) scope->gpu_begin;
+            profiler->gpu_aligned = true;
+        }
+        vk_profile_write_event(profiler, scope->name, 2, scope->gpu_begin + profiler->gpu_offset, scope->gpu_end + profiler->gpu_offset);
+    }
+}
+
+/**
+ * profiles frames recorded through vk_begin_frame, so it must be created after vk_create_frames
+ * and outside of a frame. with trace_filename every scope is also written as a Chrome trace event,
+ * open the file in chrome://tracing or Perfetto.
+ */
+void
+vk_create_profiler
+(
+    VK_CONTEXT *context,
+    const char *trace_filename
+)
+{
+    VK_PROFILER *profiler = &context->profiler;
+
+    *profiler = (VK_PROFILER) {};
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+
+    uint32_t queue_family_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physical_device, &queue_family_count, NULL);
+    VkQueueFamilyProperties queue_families[queue_family_count];
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physical_device, &queue_family_count, queue_families);
+
+    uint32_t valid_bits = queue_families[context->queue_families.indicies[GRAPHICS]].timestampValidBits;
+
+    profiler->timestamps       = valid_bits > 0;
+    profiler->timestamp_period = properties.limits.timestampPeriod;
+    profiler->timestamp_mask   = (valid_bits >= 64) ? UINT64_MAX : (1ull << valid_bits) - 1;
+    profiler->frames_count     = context->frames_count;
+    profiler->frames           = calloc(context->frames_count, sizeof(VK_PROFILE_FRAME));
+
+    if (profiler->timestamps) {
+        VkQueryPoolCreateInfo query_pool_create_info = {};
+        query_pool_create_info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_create_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_create_info.queryCount = context->frames_count * VK_PROFILE_MAX_SCOPES * 2;
+
+        VK_CHECK(vkCreateQueryPool(context->logical_device, &query_pool_create_info, NULL, &profiler->query_pool));
+    } else {
+        VK_LOG(LOG_WARNING, "Graphics queue does not support timestamps, profiling CPU scopes only");
+    }
+
+    if (trace_filename != NULL) {
+        profiler->trace = fopen(trace_filename, "w");
+        if (profiler->trace == NULL) {
+            VK_LOG(LOG_WARNING, "Could not open trace file, not writing a trace");
+        } else {
+            profiler->trace_origin = vk_get_time_ns();
+            fputs("[\n", profiler->trace);
+            fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n", profiler->trace);
+            fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}", profiler->trace);
+            profiler->trace_events = 2;
+        }
+    }
+
+    profiler->enabled = true;
+    VK_LOG(LOG_INFO, "Created Profiler");
+}
+
+/** idles the device to read back the frames still in flight, then finishes the trace */
+void
+vk_destroy_profiler
+(
+    VK_CONTEXT *context
+)
+{
+    VK_PROFILER *profiler = &context->profiler;
+
+    if (!profiler->enabled)
+        return;
+
+    VK_CHECK(vkDeviceWaitIdle(context->logical_device));
+
+    /** oldest first so the trace stays in order */
+    for (uint32_t i = 1; i <= profiler->frames_count; i++)
+        vk_profile_resolve(context, (context->current_frame + i) % profiler->frames_count);
+
+    if (profiler->trace != NULL) {
+        fputs("\n]\n", profiler->trace);
+        fclose(profiler->trace);
+    }
+
+    if (profiler->query_pool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(context->logical_device, profiler->query_pool, NULL);
+    free(profiler->frames);
+
+    *profiler = (VK_PROFILER) {};
+}
+
+/**
+ * called by vk_begin_frame once the frame fence has been waited on,
+ * reads back the scopes recorded frames_count frames ago and resets their queries.
+ */
+void
+vk_profile_begin_frame
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer
+)
+{
+    VK_PROFILER *profiler = &context->profiler;
+    uint32_t slot = context->current_frame;
+
+    vk_profile_resolve(context, slot);
+
+    if (profiler->stack_count) {
+        VK_LOG(LOG_WARNING, "Profile scopes left open at the end of a frame");
+        profiler->stack_count = 0;
+    }
+
+    profiler->frames[slot].frame_serial  = context->frame_serial;
+    profiler->frames[slot].queries_count = 0;
+    profiler->frames[slot].scopes_count  = 0;
+
+    if (profiler->timestamps)
+        vkCmdResetQueryPool(command_buffer, profiler->query_pool, slot * VK_PROFILE_MAX_SCOPES * 2, VK_PROFILE_MAX_SCOPES * 2);
+}
+
+/**
+ * opens a scope in the current frame, scopes nest up to VK_PROFILE_MAX_DEPTH.
+ * with a command buffer the GPU time is measured too, VK_NULL_HANDLE measures the CPU only.
+ */
+void
+vk_profile_begin
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer,
+    const char *name
+)
+{
+    VK_PROFILER *profiler = &context->profiler;
+
+    if (!profiler->enabled)
+        return;
+
+    if (profiler->stack_count == VK_PROFILE_MAX_DEPTH) {
+        VK_LOG(LOG_WARNING, "Profile scopes nested too deep");
+        return;
+    }
+
+    VK_PROFILE_FRAME *frame = &profiler->frames[context->current_frame];
+
+    if (frame->scopes_count == VK_PROFILE_MAX_SCOPES) {
+        profiler->stack[profiler->stack_count++] = VK_PROFILE_DROPPED;
+        return;
+    }
+
+    VK_PROFILE_SCOPE *scope = &frame->scopes[frame->scopes_count];
+    *scope = (VK_PROFILE_SCOPE) {
+        .name      = name,
+        .depth     = profiler->stack_count,
+        .gpu       = profiler->timestamps && command_buffer != VK_NULL_HANDLE,
+        .cpu_begin = vk_get_time_ns()
+    };
+
+    if (scope->gpu) {
+        scope->query = context->current_frame * VK_PROFILE_MAX_SCOPES * 2 + frame->queries_count;
+        frame->queries_count += 2;
+
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->query_pool, scope->query);
+    }
+
+    profiler->stack[profiler->stack_count++] = frame->scopes_count++;
+}
+
+/** closes the innermost scope, the command buffer must be the one it was opened with */
+void
+vk_profile_end
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer
+)
+{
+    VK_PROFILER *profiler = &context->profiler;
+
+    if (!profiler->enabled)
+        return;
+
+    if (profiler->stack_count == 0) {
+        VK_LOG(LOG_WARNING, "Profile scope ended without being begun");
+        return;
+    }
+
+    uint32_t index = profiler->stack[--profiler->stack_count];
+    if (index == VK_PROFILE_DROPPED)
+        return;
+
+    VK_PROFILE_SCOPE *scope = &profiler->frames[context->current_frame].scopes[index];
+    scope->cpu_end = vk_get_time_ns();
+
+    if (scope->gpu)
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->query_pool, scope->query + 1);
+}
+
+/** scopes of the newest frame read back, frames_count frames behind the one being recorded */
+const VK_PROFILE_SCOPE *
+vk_get_profile_results
+(
+    VK_CONTEXT *context,
+    uint32_t *scopes_count
+)
+{
+    *scopes_count = context->profiler.results.scopes_count;
+    return context->profiler.results.scopes;
+}
@@ -0,0 +1,274 @@
+#include "vkInit.h"
+
+#include <unistd.h>
+
+/** hands out a secondary buffer from the worker's pool of the current frame, growing the pool if needed */
+static VkCommandBuffer
+vk_recorder_buffer
+(
+    VK_CONTEXT *context,
+    uint32_t index
+)
+{
+    VK_RECORDER      *recorder = &context->recorder;
+    VK_RECORDER_POOL *pool     = &recorder->pools[context->current_frame * recorder->threads_count + index];
+
+    if (pool->buffers_used == pool->buffers_count) {
+        pool->buffers = realloc(pool->buffers, sizeof(VkCommandBuffer) * (pool->buffers_count + VK_RECORDER_BUFFER_BATCH));
+
+        VkCommandBufferAllocateInfo allocate_info = {};
+        allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocate_info.commandPool        = pool->command_pool;
+        allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocate_info.commandBufferCount = VK_RECORDER_BUFFER_BATCH;
+
+        VK_CHECK(vkAllocateCommandBuffers(context->logical_device, &allocate_info, &pool->buffers[pool->buffers_count]));
+        pool->buffers_count += VK_RECORDER_BUFFER_BATCH;
+    }
+
+    return pool->buffers[pool->buffers_used++];
+}
+
+/** takes chunks of the posted job until none are left, must be called with the lock held */
+static void
+vk_recorder_run
+(
+    VK_CONTEXT *context,
+    uint32_t index
+)
+{
+    VK_RECORDER *recorder = &context->recorder;
+
+    while (recorder->next_chunk < recorder->chunks_count) {
+        uint32_t chunk = recorder->next_chunk++;
+
+        VK_RECORD_CALLBACK             callback    = recorder->callback;
+        void                          *user_data   = recorder->user_data;
+        VkCommandBufferInheritanceInfo inheritance = recorder->inheritance;
+
+        pthread_mutex_unlock(&recorder->lock);
+
+        VkCommandBuffer command_buffer = vk_recorder_buffer(context, index);
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        begin_info.pInheritanceInfo = &inheritance;
+
+        VK_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info));
+        callback(context, command_buffer, chunk, user_data);
+        VK_CHECK(vkEndCommandBuffer(command_buffer));
+
+        recorder->chunk_buffers[chunk] = command_buffer;
+
+        pthread_mutex_lock(&recorder->lock);
+        if (++recorder->chunks_done == recorder->chunks_count)
+            pthread_cond_broadcast(&recorder->done);
+    }
+}
+
+static void *
+vk_recorder_worker
+(
+    void *arg
+)
+{
+    VK_RECORDER_WORKER *worker   = arg;
+    VK_RECORDER        *recorder = &worker->context->recorder;
+    uint64_t            seen     = 0;
+
+    pthread_mutex_lock(&recorder->lock);
+    for (;;) {
+        while (!recorder->shutdown && recorder->generation == seen)
+            pthread_cond_wait(&recorder->work, &recorder->lock);
+
+        if (recorder->shutdown)
+            break;
+
+        seen = recorder->generation;
+        vk_recorder_run(worker->context, worker->index);
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return NULL;
+}
+
+/**
+ * starts threads - 1 recording workers, 0 uses one per online CPU. the thread calling
+ * vk_record_secondary records too. command pools are externally synchronised, so every
+ * worker gets a graphics pool per frame in flight, which must already exist.
+ */
+void
+vk_create_recorder
+(
+    VK_CONTEXT *context,
+    uint32_t threads
+)
+{
+    uint64_t start = vk_get_time_ns();
+    VK_RECORDER *recorder = &context->recorder;
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? (uint32_t) cpus : 1;
+    }
+    if (threads > VK_RECORDER_MAX_THREADS)
+        threads = VK_RECORDER_MAX_THREADS;
+
+    *recorder = (VK_RECORDER) {
+        .threads_count = threads,
+        .frames_count  = context->frames_count,
+        .workers       = calloc(threads, sizeof(VK_RECORDER_WORKER)),
+        .pools         = calloc(context->frames_count * threads, sizeof(VK_RECORDER_POOL))
+    };
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->work, NULL);
+    pthread_cond_init(&recorder->done, NULL);
+
+    /** buffers are never reset one by one, the whole pool is reset when its frame comes around */
+    VkCommandPoolCreateInfo pool_create_info = {};
+    pool_create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_create_info.queueFamilyIndex = context->queue_families.indicies[GRAPHICS];
+
+    for (uint32_t i = 0; i < context->frames_count * threads; i++)
+        VK_CHECK(vkCreateCommandPool(context->logical_device, &pool_create_info, NULL, &recorder->pools[i].command_pool));
+
+    for (uint32_t i = 0; i < threads; i++) {
+        recorder->workers[i] = (VK_RECORDER_WORKER) {
+            .context = context,
+            .index   = i
+        };
+
+        if (i == 0)
+            continue;
+
+        if (pthread_create(&recorder->workers[i].thread, NULL, vk_recorder_worker, &recorder->workers[i]) != 0) {
+            VK_LOG(LOG_ERROR, "Could not create recorder worker thread");
+            exit(-1);
+        }
+    }
+
+    recorder->enabled = true;
+    vk_record_init_stage(context, "create recorder", start);
+    VK_LOGF(LOG_INFO, "vk", "Created Recorder (%u threads)", threads);
+}
+
+/** idles the device since secondary buffers of frames in flight may still be executing */
+void
+vk_destroy_recorder
+(
+    VK_CONTEXT *context
+)
+{
+    VK_RECORDER *recorder = &context->recorder;
+
+    if (!recorder->enabled)
+        return;
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->shutdown = true;
+    pthread_cond_broadcast(&recorder->work);
+    pthread_mutex_unlock(&recorder->lock);
+
+    for (uint32_t i = 1; i < recorder->threads_count; i++)
+        pthread_join(recorder->workers[i].thread, NULL);
+
+    VK_CHECK(vkDeviceWaitIdle(context->logical_device));
+
+    for (uint32_t i = 0; i < recorder->frames_count * recorder->threads_count; i++) {
+        vkDestroyCommandPool(context->logical_device, recorder->pools[i].command_pool, NULL);
+        free(recorder->pools[i].buffers);
+    }
+
+    pthread_cond_destroy(&recorder->done);
+    pthread_cond_destroy(&recorder->work);
+    pthread_mutex_destroy(&recorder->lock);
+
+    free(recorder->chunk_buffers);
+    free(recorder->pools);
+    free(recorder->workers);
+    *recorder = (VK_RECORDER) {};
+}
+
+/** called by vk_begin_frame once the frame fence has been waited on, resets the frame's pools whole */
+void
+vk_reset_recorder_frame
+(
+    VK_CONTEXT *context
+)
+{
+    VK_RECORDER *recorder = &context->recorder;
+
+    for (uint32_t i = 0; i < recorder->threads_count; i++) {
+        VK_RECORDER_POOL *pool = &recorder->pools[context->current_frame * recorder->threads_count + i];
+
+        if (pool->buffers_used == 0)
+            continue;
+
+        VK_CHECK(vkResetCommandPool(context->logical_device, pool->command_pool, 0));
+        pool->buffers_used = 0;
+    }
+}
+
+/**
+ * records chunks_count secondary buffers on the workers and executes them from primary in chunk order.
+ * the buffers inherit render_pass, subpass and framebuffer, primary must have begun that render pass
+ * with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. state such as the pipeline, viewport and scissor
+ * is not inherited, the callback binds what its chunk uses. returns once every chunk is recorded.
+ */
+void
+vk_record_secondary
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer primary,
+    VkRenderPass render_pass,
+    uint32_t subpass,
+    VkFramebuffer framebuffer,
+    uint32_t chunks_count,
+    VK_RECORD_CALLBACK callback,
+    void *user_data
+)
+{
+    VK_RECORDER *recorder = &context->recorder;
+
+    if (!recorder->enabled) {
+        VK_LOG(LOG_ERROR, "vk_record_secondary requires vk_create_recorder");
+        exit(-1);
+    }
+
+    if (chunks_count == 0)
+        return;
+
+    pthread_mutex_lock(&recorder->lock);
+
+    if (chunks_count > recorder->chunk_buffers_capacity) {
+        recorder->chunk_buffers_capacity = chunks_count;
+        recorder->chunk_buffers = realloc(recorder->chunk_buffers, sizeof(VkCommandBuffer) * chunks_count);
+    }
+
+    recorder->callback     = callback;
+    recorder->user_data    = user_data;
+    recorder->chunks_count = chunks_count;
+    recorder->next_chunk   = 0;
+    recorder->chunks_done  = 0;
+
+    recorder->inheritance = (VkCommandBufferInheritanceInfo) {};
+    recorder->inheritance.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    recorder->inheritance.renderPass  = render_pass;
+    recorder->inheritance.subpass     = subpass;
+    recorder->inheritance.framebuffer = framebuffer;
+
+    /** a single chunk is recorded here without waking the workers */
+    recorder->generation++;
+    if (chunks_count > 1)
+        pthread_cond_broadcast(&recorder->work);
+
+    vk_recorder_run(context, 0);
+
+    while (recorder->chunks_done < recorder->chunks_count)
+        pthread_cond_wait(&recorder->done, &recorder->lock);
+
+    pthread_mutex_unlock(&recorder->lock);
+
+    vkCmdExecuteCommands(primary, chunks_count, recorder->chunk_buffers);
+}
@@ -0,0 +1,137 @@
+#include "vkInit.h"
+
+/** stages are recorded from jobs too */
+static pthread_mutex_t vk_init_report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * adds the time since start to the named startup stage, start is a vk_get_time_ns value.
+ * stages keep the order they first ran in.
+ */
+void
+vk_record_init_stage
+(
+    VK_CONTEXT *context,
+    const char *name,
+    uint64_t start
+)
+{
+    uint64_t end = vk_get_time_ns();
+    VK_INIT_REPORT *report = &context->init_report;
+
+    pthread_mutex_lock(&vk_init_report_lock);
+
+    if (report->origin == 0 || start < report->origin)
+        report->origin = start;
+    if (end > report->end)
+        report->end = end;
+
+    VK_INIT_STAGE *stage = NULL;
+    for (uint32_t i = 0; i < report->stages_count; i++) {
+        if (!strncmp(report->stages[i].name, name, VK_INIT_STAGE_NAME_SIZE - 1)) {
+            stage = &report->stages[i];
+            break;
+        }
+    }
+
+    if (stage == NULL) {
+        if (report->stages_count == report->stages_capacity) {
+            report->stages_capacity = (report->stages_capacity) ? report->stages_capacity * 2 : 32;
+            report->stages = realloc(report->stages, sizeof(VK_INIT_STAGE) * report->stages_capacity);
+        }
+
+        stage = &report->stages[report->stages_count++];
+        *stage = (VK_INIT_STAGE) {
+            .start = start - report->origin
+        };
+        snprintf(stage->name, sizeof(stage->name), "%s", name);
+    }
+
+    stage->count++;
+    stage->duration += end - start;
+
+    pthread_mutex_unlock(&vk_init_report_lock);
+}
+
+static void
+vk_report_write_string
+(
+    FILE *file,
+    const char *string
+)
+{
+    fputc('"', file);
+    for (const char *c = string; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if ((unsigned char) *c >= ' ')
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * writes the startup stages and the context they ran in as JSON, times are in ms.
+ * meant to be written once startup is done and compared between commits.
+ */
+void
+vk_write_init_report
+(
+    VK_CONTEXT *context,
+    const char *filename
+)
+{
+    VK_INIT_REPORT *report = &context->init_report;
+
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        VK_LOG(LOG_WARNING, "Could not open init report file, not writing it");
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties = {};
+    if (context->physical_device != VK_NULL_HANDLE)
+        vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+
+    pthread_mutex_lock(&vk_init_report_lock);
+
+    fputs("{\n  \"device\": ", file);
+    vk_report_write_string(file, properties.deviceName);
+    fprintf(file, ",\n  \"device_api_version\": \"%u.%u.%u\",\n",
+            VK_VERSION_MAJOR(properties.apiVersion), VK_VERSION_MINOR(properties.apiVersion), VK_VERSION_PATCH(properties.apiVersion));
+    fprintf(file, "  \"instance_api_version\": \"%u.%u.%u\",\n",
+            VK_VERSION_MAJOR(context->api_version), VK_VERSION_MINOR(context->api_version), VK_VERSION_PATCH(context->api_version));
+    fprintf(file, "  \"driver_version\": %u,\n", properties.driverVersion);
+    fprintf(file, "  \"headless\": %s,\n", (context->headless) ? "true" : "false");
+    fprintf(file, "  \"pipeline_cache_warm\": %s,\n", (context->pipeline_cache_details.warm) ? "true" : "false");
+    fprintf(file, "  \"pipelines\": %u,\n", context->pipeline_cache_details.pipeline_count);
+    fprintf(file, "  \"shader_cache_hits\": %u,\n", context->shader_cache.hits);
+    fprintf(file, "  \"shader_cache_misses\": %u,\n", context->shader_cache.misses);
+    fprintf(file, "  \"total_ms\": %.3f,\n", (report->end - report->origin) / 1e6);
+    fputs("  \"stages\": [", file);
+
+    for (uint32_t i = 0; i < report->stages_count; i++) {
+        VK_INIT_STAGE *stage = &report->stages[i];
+
+        fputs((i) ? ",\n    { \"name\": " : "\n    { \"name\": ", file);
+        vk_report_write_string(file, stage->name);
+        fprintf(file, ", \"count\": %u, \"start_ms\": %.3f, \"ms\": %.3f }", stage->count, stage->start / 1e6, stage->duration / 1e6);
+    }
+
+    fputs("\n  ]\n}\n", file);
+
+    pthread_mutex_unlock(&vk_init_report_lock);
+    fclose(file);
+
+    VK_LOG(LOG_INFO, "Saved Init Report");
+}
+
+void
+vk_destroy_init_report
+(
+    VK_CONTEXT *context
+)
+{
+    free(context->init_report.stages);
+    context->init_report = (VK_INIT_REPORT) {};
+}
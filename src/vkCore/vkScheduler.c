@@ -0,0 +1,590 @@
+#include "vkInit.h"
+
+#include <stddef.h>
+
+/**
+ * one monotonic counter per queue. every submission signals the next value of its queue and
+ * may wait on values of any queue. with timeline semaphores the counter is the semaphore itself,
+ * on devices without them each vkQueueSubmit signals a fence carrying its last value and
+ * dependencies between queues are carried by binary semaphores.
+ */
+
+static VkFence
+vk_scheduler_get_fence
+(
+    VK_CONTEXT *context
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+    VkFence fence;
+
+    if (scheduler->free_fences_count)
+        return scheduler->free_fences[--scheduler->free_fences_count];
+
+    VkFenceCreateInfo fence_create_info = {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VK_CHECK(vkCreateFence(context->logical_device, &fence_create_info, NULL, &fence));
+    return fence;
+}
+
+static VkSemaphore
+vk_scheduler_get_semaphore
+(
+    VK_CONTEXT *context
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+    VkSemaphore semaphore;
+
+    if (scheduler->free_semaphores_count)
+        return scheduler->free_semaphores[--scheduler->free_semaphores_count];
+
+    VkSemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &semaphore));
+    return semaphore;
+}
+
+/** returns the fences of the queue that have signaled to the pool, advancing completed_value */
+static void
+vk_scheduler_retire
+(
+    VK_CONTEXT *context,
+    VK_SCHEDULER_QUEUE *queue
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+
+    uint32_t retired = 0;
+    while (retired < queue->fences_count && vkGetFenceStatus(context->logical_device, queue->fences[retired].fence) == VK_SUCCESS) {
+        VK_SCHEDULER_FENCE *fence = &queue->fences[retired++];
+
+        VK_CHECK(vkResetFences(context->logical_device, 1, &fence->fence));
+
+        if (scheduler->free_fences_count == scheduler->free_fences_capacity) {
+            scheduler->free_fences_capacity = (scheduler->free_fences_capacity) ? scheduler->free_fences_capacity * 2 : 8;
+            scheduler->free_fences = realloc(scheduler->free_fences, sizeof(VkFence) * scheduler->free_fences_capacity);
+        }
+        scheduler->free_fences[scheduler->free_fences_count++] = fence->fence;
+
+        /** the waits completed before the fence signaled, so the semaphores are unsignaled again */
+        for (uint32_t i = 0; i < fence->semaphores_count; i++) {
+            if (scheduler->free_semaphores_count == scheduler->free_semaphores_capacity) {
+                scheduler->free_semaphores_capacity = (scheduler->free_semaphores_capacity) ? scheduler->free_semaphores_capacity * 2 : 8;
+                scheduler->free_semaphores = realloc(scheduler->free_semaphores, sizeof(VkSemaphore) * scheduler->free_semaphores_capacity);
+            }
+            scheduler->free_semaphores[scheduler->free_semaphores_count++] = fence->semaphores[i];
+        }
+        free(fence->semaphores);
+
+        queue->completed_value = fence->value;
+    }
+
+    if (retired == 0)
+        return;
+
+    queue->fences_count -= retired;
+    memmove(queue->fences, queue->fences + retired, sizeof(VK_SCHEDULER_FENCE) * queue->fences_count);
+}
+
+/** emulation only, blocks until a value already passed to vkQueueSubmit has completed */
+static void
+vk_scheduler_wait_fence
+(
+    VK_CONTEXT *context,
+    VK_SCHEDULER_QUEUE *queue,
+    uint64_t value
+)
+{
+    for (uint32_t i = 0; i < queue->fences_count; i++) {
+        if (queue->fences[i].value < value)
+            continue;
+
+        VK_CHECK(vkWaitForFences(context->logical_device, 1, &queue->fences[i].fence, VK_TRUE, UINT64_MAX));
+        break;
+    }
+    vk_scheduler_retire(context, queue);
+}
+
+/** one vkQueueSubmit per queue, waits may name values flushed later since timelines allow wait before signal */
+static void
+vk_scheduler_flush_timeline
+(
+    VK_CONTEXT *context
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+
+    uint32_t n = scheduler->pending_count;
+
+    VkSubmitInfo                  submit_infos[n];
+    VkTimelineSemaphoreSubmitInfo timeline_infos[n];
+    VkSemaphore                   wait_semaphores[n][VK_SCHEDULER_MAX_WAITS];
+    uint64_t                      wait_values[n][VK_SCHEDULER_MAX_WAITS];
+    VkPipelineStageFlags          wait_stages[n][VK_SCHEDULER_MAX_WAITS];
+    VkSemaphore                   signal_semaphores[n][2];
+    uint64_t                      signal_values[n][2];
+
+    for (uint32_t role = 0; role < VK_SCHEDULER_QUEUES; role++) {
+        VK_SCHEDULER_QUEUE *queue = &scheduler->queues[role];
+
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            VK_SCHEDULER_SUBMISSION *submission = &scheduler->pending[i];
+
+            if (submission->role != role)
+                continue;
+
+            for (uint32_t w = 0; w < submission->waits_count; w++) {
+                wait_semaphores[count][w] = scheduler->queues[submission->waits[w].role].timeline;
+                wait_values[count][w]     = submission->waits[w].value;
+                wait_stages[count][w]     = submission->waits[w].stage;
+            }
+
+            /** the value of a binary semaphore is ignored */
+            uint32_t signals = (submission->signal != VK_NULL_HANDLE) ? 2 : 1;
+            signal_semaphores[count][0] = queue->timeline;
+            signal_semaphores[count][1] = submission->signal;
+            signal_values[count][0]     = submission->value;
+            signal_values[count][1]     = 0;
+
+            timeline_infos[count] = (VkTimelineSemaphoreSubmitInfo) {
+                .sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                .waitSemaphoreValueCount   = submission->waits_count,
+                .pWaitSemaphoreValues      = wait_values[count],
+                .signalSemaphoreValueCount = signals,
+                .pSignalSemaphoreValues    = signal_values[count]
+            };
+
+            submit_infos[count] = (VkSubmitInfo) {
+                .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext                = &timeline_infos[count],
+                .waitSemaphoreCount   = submission->waits_count,
+                .pWaitSemaphores      = wait_semaphores[count],
+                .pWaitDstStageMask    = wait_stages[count],
+                .commandBufferCount   = (submission->command_buffer != VK_NULL_HANDLE) ? 1 : 0,
+                .pCommandBuffers      = &submission->command_buffer,
+                .signalSemaphoreCount = signals,
+                .pSignalSemaphores    = signal_semaphores[count]
+            };
+
+            queue->submitted_value = submission->value;
+            count++;
+        }
+
+        if (count == 0)
+            continue;
+
+        VK_CHECK(vk_queue_submit(context, queue->queue, count, submit_infos, VK_NULL_HANDLE));
+        scheduler->submit_calls++;
+    }
+}
+
+/**
+ * binary semaphores must be signaled before they are waited on and waited on once,
+ * so runs of submissions to the same queue are submitted in the order they were made
+ * and every cross submission wait gets its own semaphore.
+ */
+static void
+vk_scheduler_flush_emulated
+(
+    VK_CONTEXT *context
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+
+    uint32_t n = scheduler->pending_count;
+
+    VkSemaphore          wait_semaphores[n][VK_SCHEDULER_MAX_WAITS];
+    VkPipelineStageFlags wait_stages[n][VK_SCHEDULER_MAX_WAITS];
+    uint32_t             wait_counts[n];
+    uint32_t             signal_counts[n];
+    uint32_t             signal_offsets[n];
+    uint32_t             producers[n * VK_SCHEDULER_MAX_WAITS];
+    VkSemaphore          producer_semaphores[n * VK_SCHEDULER_MAX_WAITS];
+    VkSemaphore          signal_semaphores[n * (VK_SCHEDULER_MAX_WAITS + 1)];
+    uint32_t             pairs = 0;
+
+    memset(signal_counts, 0, sizeof(signal_counts));
+
+    for (uint32_t i = 0; i < n; i++) {
+        VK_SCHEDULER_SUBMISSION *submission = &scheduler->pending[i];
+
+        wait_counts[i] = 0;
+        if (submission->signal != VK_NULL_HANDLE)
+            signal_counts[i]++;
+
+        for (uint32_t w = 0; w < submission->waits_count; w++) {
+            VK_SCHEDULER_WAIT  *wait  = &submission->waits[w];
+            VK_SCHEDULER_QUEUE *queue = &scheduler->queues[wait->role];
+
+            vk_scheduler_retire(context, queue);
+            if (wait->value <= queue->completed_value)
+                continue;
+
+            /** a binary semaphore cannot be added to work already on the GPU, wait for it here */
+            if (wait->value <= queue->submitted_value) {
+                vk_scheduler_wait_fence(context, queue, wait->value);
+                continue;
+            }
+
+            /** values are handed out in submission order, so the producer is pending before i */
+            uint32_t j = 0;
+            while (scheduler->pending[j].role != wait->role || scheduler->pending[j].value != wait->value)
+                j++;
+
+            VkSemaphore semaphore = vk_scheduler_get_semaphore(context);
+
+            producers[pairs]           = j;
+            producer_semaphores[pairs] = semaphore;
+            pairs++;
+            signal_counts[j]++;
+
+            wait_semaphores[i][wait_counts[i]] = semaphore;
+            wait_stages[i][wait_counts[i]]     = wait->stage;
+            wait_counts[i]++;
+        }
+    }
+
+    /** group the semaphores each producer signals */
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        signal_offsets[i] = offset;
+        offset           += signal_counts[i];
+        signal_counts[i]  = 0;
+    }
+    for (uint32_t i = 0; i < pairs; i++) {
+        uint32_t j = producers[i];
+        signal_semaphores[signal_offsets[j] + signal_counts[j]++] = producer_semaphores[i];
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (scheduler->pending[i].signal != VK_NULL_HANDLE)
+            signal_semaphores[signal_offsets[i] + signal_counts[i]++] = scheduler->pending[i].signal;
+    }
+
+    VkSubmitInfo submit_infos[n];
+
+    for (uint32_t first = 0; first < n;) {
+        uint32_t role = scheduler->pending[first].role;
+        uint32_t last = first;
+        uint32_t semaphores_count = 0;
+
+        while (last < n && scheduler->pending[last].role == role) {
+            VK_SCHEDULER_SUBMISSION *submission = &scheduler->pending[last];
+
+            submit_infos[last - first] = (VkSubmitInfo) {
+                .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .waitSemaphoreCount   = wait_counts[last],
+                .pWaitSemaphores      = wait_semaphores[last],
+                .pWaitDstStageMask    = wait_stages[last],
+                .commandBufferCount   = (submission->command_buffer != VK_NULL_HANDLE) ? 1 : 0,
+                .pCommandBuffers      = &submission->command_buffer,
+                .signalSemaphoreCount = signal_counts[last],
+                .pSignalSemaphores    = &signal_semaphores[signal_offsets[last]]
+            };
+
+            semaphores_count += wait_counts[last];
+            last++;
+        }
+
+        VK_SCHEDULER_QUEUE *queue = &scheduler->queues[role];
+        VkFence fence = vk_scheduler_get_fence(context);
+
+        VK_CHECK(vk_queue_submit(context, queue->queue, last - first, submit_infos, fence));
+        scheduler->submit_calls++;
+
+        if (queue->fences_count == queue->fences_capacity) {
+            queue->fences_capacity = (queue->fences_capacity) ? queue->fences_capacity * 2 : 8;
+            queue->fences = realloc(queue->fences, sizeof(VK_SCHEDULER_FENCE) * queue->fences_capacity);
+        }
+
+        VK_SCHEDULER_FENCE *record = &queue->fences[queue->fences_count++];
+        *record = (VK_SCHEDULER_FENCE) {
+            .value            = scheduler->pending[last - 1].value,
+            .fence            = fence,
+            .semaphores_count = semaphores_count,
+            .semaphores       = malloc(sizeof(VkSemaphore) * (semaphores_count ? semaphores_count : 1))
+        };
+
+        uint32_t k = 0;
+        for (uint32_t i = first; i < last; i++) {
+            memcpy(record->semaphores + k, wait_semaphores[i], sizeof(VkSemaphore) * wait_counts[i]);
+            k += wait_counts[i];
+        }
+
+        queue->submitted_value = record->value;
+        first = last;
+    }
+}
+
+static void
+vk_scheduler_flush_locked
+(
+    VK_CONTEXT *context
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+
+    if (scheduler->pending_count == 0)
+        return;
+
+    if (scheduler->timeline)
+        vk_scheduler_flush_timeline(context);
+    else
+        vk_scheduler_flush_emulated(context);
+
+    scheduler->pending_count = 0;
+}
+
+/**
+ * uses timeline semaphores if the device was created with the timelineSemaphore feature,
+ * in VkPhysicalDeviceVulkan12Features or VkPhysicalDeviceTimelineSemaphoreFeatures,
+ * and emulates them with fences otherwise.
+ */
+void
+vk_create_scheduler
+(
+    VK_CONTEXT *context
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+
+    *scheduler = (VK_SCHEDULER) {};
+    pthread_mutex_init(&scheduler->lock, NULL);
+    scheduler->enabled = true;
+
+    scheduler->timeline =
+        vk_get_enabled_feature(context, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+                               offsetof(VkPhysicalDeviceVulkan12Features, timelineSemaphore)) ||
+        vk_get_enabled_feature(context, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+                               offsetof(VkPhysicalDeviceTimelineSemaphoreFeatures, timelineSemaphore));
+
+    if (scheduler->timeline) {
+        /** core on 1.2 devices, VK_KHR_timeline_semaphore on 1.1 devices */
+        scheduler->wait_semaphores = (PFN_vkWaitSemaphores) vkGetDeviceProcAddr(context->logical_device, "vkWaitSemaphores");
+        if (scheduler->wait_semaphores == NULL)
+            scheduler->wait_semaphores = (PFN_vkWaitSemaphores) vkGetDeviceProcAddr(context->logical_device, "vkWaitSemaphoresKHR");
+
+        scheduler->get_semaphore_counter_value = (PFN_vkGetSemaphoreCounterValue) vkGetDeviceProcAddr(context->logical_device, "vkGetSemaphoreCounterValue");
+        if (scheduler->get_semaphore_counter_value == NULL)
+            scheduler->get_semaphore_counter_value = (PFN_vkGetSemaphoreCounterValue) vkGetDeviceProcAddr(context->logical_device, "vkGetSemaphoreCounterValueKHR");
+
+        if (scheduler->wait_semaphores == NULL || scheduler->get_semaphore_counter_value == NULL) {
+            VK_LOG(LOG_WARNING, "Timeline semaphore functions not found, emulating with fences");
+            scheduler->timeline = false;
+        }
+    }
+
+    for (uint32_t role = 0; role < VK_SCHEDULER_QUEUES; role++) {
+        VK_SCHEDULER_QUEUE *queue = &scheduler->queues[role];
+
+        /**
+         * roles without a family run on graphics, the last queue of a role is the one least shared with the frame loop.
+         * on single queue families it is the frame's queue, vk_queue_submit keeps the two apart.
+         */
+        uint32_t family_role = (context->queue_families.found[role]) ? role : GRAPHICS;
+        uint32_t count       = context->queue_families.queue_count[family_role];
+        queue->queue = vk_get_queue(context, family_role, (count) ? count - 1 : 0);
+
+        if (!scheduler->timeline)
+            continue;
+
+        VkSemaphoreTypeCreateInfo type_create_info = {};
+        type_create_info.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_create_info.initialValue  = 0;
+
+        VkSemaphoreCreateInfo semaphore_create_info = {};
+        semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphore_create_info.pNext = &type_create_info;
+
+        VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &queue->timeline));
+    }
+
+    if (scheduler->timeline)
+        VK_LOG(LOG_INFO, "Created Scheduler (timeline semaphores)");
+    else
+        VK_LOG(LOG_INFO, "Created Scheduler (fence emulation)");
+}
+
+void
+vk_destroy_scheduler
+(
+    VK_CONTEXT *context
+)
+{
+    char msg[128];
+    VK_SCHEDULER *scheduler = &context->scheduler;
+
+    for (uint32_t role = 0; role < VK_SCHEDULER_QUEUES; role++)
+        vk_scheduler_wait(context, role, scheduler->queues[role].next_value);
+
+    for (uint32_t role = 0; role < VK_SCHEDULER_QUEUES; role++) {
+        VK_SCHEDULER_QUEUE *queue = &scheduler->queues[role];
+
+        if (queue->timeline != VK_NULL_HANDLE)
+            vkDestroySemaphore(context->logical_device, queue->timeline, NULL);
+        free(queue->fences);
+    }
+
+    for (uint32_t i = 0; i < scheduler->free_fences_count; i++)
+        vkDestroyFence(context->logical_device, scheduler->free_fences[i], NULL);
+    for (uint32_t i = 0; i < scheduler->free_semaphores_count; i++)
+        vkDestroySemaphore(context->logical_device, scheduler->free_semaphores[i], NULL);
+
+    snprintf(msg, sizeof(msg), "Scheduler: %u submissions in %u vkQueueSubmit calls", scheduler->submissions, scheduler->submit_calls);
+    VK_LOG(LOG_INFO, msg);
+
+    free(scheduler->free_fences);
+    free(scheduler->free_semaphores);
+    free(scheduler->pending);
+    pthread_mutex_destroy(&scheduler->lock);
+
+    *scheduler = (VK_SCHEDULER) {};
+}
+
+/**
+ * queues a command buffer on the GRAPHICS, COMPUTE or TRANSFER queue after the given waits,
+ * returns the value the queue's counter reaches once it completes.
+ * signal is an optional binary semaphore for a submission made outside the scheduler, e.g. vk_frame_wait_semaphore.
+ * nothing reaches the GPU until vk_scheduler_flush or a wait on a pending value.
+ */
+uint64_t
+vk_scheduler_submit
+(
+    VK_CONTEXT *context,
+    uint32_t role,
+    VkCommandBuffer command_buffer,
+    const VK_SCHEDULER_WAIT *waits,
+    uint32_t waits_count,
+    VkSemaphore signal
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+
+    if (role >= VK_SCHEDULER_QUEUES || waits_count > VK_SCHEDULER_MAX_WAITS)
+    {
+        VK_LOG(LOG_ERROR, "Scheduler submission needs a graphics, compute or transfer queue and at most VK_SCHEDULER_MAX_WAITS waits");
+        exit(-1);
+    }
+
+    pthread_mutex_lock(&scheduler->lock);
+
+    for (uint32_t i = 0; i < waits_count; i++) {
+        if (waits[i].role >= VK_SCHEDULER_QUEUES || waits[i].value > scheduler->queues[waits[i].role].next_value)
+        {
+            VK_LOG(LOG_ERROR, "Scheduler wait on a value that was never submitted");
+            exit(-1);
+        }
+    }
+
+    if (scheduler->pending_count == scheduler->pending_capacity) {
+        scheduler->pending_capacity = (scheduler->pending_capacity) ? scheduler->pending_capacity * 2 : 16;
+        scheduler->pending = realloc(scheduler->pending, sizeof(VK_SCHEDULER_SUBMISSION) * scheduler->pending_capacity);
+    }
+
+    VK_SCHEDULER_SUBMISSION *submission = &scheduler->pending[scheduler->pending_count++];
+    *submission = (VK_SCHEDULER_SUBMISSION) {
+        .role           = role,
+        .value          = ++scheduler->queues[role].next_value,
+        .command_buffer = command_buffer,
+        .signal         = signal,
+        .waits_count    = waits_count
+    };
+    if (waits_count)
+        memcpy(submission->waits, waits, sizeof(VK_SCHEDULER_WAIT) * waits_count);
+
+    scheduler->submissions++;
+    uint64_t value = submission->value;
+
+    pthread_mutex_unlock(&scheduler->lock);
+    return value;
+}
+
+/** hands every pending submission to its queue in as few vkQueueSubmit calls as the mode allows */
+void
+vk_scheduler_flush
+(
+    VK_CONTEXT *context
+)
+{
+    pthread_mutex_lock(&context->scheduler.lock);
+    vk_scheduler_flush_locked(context);
+    pthread_mutex_unlock(&context->scheduler.lock);
+}
+
+/** polls the counter of a queue without blocking */
+uint64_t
+vk_scheduler_completed
+(
+    VK_CONTEXT *context,
+    uint32_t role
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+    VK_SCHEDULER_QUEUE *queue = &scheduler->queues[role];
+
+    pthread_mutex_lock(&scheduler->lock);
+
+    if (scheduler->timeline) {
+        uint64_t value;
+        VK_CHECK(scheduler->get_semaphore_counter_value(context->logical_device, queue->timeline, &value));
+        if (value > queue->completed_value)
+            queue->completed_value = value;
+    } else {
+        vk_scheduler_retire(context, queue);
+    }
+
+    uint64_t completed = queue->completed_value;
+
+    pthread_mutex_unlock(&scheduler->lock);
+    return completed;
+}
+
+/**
+ * blocks until the counter of a queue reaches value, flushing first if it is still pending.
+ * the fence emulation holds the scheduler lock while it waits.
+ */
+void
+vk_scheduler_wait
+(
+    VK_CONTEXT *context,
+    uint32_t role,
+    uint64_t value
+)
+{
+    VK_SCHEDULER *scheduler = &context->scheduler;
+    VK_SCHEDULER_QUEUE *queue = &scheduler->queues[role];
+
+    pthread_mutex_lock(&scheduler->lock);
+
+    if (value > queue->submitted_value)
+        vk_scheduler_flush_locked(context);
+
+    if (!scheduler->timeline) {
+        vk_scheduler_wait_fence(context, queue, value);
+        pthread_mutex_unlock(&scheduler->lock);
+        return;
+    }
+
+    if (value <= queue->completed_value) {
+        pthread_mutex_unlock(&scheduler->lock);
+        return;
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores    = &queue->timeline;
+    wait_info.pValues        = &value;
+
+    VK_CHECK(scheduler->wait_semaphores(context->logical_device, &wait_info, UINT64_MAX));
+
+    pthread_mutex_lock(&scheduler->lock);
+    if (value > queue->completed_value)
+        queue->completed_value = value;
+    pthread_mutex_unlock(&scheduler->lock);
+}
@@ -0,0 +1,260 @@
+#include "vkInit.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define VK_SPIRV_MAGIC       0x07230203
+#define VK_SPIRV_HEADER_SIZE 20 // magic, version, generator, bound, schema
+
+/** must be called with the lock held */
+static VK_SHADER_CACHE_ENTRY *
+vk_shader_cache_find
+(
+    VK_SHADER_CACHE *cache,
+    uint64_t hash,
+    const uint32_t *code,
+    size_t size
+)
+{
+    for (uint32_t i = 0; i < cache->entries_count; i++) {
+        VK_SHADER_CACHE_ENTRY *entry = &cache->entries[i];
+
+        if (entry->hash == hash && entry->size == size && !memcmp(entry->code, code, size))
+            return entry;
+    }
+    return NULL;
+}
+
+void
+vk_create_shader_cache
+(
+    VK_CONTEXT *context
+)
+{
+    VK_SHADER_CACHE *cache = &context->shader_cache;
+
+    *cache = (VK_SHADER_CACHE) {};
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->enabled = true;
+
+    VK_LOG(LOG_INFO, "Created Shader Cache");
+}
+
+/** destroys the cached modules no pipeline is being created from */
+void
+vk_trim_shader_cache
+(
+    VK_CONTEXT *context
+)
+{
+    VK_SHADER_CACHE *cache = &context->shader_cache;
+
+    if (!cache->enabled)
+        return;
+
+    pthread_mutex_lock(&cache->lock);
+    for (uint32_t i = 0; i < cache->entries_count;) {
+        if (cache->entries[i].references) {
+            i++;
+            continue;
+        }
+
+        vkDestroyShaderModule(context->logical_device, cache->entries[i].module, NULL);
+        munmap((void *) cache->entries[i].code, cache->entries[i].size);
+        cache->entries[i] = cache->entries[--cache->entries_count];
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void
+vk_destroy_shader_cache
+(
+    VK_CONTEXT *context
+)
+{
+    char msg[128];
+    VK_SHADER_CACHE *cache = &context->shader_cache;
+
+    if (!cache->enabled)
+        return;
+
+    for (uint32_t i = 0; i < cache->entries_count; i++) {
+        if (cache->entries[i].references)
+            VK_LOG(LOG_WARNING, "Shader module still referenced on cache destruction");
+
+        vkDestroyShaderModule(context->logical_device, cache->entries[i].module, NULL);
+        munmap((void *) cache->entries[i].code, cache->entries[i].size);
+    }
+
+    snprintf(msg, sizeof(msg), "Shader cache: %u hits, %u misses", cache->hits, cache->misses);
+    VK_LOG(LOG_INFO, msg);
+
+    free(cache->entries);
+    pthread_mutex_destroy(&cache->lock);
+
+    *cache = (VK_SHADER_CACHE) {};
+}
+
+/**
+ * maps a SPIR-V file and returns a module for it, shared with every other load of the same code.
+ * the file is passed to the driver straight from the mapping, no copy is made.
+ * a new entry keeps the mapping to compare later loads against until it is trimmed.
+ * every successful load must be paired with vk_release_shader_module.
+ */
+bool
+vk_load_shader_module
+(
+    VK_CONTEXT *context,
+    const char *filename,
+    VkShaderModule *shader_module
+)
+{
+    struct stat st;
+    char stage_name[VK_INIT_STAGE_NAME_SIZE];
+    uint64_t start = vk_get_time_ns();
+    VK_SHADER_CACHE *cache = &context->shader_cache;
+
+    int fd = open(filename, O_RDONLY);
+
+    /** if not found continue */
+    if (fd < 0)
+    {
+        VK_LOG(LOG_WARNING, "file not found, skipping");
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        VK_LOG(LOG_ERROR, "Could not read file");
+        exit(-1);
+    }
+
+    /** SPIR-V is a stream of 32 bit words behind a 5 word header */
+    size_t size = st.st_size;
+    if (size < VK_SPIRV_HEADER_SIZE || size % 4 != 0)
+    {
+        VK_LOG(LOG_WARNING, "file is not a whole number of SPIR-V words, skipping");
+        close(fd);
+        return false;
+    }
+
+    const uint32_t *code = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (code == MAP_FAILED)
+    {
+        VK_LOG(LOG_ERROR, "Could not map file");
+        exit(-1);
+    }
+
+    if (code[0] != VK_SPIRV_MAGIC)
+    {
+        VK_LOG(LOG_WARNING, "file has no SPIR-V magic number, skipping");
+        munmap((void *) code, size);
+        return false;
+    }
+
+    uint64_t hash = vk_fnv1a(code, size);
+    snprintf(stage_name, sizeof(stage_name), "load shader %s", filename);
+
+    if (cache->enabled) {
+        pthread_mutex_lock(&cache->lock);
+
+        VK_SHADER_CACHE_ENTRY *entry = vk_shader_cache_find(cache, hash, code, size);
+        if (entry != NULL) {
+            entry->references++;
+            cache->hits++;
+            *shader_module = entry->module;
+
+            pthread_mutex_unlock(&cache->lock);
+            munmap((void *) code, size);
+
+            vk_record_init_stage(context, stage_name, start);
+            return true;
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    VkShaderModuleCreateInfo shader_create_info = {};
+    shader_create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_create_info.codeSize = size;
+    shader_create_info.pCode    = code;
+
+    /** created outside the lock so misses on other threads compile in parallel */
+    VK_CHECK(vkCreateShaderModule(context->logical_device, &shader_create_info, NULL, shader_module));
+    VK_LOG(LOG_INFO, "Created Shader Module");
+
+    /** without a cache every load owns its module, as before */
+    if (!cache->enabled) {
+        munmap((void *) code, size);
+        vk_record_init_stage(context, stage_name, start);
+        return true;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    /** another thread may have loaded the same code meanwhile, keep its module and drop ours */
+    VK_SHADER_CACHE_ENTRY *entry = vk_shader_cache_find(cache, hash, code, size);
+    if (entry != NULL) {
+        VkShaderModule created = *shader_module;
+
+        entry->references++;
+        cache->hits++;
+        *shader_module = entry->module;
+
+        pthread_mutex_unlock(&cache->lock);
+        vkDestroyShaderModule(context->logical_device, created, NULL);
+    } else {
+        if (cache->entries_count == cache->entries_capacity) {
+            cache->entries_capacity = (cache->entries_capacity) ? cache->entries_capacity * 2 : 16;
+            cache->entries = realloc(cache->entries, sizeof(VK_SHADER_CACHE_ENTRY) * cache->entries_capacity);
+        }
+
+        cache->entries[cache->entries_count++] = (VK_SHADER_CACHE_ENTRY) {
+            .hash       = hash,
+            .size       = size,
+            .code       = code,
+            .module     = *shader_module,
+            .references = 1
+        };
+        cache->misses++;
+
+        pthread_mutex_unlock(&cache->lock);
+
+        vk_record_init_stage(context, stage_name, start);
+        return true;
+    }
+
+    munmap((void *) code, size);
+    vk_record_init_stage(context, stage_name, start);
+    return true;
+}
+
+/** drops a reference taken by vk_load_shader_module, the module stays cached until trimmed */
+void
+vk_release_shader_module
+(
+    VK_CONTEXT *context,
+    VkShaderModule shader_module
+)
+{
+    VK_SHADER_CACHE *cache = &context->shader_cache;
+
+    if (!cache->enabled) {
+        vkDestroyShaderModule(context->logical_device, shader_module, NULL);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    for (uint32_t i = 0; i < cache->entries_count; i++) {
+        if (cache->entries[i].module != shader_module)
+            continue;
+
+        if (cache->entries[i].references)
+            cache->entries[i].references--;
+        break;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,198 @@
+#include "vkInit.h"
+#include "SDL2/SDL_vulkan.h"
+
+/** moves the current presentation resources onto the retired list */
+static void
+vk_retire_swapchain
+(
+    VK_CONTEXT *context
+)
+{
+    context->retired_swapchains = realloc(context->retired_swapchains, sizeof(VK_RETIRED_SWAPCHAIN) * (context->retired_swapchains_count + 1));
+    context->retired_swapchains[context->retired_swapchains_count++] = (VK_RETIRED_SWAPCHAIN) {
+        .frame_serial       = context->frame_serial,
+        .swapchain          = context->swapchain,
+        .image_count        = context->image_count,
+        .images             = context->images,
+        .image_views        = context->image_views,
+        .offscreen_targets  = context->offscreen_targets,
+        .framebuffers_count = context->framebuffers_count,
+        .framebuffers       = context->framebuffers,
+        .render_finished    = context->render_finished
+    };
+
+    /** the swapchain handle stays in the context so it can be passed as oldSwapchain */
+    context->image_count        = 0;
+    context->images             = NULL;
+    context->image_views        = NULL;
+    context->offscreen_targets  = NULL;
+    context->framebuffers_count = 0;
+    context->framebuffers       = NULL;
+    context->render_finished    = NULL;
+}
+
+static void
+vk_destroy_retired_swapchain
+(
+    VK_CONTEXT *context,
+    VK_RETIRED_SWAPCHAIN *retired
+)
+{
+    for (uint32_t i = 0; i < retired->framebuffers_count; i++)
+        vkDestroyFramebuffer(context->logical_device, retired->framebuffers[i], NULL);
+
+    for (uint32_t i = 0; i < retired->image_count; i++) {
+        vkDestroyImageView(context->logical_device, retired->image_views[i], NULL);
+        if (retired->offscreen_targets != NULL)
+            vk_destroy_image(context, &retired->offscreen_targets[i]);
+        if (retired->render_finished != NULL)
+            vkDestroySemaphore(context->logical_device, retired->render_finished[i], NULL);
+    }
+
+    if (retired->swapchain != VK_NULL_HANDLE)
+        vkDestroySwapchainKHR(context->logical_device, retired->swapchain, NULL);
+
+    free(retired->framebuffers);
+    free(retired->image_views);
+    free(retired->images);
+    free(retired->offscreen_targets);
+    free(retired->render_finished);
+}
+
+/**
+ * destroys retired swapchains whose frames have completed.
+ * frames are waited on round robin, so when frame n begins every submission
+ * up to n - frames_count has been waited on. with wait the device is idled first.
+ */
+void
+vk_collect_retired_swapchains
+(
+    VK_CONTEXT *context,
+    bool wait
+)
+{
+    if (context->retired_swapchains_count == 0)
+        return;
+
+    if (wait)
+        VK_CHECK(vkDeviceWaitIdle(context->logical_device));
+
+    uint64_t completed = (context->frame_serial >= context->frames_count) ? context->frame_serial - context->frames_count : 0;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < context->retired_swapchains_count; i++) {
+        VK_RETIRED_SWAPCHAIN *retired = &context->retired_swapchains[i];
+
+        if (!wait && retired->frame_serial > completed) {
+            context->retired_swapchains[kept++] = *retired;
+            continue;
+        }
+        vk_destroy_retired_swapchain(context, retired);
+    }
+
+    context->retired_swapchains_count = kept;
+    if (kept == 0) {
+        free(context->retired_swapchains);
+        context->retired_swapchains = NULL;
+    }
+}
+
+/**
+ * rebuilds the swapchain, image views and framebuffers for a new size, keeping the render pass and pipelines.
+ * windowed contexts take the size from the surface and pass the old swapchain through for the handover,
+ * headless contexts recreate their offscreen targets at extent.
+ * returns false if the window is minimised and nothing could be created.
+ */
+bool
+vk_recreate_swapchain
+(
+    VK_CONTEXT *context,
+    VkExtent2D extent
+)
+{
+    char msg[128];
+    uint64_t start = vk_get_time_ns();
+
+    if (!context->headless) {
+        int width, height;
+
+        SDL_Vulkan_GetDrawableSize(context->window, &width, &height);
+        if (width == 0 || height == 0)
+            return false;
+    } else if (extent.width == 0 || extent.height == 0) {
+        return false;
+    }
+
+    uint32_t old_count = context->image_count;
+
+    vk_retire_swapchain(context);
+
+    if (context->headless) {
+        vk_create_offscreen_targets(context, extent, context->swapchain_details.format.format, old_count);
+    } else {
+        VK_SWAPCHAIN_SUPPORT_DETAILS swapchain_details = context->swapchain_details;
+        swapchain_details.suggestion = true;
+
+        vk_create_swapchain(context, swapchain_details);
+        vk_create_image_views(context);
+    }
+
+    if (context->render_pass != VK_NULL_HANDLE)
+        vk_create_framebuffers(context);
+
+    /** images changed, forget which frame used the old ones, the old semaphores retire with the old swapchain */
+    if (context->frames != NULL) {
+        free(context->images_in_flight);
+        context->images_in_flight = calloc(context->image_count, sizeof(VkFence));
+
+        if (!context->headless) {
+            VkSemaphoreCreateInfo semaphore_create_info = {};
+            semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+            context->render_finished = calloc(context->image_count, sizeof(VkSemaphore));
+            for (uint32_t i = 0; i < context->image_count; i++)
+                VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &context->render_finished[i]));
+        }
+    }
+
+    context->swapchain_out_of_date = false;
+    context->resize_time = vk_get_time_ns() - start;
+
+    snprintf(msg, sizeof(msg), "Recreated Swapchain (%ux%u, %.3f ms)",
+             context->swapchain_details.extent.width, context->swapchain_details.extent.height,
+             context->resize_time / 1e6);
+    VK_LOG(LOG_INFO, msg);
+    return true;
+}
+
+/** destroys the framebuffers, image views and swapchain or offscreen targets, including retired ones */
+void
+vk_destroy_swapchain
+(
+    VK_CONTEXT *context
+)
+{
+    vk_collect_retired_swapchains(context, true);
+
+    for (uint32_t i = 0; i < context->framebuffers_count; i++)
+        vkDestroyFramebuffer(context->logical_device, context->framebuffers[i], NULL);
+    free(context->framebuffers);
+    context->framebuffers       = NULL;
+    context->framebuffers_count = 0;
+
+    if (context->headless) {
+        vk_destroy_offscreen_targets(context);
+        return;
+    }
+
+    for (uint32_t i = 0; i < context->image_count; i++)
+        vkDestroyImageView(context->logical_device, context->image_views[i], NULL);
+    vkDestroySwapchainKHR(context->logical_device, context->swapchain, NULL);
+
+    free(context->image_views);
+    free(context->images);
+    context->image_views = NULL;
+    context->images      = NULL;
+    context->image_count = 0;
+    context->swapchain   = VK_NULL_HANDLE;
+}
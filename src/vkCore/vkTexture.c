@@ -0,0 +1,767 @@
+#include "vkInit.h"
+
+/** KTX2 file header, followed by the level index */
+typedef struct VK_KTX2_HEADER {
+    uint8_t  identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+} VK_KTX2_HEADER;
+
+typedef struct VK_KTX2_LEVEL {
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+} VK_KTX2_LEVEL;
+
+/** a 2D image never has more levels than this */
+#define VK_TEXTURE_MAX_LEVELS 32
+
+/** stages that sample textures */
+#define VK_TEXTURE_SHADER_STAGES (VK_PIPELINE_STAGE_VERTEX_SHADER_BIT   | \
+                                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | \
+                                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+
+static const uint8_t vk_ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+static VkExtent3D
+vk_texture_level_extent
+(
+    const VK_TEXTURE *texture,
+    uint32_t level
+)
+{
+    uint32_t width  = texture->extent.width  >> level;
+    uint32_t height = texture->extent.height >> level;
+    return (VkExtent3D) { (width) ? width : 1, (height) ? height : 1, 1 };
+}
+
+/** runs in the first job, fills in everything the header and level index describe */
+static bool
+vk_read_texture_header
+(
+    VK_TEXTURE *texture,
+    FILE *file
+)
+{
+    VK_CONTEXT *context = texture->context;
+    VK_KTX2_HEADER header;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.identifier, vk_ktx2_identifier, sizeof(vk_ktx2_identifier))) {
+        VK_LOGF(LOG_WARNING, "vk", "Texture %s is not a KTX2 file", texture->filename);
+        return false;
+    }
+
+    if (header.supercompression_scheme != 0 || header.vk_format == VK_FORMAT_UNDEFINED) {
+        VK_LOGF(LOG_WARNING, "vk", "Texture %s is supercompressed, which is not supported", texture->filename);
+        return false;
+    }
+
+    if (header.pixel_width == 0 || header.pixel_depth > 1 || (header.face_count != 1 && header.face_count != 6) ||
+        header.level_count > VK_TEXTURE_MAX_LEVELS) {
+        VK_LOGF(LOG_WARNING, "vk", "Texture %s is not a 2D, array or cube texture", texture->filename);
+        return false;
+    }
+
+    uint32_t file_levels = (header.level_count) ? header.level_count : 1;
+    VK_KTX2_LEVEL levels[VK_TEXTURE_MAX_LEVELS];
+
+    if (fread(levels, sizeof(VK_KTX2_LEVEL), file_levels, file) != file_levels) {
+        VK_LOGF(LOG_WARNING, "vk", "Texture %s has a truncated level index", texture->filename);
+        return false;
+    }
+
+    texture->format       = (VkFormat) header.vk_format;
+    texture->extent       = (VkExtent2D) { header.pixel_width, (header.pixel_height) ? header.pixel_height : 1 };
+    texture->layers_count = ((header.layer_count) ? header.layer_count : 1) * header.face_count;
+    texture->cube         = header.face_count == 6;
+
+    uint32_t full_levels = 1;
+    while ((texture->extent.width | texture->extent.height) >> full_levels)
+        full_levels++;
+
+    /** a level count of 0 asks for the chain to be generated, which needs linear blits of the format */
+    if (header.level_count == 0 && full_levels > 1) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(context->physical_device, texture->format, &properties);
+
+        VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+        texture->generate_mips = (properties.optimalTilingFeatures & needed) == needed;
+        if (!texture->generate_mips)
+            VK_LOGF(LOG_WARNING, "vk", "Texture %s format can not be blitted, loading level 0 only", texture->filename);
+    }
+
+    texture->levels_count  = (texture->generate_mips) ? full_levels : file_levels;
+    texture->level_offsets = calloc(texture->levels_count, sizeof(uint64_t));
+    texture->level_bytes   = calloc(texture->levels_count, sizeof(VkDeviceSize));
+
+    for (uint32_t i = 0; i < texture->levels_count; i++) {
+        if (i < file_levels) {
+            texture->level_offsets[i] = levels[i].byte_offset;
+            texture->level_bytes[i]   = levels[i].byte_length;
+        } else {
+            /** generated levels only count towards the budget, a quarter of the level above is close enough */
+            texture->level_bytes[i] = (texture->level_bytes[i - 1] > 4) ? texture->level_bytes[i - 1] / 4 : 1;
+        }
+    }
+
+    /** one layer of a level is the largest single upload, levels beyond the staging ring are never streamed */
+    uint32_t uploaded = (texture->generate_mips) ? 1 : texture->levels_count;
+
+    texture->stream_limit = 0;
+    while (texture->stream_limit < uploaded &&
+           texture->level_bytes[texture->stream_limit] / texture->layers_count > context->uploader.size)
+        texture->stream_limit++;
+
+    if (texture->stream_limit == uploaded) {
+        VK_LOGF(LOG_WARNING, "vk", "Texture %s has no level that fits the staging ring", texture->filename);
+        return false;
+    }
+    if (texture->stream_limit > 0)
+        VK_LOGF(LOG_WARNING, "vk", "Texture %s streams from level %u, larger levels do not fit the staging ring",
+                texture->filename, texture->stream_limit);
+
+    texture->first_level = texture->levels_count;
+    return true;
+}
+
+/**
+ * uploads every layer of level into image_level of the pending image, a layer at a time if they do not fit
+ * the ring together. sets stalled and returns with upload_layer saved when the ring is full, so the job can resume.
+ */
+static bool
+vk_upload_texture_level
+(
+    VK_TEXTURE *texture,
+    FILE *file,
+    uint32_t level,
+    uint32_t image_level,
+    VkImageLayout final_layout,
+    bool *stalled
+)
+{
+    VK_CONTEXT *context = texture->context;
+    VkDeviceSize bytes  = texture->level_bytes[level];
+
+    bool     whole        = bytes <= context->uploader.size;
+    uint32_t layers       = (whole) ? texture->layers_count : 1;
+    uint32_t uploads      = (whole) ? 1 : texture->layers_count;
+    VkDeviceSize size     = bytes / uploads;
+    uint8_t *data         = malloc(size);
+
+    for (; texture->upload_layer < uploads; texture->upload_layer++) {
+        off_t offset = (off_t) (texture->level_offsets[level] + size * texture->upload_layer);
+
+        if (fseeko(file, offset, SEEK_SET) != 0 || fread(data, 1, size, file) != size) {
+            VK_LOGF(LOG_WARNING, "vk", "Could not read level %u of texture %s", level, texture->filename);
+            free(data);
+            return false;
+        }
+
+        VkImageSubresourceLayers subresource = {
+            .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel       = image_level,
+            .baseArrayLayer = texture->upload_layer,
+            .layerCount     = layers
+        };
+        if (!vk_try_upload_image(context, texture->pending_image.image, subresource, vk_texture_level_extent(texture, level),
+                                 data, size, final_layout)) {
+            *stalled = true;
+            break;
+        }
+    }
+
+    free(data);
+    return true;
+}
+
+static VkImageView
+vk_create_texture_view
+(
+    VK_TEXTURE *texture,
+    VkImage image,
+    uint32_t levels
+)
+{
+    VkImageViewType view_type = VK_IMAGE_VIEW_TYPE_2D;
+    if (texture->cube)
+        view_type = (texture->layers_count > 6) ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE;
+    else if (texture->layers_count > 1)
+        view_type = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+
+    VkImageViewCreateInfo create_info           = {};
+    create_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    create_info.image                           = image;
+    create_info.viewType                        = view_type;
+    create_info.format                          = texture->format;
+    create_info.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    create_info.subresourceRange.baseMipLevel   = 0;
+    create_info.subresourceRange.levelCount     = levels;
+    create_info.subresourceRange.baseArrayLayer = 0;
+    create_info.subresourceRange.layerCount     = texture->layers_count;
+
+    VkImageView view;
+    VK_CHECK(vkCreateImageView(texture->context->logical_device, &create_info, NULL, &view));
+    return view;
+}
+
+/**
+ * reads the header on the first run, creates an image for levels pending_level to levels_count
+ * and uploads the levels that are not resident yet. the resident ones are copied over by the frame thread.
+ * never waits for the staging ring, a full ring stalls the step and a later run picks up where it stopped.
+ */
+static void
+vk_texture_job
+(
+    void *data
+)
+{
+    VK_TEXTURE *texture = data;
+    VK_CONTEXT *context = texture->context;
+
+    FILE *file = fopen(texture->filename, "rb");
+    if (file == NULL) {
+        VK_LOGF(LOG_WARNING, "vk", "Could not open texture %s", texture->filename);
+        atomic_store(&texture->state, VK_TEXTURE_FAILED);
+        return;
+    }
+
+    if (texture->levels_count == 0 && !vk_read_texture_header(texture, file)) {
+        fclose(file);
+        atomic_store(&texture->state, VK_TEXTURE_FAILED);
+        return;
+    }
+
+    /** the first load takes every level up to VK_TEXTURE_TAIL_EXTENT */
+    if (texture->pending_level == UINT32_MAX) {
+        /** generated chains are blitted from level 0 and load whole, the frame thread reserves them first */
+        if (texture->generate_mips) {
+            fclose(file);
+            atomic_store(&texture->state, VK_TEXTURE_RESERVING);
+            return;
+        }
+
+        uint32_t level = texture->levels_count - 1;
+
+        while (level > texture->stream_limit) {
+            VkExtent3D extent = vk_texture_level_extent(texture, level - 1);
+            if (extent.width > VK_TEXTURE_TAIL_EXTENT || extent.height > VK_TEXTURE_TAIL_EXTENT)
+                break;
+            level--;
+        }
+        texture->pending_level = level;
+    }
+
+    uint32_t levels = texture->levels_count - texture->pending_level;
+
+    /** a stalled step already has its image */
+    if (texture->pending_image.image == VK_NULL_HANDLE) {
+        VkImageCreateInfo image_create_info = {};
+        image_create_info.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.flags         = (texture->cube) ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+        image_create_info.imageType     = VK_IMAGE_TYPE_2D;
+        image_create_info.format        = texture->format;
+        image_create_info.extent        = vk_texture_level_extent(texture, texture->pending_level);
+        image_create_info.mipLevels     = levels;
+        image_create_info.arrayLayers   = texture->layers_count;
+        image_create_info.samples       = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_create_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        vk_create_image(context, &image_create_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture->pending_image);
+        texture->upload_level = texture->pending_level;
+        texture->upload_layer = 0;
+    }
+
+    bool uploaded = true;
+    bool stalled  = false;
+    if (texture->generate_mips) {
+        /** level 0 stays a blit source for the rest of the chain */
+        uploaded = vk_upload_texture_level(texture, file, 0, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, &stalled);
+    } else {
+        for (; uploaded && texture->upload_level < texture->first_level; texture->upload_level++) {
+            uploaded = vk_upload_texture_level(texture, file, texture->upload_level, texture->upload_level - texture->pending_level,
+                                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &stalled);
+            if (stalled)
+                break;
+            texture->upload_layer = 0;
+        }
+    }
+    fclose(file);
+
+    /** the frame thread retires the image once the uploads already recorded are surely done */
+    if (!uploaded) {
+        atomic_store(&texture->state, VK_TEXTURE_FAILED);
+        return;
+    }
+
+    if (stalled) {
+        atomic_store(&texture->state, VK_TEXTURE_STALLED);
+        return;
+    }
+
+    texture->pending_view = vk_create_texture_view(texture, texture->pending_image.image, levels);
+    atomic_store(&texture->state, VK_TEXTURE_LOADED);
+}
+
+/** copies the resident levels into the larger image, shifted down by the levels the step added */
+static void
+vk_record_texture_copy
+(
+    VK_TEXTURE *texture,
+    VkCommandBuffer command_buffer
+)
+{
+    uint32_t shift  = texture->first_level - texture->pending_level;
+    uint32_t copied = texture->levels_count - texture->first_level;
+
+    VkImageMemoryBarrier barriers[2] = {};
+    for (uint32_t i = 0; i < 2; i++) {
+        barriers[i].sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barriers[i].srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        barriers[i].subresourceRange.levelCount     = copied;
+        barriers[i].subresourceRange.layerCount     = texture->layers_count;
+    }
+
+    /** earlier frames may still be sampling the old image, only their reads need to finish */
+    barriers[0].dstAccessMask                 = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].oldLayout                     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout                     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].image                         = texture->image.image;
+
+    barriers[1].dstAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].oldLayout                     = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout                     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].image                         = texture->pending_image.image;
+    barriers[1].subresourceRange.baseMipLevel = shift;
+
+    vkCmdPipelineBarrier(command_buffer, VK_TEXTURE_SHADER_STAGES, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 2, barriers);
+
+    VkImageCopy regions[VK_TEXTURE_MAX_LEVELS];
+    for (uint32_t i = 0; i < copied; i++) {
+        regions[i] = (VkImageCopy) {
+            .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, texture->layers_count },
+            .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i + shift, 0, texture->layers_count },
+            .extent         = vk_texture_level_extent(texture, texture->first_level + i)
+        };
+    }
+
+    vkCmdCopyImage(command_buffer, texture->image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   texture->pending_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copied, regions);
+
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[1].oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_TEXTURE_SHADER_STAGES, 0, 0, NULL, 0, NULL, 1, &barriers[1]);
+}
+
+/** blits every level from the one above, level 0 arrives as a transfer source */
+static void
+vk_record_texture_mips
+(
+    VK_TEXTURE *texture,
+    VkCommandBuffer command_buffer
+)
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.dstAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image                           = texture->pending_image.image;
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel   = 1;
+    barrier.subresourceRange.levelCount     = texture->levels_count - 1;
+    barrier.subresourceRange.layerCount     = texture->layers_count;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    for (uint32_t level = 1; level < texture->levels_count; level++) {
+        VkExtent3D src = vk_texture_level_extent(texture, level - 1);
+        VkExtent3D dst = vk_texture_level_extent(texture, level);
+
+        VkImageBlit blit = {
+            .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, texture->layers_count },
+            .srcOffsets     = { { 0, 0, 0 }, { (int32_t) src.width, (int32_t) src.height, 1 } },
+            .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, texture->layers_count },
+            .dstOffsets     = { { 0, 0, 0 }, { (int32_t) dst.width, (int32_t) dst.height, 1 } }
+        };
+
+        vkCmdBlitImage(command_buffer, texture->pending_image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       texture->pending_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        /** the level just written is the source of the next */
+        barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask                 = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout                     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout                     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.subresourceRange.baseMipLevel = level;
+        barrier.subresourceRange.levelCount   = 1;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+    }
+
+    barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask                 = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout                     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout                     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount   = texture->levels_count;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_TEXTURE_SHADER_STAGES, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+static void
+vk_retire_texture_image
+(
+    VK_TEXTURE_STREAMER *streamer,
+    uint64_t frame_serial,
+    VK_IMAGE image,
+    VkImageView view
+)
+{
+    if (streamer->retired_count == streamer->retired_capacity) {
+        streamer->retired_capacity = (streamer->retired_capacity) ? streamer->retired_capacity * 2 : 16;
+        streamer->retired = realloc(streamer->retired, sizeof(VK_RETIRED_TEXTURE) * streamer->retired_capacity);
+    }
+
+    streamer->retired[streamer->retired_count++] = (VK_RETIRED_TEXTURE) {
+        .frame_serial = frame_serial,
+        .image        = image,
+        .view         = view
+    };
+}
+
+/** destroys retired images whose frames have completed, same rule as vk_collect_retired_swapchains */
+static void
+vk_collect_retired_textures
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    bool wait
+)
+{
+    uint64_t completed = (context->frame_serial >= context->frames_count) ? context->frame_serial - context->frames_count : 0;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < streamer->retired_count; i++) {
+        VK_RETIRED_TEXTURE *retired = &streamer->retired[i];
+
+        if (!wait && retired->frame_serial > completed) {
+            streamer->retired[kept++] = *retired;
+            continue;
+        }
+        vkDestroyImageView(context->logical_device, retired->view, NULL);
+        vk_destroy_image(context, &retired->image);
+    }
+    streamer->retired_count = kept;
+}
+
+/** swaps in the image a job finished a frame ago, recording the copies or blits it still needs */
+static void
+vk_finish_texture_step
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    VK_TEXTURE *texture,
+    VkCommandBuffer command_buffer
+)
+{
+    if (texture->generate_mips && texture->levels_count > 1)
+        vk_record_texture_mips(texture, command_buffer);
+    else if (texture->image.image != VK_NULL_HANDLE)
+        vk_record_texture_copy(texture, command_buffer);
+
+    /** the copy above reads the old image, so it lives until this frame completes */
+    if (texture->image.image != VK_NULL_HANDLE) {
+        streamer->resident -= texture->image.allocation.size;
+        vk_retire_texture_image(streamer, context->frame_serial + 1, texture->image, texture->view);
+    }
+
+    texture->image       = texture->pending_image;
+    texture->view        = texture->pending_view;
+    texture->first_level = texture->pending_level;
+    texture->generation++;
+
+    streamer->resident += texture->image.allocation.size;
+    streamer->reserved -= texture->pending_bytes;
+
+    texture->pending_image = (VK_IMAGE) {};
+    texture->pending_view  = VK_NULL_HANDLE;
+    texture->pending_bytes = 0;
+
+    VK_LOGF(LOG_DEBUG, "vk", "Texture %s resident from level %u of %u (%.1f of %.1f MiB)",
+            texture->filename, texture->first_level, texture->levels_count,
+            streamer->resident / 1048576.0, streamer->budget / 1048576.0);
+
+    atomic_store(&texture->state, VK_TEXTURE_IDLE);
+}
+
+/** starts loading a generated chain once the budget has room for all of it, refuses chains larger than the budget */
+static uint32_t
+vk_reserve_texture_chain
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    VK_TEXTURE *texture
+)
+{
+    VkDeviceSize bytes = 0;
+    for (uint32_t i = 0; i < texture->levels_count; i++)
+        bytes += texture->level_bytes[i];
+
+    if (texture->unload || bytes > streamer->budget) {
+        if (!texture->unload)
+            VK_LOGF(LOG_WARNING, "vk", "Texture %s generates %.1f MiB of levels, more than the whole budget",
+                    texture->filename, bytes / 1048576.0);
+        atomic_store(&texture->state, VK_TEXTURE_FAILED);
+        return VK_TEXTURE_FAILED;
+    }
+
+    if (streamer->resident + streamer->reserved + bytes > streamer->budget)
+        return VK_TEXTURE_RESERVING;
+
+    streamer->reserved     += bytes;
+    texture->pending_bytes  = bytes;
+    texture->pending_level  = 0;
+    atomic_store(&texture->state, VK_TEXTURE_LOADING);
+
+    vk_submit_job(context, vk_texture_job, texture, &streamer->jobs);
+    return VK_TEXTURE_LOADING;
+}
+
+static void
+vk_free_texture
+(
+    VK_TEXTURE *texture
+)
+{
+    free(texture->level_offsets);
+    free(texture->level_bytes);
+    free(texture->filename);
+    free(texture);
+}
+
+/**
+ * textures are read, created and uploaded on the job system, the frame thread only records copies.
+ * resident texture memory is kept under budget bytes, except for the smallest levels of each texture.
+ * generated chains load whole and wait until the budget has room for them.
+ * needs vk_create_uploader, and vk_create_job_system or loads run on the calling thread.
+ */
+void
+vk_create_texture_streamer
+(
+    VK_CONTEXT *context,
+    VkDeviceSize budget,
+    VK_TEXTURE_STREAMER *streamer
+)
+{
+    if (context->uploader.size == 0) {
+        VK_LOG(LOG_ERROR, "Texture streaming requires vk_create_uploader");
+        exit(-1);
+    }
+
+    if (!context->jobs.enabled)
+        VK_LOG(LOG_WARNING, "No job system, textures load on the frame thread");
+
+    *streamer = (VK_TEXTURE_STREAMER) {
+        .budget = budget
+    };
+
+    VK_LOGF(LOG_INFO, "vk", "Created Texture Streamer (%.1f MiB budget)", budget / 1048576.0);
+}
+
+/** waits for the loading jobs and their uploads and idles the device */
+void
+vk_destroy_texture_streamer
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer
+)
+{
+    vk_wait_job_counter(context, &streamer->jobs);
+    vk_upload_wait_idle(context);
+    VK_CHECK(vkDeviceWaitIdle(context->logical_device));
+
+    for (uint32_t i = 0; i < streamer->textures_count; i++) {
+        VK_TEXTURE *texture = streamer->textures[i];
+
+        if (texture->pending_image.image != VK_NULL_HANDLE) {
+            vkDestroyImageView(context->logical_device, texture->pending_view, NULL);
+            vk_destroy_image(context, &texture->pending_image);
+        }
+        if (texture->image.image != VK_NULL_HANDLE) {
+            vkDestroyImageView(context->logical_device, texture->view, NULL);
+            vk_destroy_image(context, &texture->image);
+        }
+        vk_free_texture(texture);
+    }
+
+    vk_collect_retired_textures(context, streamer, true);
+
+    free(streamer->textures);
+    free(streamer->retired);
+    *streamer = (VK_TEXTURE_STREAMER) {};
+}
+
+/**
+ * starts loading a KTX2 file and returns at once, the texture has no view until its smallest levels
+ * are resident. more detailed levels follow from vk_update_texture_streamer. call from the frame thread.
+ */
+VK_TEXTURE *
+vk_load_texture
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    const char *filename
+)
+{
+    VK_TEXTURE *texture = calloc(1, sizeof(VK_TEXTURE));
+    texture->context       = context;
+    texture->filename      = strdup(filename);
+    texture->pending_level = UINT32_MAX;
+    atomic_init(&texture->state, VK_TEXTURE_LOADING);
+
+    if (streamer->textures_count == streamer->textures_capacity) {
+        streamer->textures_capacity = (streamer->textures_capacity) ? streamer->textures_capacity * 2 : 16;
+        streamer->textures = realloc(streamer->textures, sizeof(VK_TEXTURE *) * streamer->textures_capacity);
+    }
+    streamer->textures[streamer->textures_count++] = texture;
+
+    vk_submit_job(context, vk_texture_job, texture, &streamer->jobs);
+    return texture;
+}
+
+/** the texture is freed by a later vk_update_texture_streamer and must not be used after this */
+void
+vk_unload_texture
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    VK_TEXTURE *texture
+)
+{
+    (void) context;
+    (void) streamer;
+    texture->unload = true;
+}
+
+/**
+ * call once a frame after vk_begin_frame, before recording anything that samples the textures.
+ * swaps in finished steps, recording their copies into command_buffer outside a render pass,
+ * and streams in more detailed levels of the least detailed textures while the budget allows.
+ * a texture whose generation changed has a new view, write it into sets of this frame only,
+ * e.g. from vk_allocate_frame_descriptor_set, as earlier frames may still use the old one.
+ */
+void
+vk_update_texture_streamer
+(
+    VK_CONTEXT *context,
+    VK_TEXTURE_STREAMER *streamer,
+    VkCommandBuffer command_buffer
+)
+{
+    vk_collect_retired_textures(context, streamer, false);
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < streamer->textures_count; i++) {
+        VK_TEXTURE *texture = streamer->textures[i];
+        uint32_t state = atomic_load(&texture->state);
+
+        /** the job's uploads are acquired when the next frame begins, the image is used from then on */
+        if (state == VK_TEXTURE_LOADED) {
+            texture->acquire_serial = context->frame_serial;
+            atomic_store(&texture->state, VK_TEXTURE_ACQUIRING);
+        } else if (state == VK_TEXTURE_ACQUIRING && context->frame_serial > texture->acquire_serial) {
+            vk_finish_texture_step(context, streamer, texture, command_buffer);
+            state = VK_TEXTURE_IDLE;
+        } else if (state == VK_TEXTURE_STALLED) {
+            atomic_store(&texture->state, VK_TEXTURE_LOADING);
+            vk_submit_job(context, vk_texture_job, texture, &streamer->jobs);
+            state = VK_TEXTURE_LOADING;
+        } else if (state == VK_TEXTURE_RESERVING) {
+            state = vk_reserve_texture_chain(context, streamer, texture);
+        } else if (state == VK_TEXTURE_FAILED) {
+            streamer->reserved -= texture->pending_bytes;
+            texture->pending_bytes = 0;
+
+            /** uploads the job recorded are acquired by the next frame at the latest */
+            if (texture->pending_image.image != VK_NULL_HANDLE) {
+                vk_retire_texture_image(streamer, context->frame_serial + 2, texture->pending_image, VK_NULL_HANDLE);
+                texture->pending_image = (VK_IMAGE) {};
+            }
+        }
+
+        if (texture->unload && (state == VK_TEXTURE_IDLE || state == VK_TEXTURE_FAILED)) {
+            if (texture->image.image != VK_NULL_HANDLE) {
+                streamer->resident -= texture->image.allocation.size;
+                vk_retire_texture_image(streamer, context->frame_serial, texture->image, texture->view);
+            }
+            vk_free_texture(texture);
+            continue;
+        }
+        streamer->textures[kept++] = texture;
+    }
+    streamer->textures_count = kept;
+
+    /** the least detailed texture is refined first, one level per step */
+    for (uint32_t n = 0; n < VK_TEXTURE_STREAMS_PER_FRAME; n++) {
+        VK_TEXTURE *next = NULL;
+
+        for (uint32_t i = 0; i < streamer->textures_count; i++) {
+            VK_TEXTURE *texture = streamer->textures[i];
+
+            if (atomic_load(&texture->state) != VK_TEXTURE_IDLE || texture->unload || texture->generate_mips)
+                continue;
+            if (texture->first_level <= texture->stream_limit)
+                continue;
+            if (next == NULL || texture->first_level > next->first_level)
+                next = texture;
+        }
+
+        if (next == NULL)
+            break;
+
+        uint32_t level = next->first_level - 1;
+
+        VkDeviceSize bytes = 0;
+        for (uint32_t i = level; i < next->levels_count; i++)
+            bytes += next->level_bytes[i];
+
+        if (streamer->resident - next->image.allocation.size + streamer->reserved + bytes > streamer->budget)
+            break;
+
+        streamer->reserved  += bytes;
+        next->pending_bytes  = bytes;
+        next->pending_level  = level;
+        atomic_store(&next->state, VK_TEXTURE_LOADING);
+
+        vk_submit_job(context, vk_texture_job, next, &streamer->jobs);
+    }
+}
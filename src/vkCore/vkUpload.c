@@ -0,0 +1,606 @@
+#include "vkInit.h"
+
+/** staging offsets are kept 16 byte aligned, which satisfies the texel and 4 byte rules of image copies */
+#define VK_UPLOAD_ALIGNMENT 16
+
+/** stages that consume uploaded resources on the graphics queue */
+#define VK_UPLOAD_DST_STAGES (VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT   | \
+                              VK_PIPELINE_STAGE_VERTEX_INPUT_BIT    | \
+                              VK_PIPELINE_STAGE_VERTEX_SHADER_BIT   | \
+                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | \
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT  | \
+                              VK_PIPELINE_STAGE_TRANSFER_BIT)
+
+/** waits for a submitted batch and gives its staging memory back to the ring */
+static void
+vk_upload_retire
+(
+    VK_CONTEXT *context,
+    VK_UPLOAD_BATCH *batch
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+
+    if (uploader->scheduled) {
+        vk_scheduler_wait(context, uploader->role, batch->value);
+    } else {
+        VK_CHECK(vkWaitForFences(context->logical_device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+        VK_CHECK(vkResetFences(context->logical_device, 1, &batch->fence));
+    }
+
+    uploader->used   -= batch->ring_bytes;
+    batch->ring_bytes = 0;
+    batch->submitted  = false;
+
+    /** nobody waited on the semaphore, the copies are complete so replace it rather than leave it signaled */
+    if (batch->semaphore_pending) {
+        VkSemaphoreCreateInfo semaphore_create_info = {};
+        semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        vkDestroySemaphore(context->logical_device, batch->semaphore, NULL);
+        VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &batch->semaphore));
+        batch->semaphore_pending = false;
+    }
+
+    if (uploader->used == 0)
+        uploader->head = 0;
+}
+
+/** retires the oldest submitted batch, returns false if there is none or it is still running and wait is false */
+static bool
+vk_upload_retire_oldest
+(
+    VK_CONTEXT *context,
+    bool wait
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+
+    for (uint32_t i = 0; i < VK_UPLOAD_BATCHES; i++) {
+        VK_UPLOAD_BATCH *batch = &uploader->batches[(uploader->current_batch + i) % VK_UPLOAD_BATCHES];
+
+        if (!batch->submitted)
+            continue;
+
+        if (!wait && uploader->scheduled && vk_scheduler_completed(context, uploader->role) < batch->value)
+            return false;
+        if (!wait && !uploader->scheduled && vkGetFenceStatus(context->logical_device, batch->fence) != VK_SUCCESS)
+            return false;
+
+        vk_upload_retire(context, batch);
+        return true;
+    }
+    return false;
+}
+
+static void
+vk_upload_submit
+(
+    VK_CONTEXT *context
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+    VK_UPLOAD_BATCH *batch = &uploader->batches[uploader->current_batch];
+
+    if (!batch->recording)
+        return;
+
+    VK_CHECK(vkEndCommandBuffer(batch->command_buffer));
+
+    if (uploader->scheduled) {
+        batch->value = vk_scheduler_submit(context, uploader->role, batch->command_buffer, NULL, 0, batch->semaphore);
+        vk_scheduler_flush(context);
+    } else {
+        VkSubmitInfo submit_info = {};
+        submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount   = 1;
+        submit_info.pCommandBuffers      = &batch->command_buffer;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores    = &batch->semaphore;
+
+        VK_CHECK(vk_queue_submit(context, uploader->queue, 1, &submit_info, batch->fence));
+    }
+
+    batch->recording         = false;
+    batch->submitted         = true;
+    batch->semaphore_pending = true;
+
+    uploader->current_batch = (uploader->current_batch + 1) % VK_UPLOAD_BATCHES;
+}
+
+/** returns the command buffer of the batch being recorded, starting a new one if needed */
+static VkCommandBuffer
+vk_upload_begin
+(
+    VK_CONTEXT *context
+)
+{
+    VK_UPLOAD_BATCH *batch = &context->uploader.batches[context->uploader.current_batch];
+
+    if (batch->recording)
+        return batch->command_buffer;
+
+    /** slots are reused round robin, so a submitted slot is always the oldest in flight */
+    if (batch->submitted)
+        vk_upload_retire(context, batch);
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkResetCommandBuffer(batch->command_buffer, 0));
+    VK_CHECK(vkBeginCommandBuffer(batch->command_buffer, &begin_info));
+    batch->recording = true;
+
+    return batch->command_buffer;
+}
+
+/** reserves size bytes of the ring if they are free now, after handing back what the GPU is done with */
+static bool
+vk_upload_try_reserve
+(
+    VK_CONTEXT *context,
+    VkDeviceSize size,
+    VkDeviceSize *ring_bytes,
+    VkDeviceSize *offset
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+
+    while (vk_upload_retire_oldest(context, false));
+
+    VkDeviceSize aligned = (uploader->head + VK_UPLOAD_ALIGNMENT - 1) & ~(VkDeviceSize) (VK_UPLOAD_ALIGNMENT - 1);
+    VkDeviceSize needed  = aligned - uploader->head + size;
+
+    /** does not fit before the end, skip the remainder and wrap around */
+    if (aligned + size > uploader->size) {
+        aligned = 0;
+        needed  = uploader->size - uploader->head + size;
+    }
+
+    if (uploader->used + needed > uploader->size)
+        return false;
+
+    uploader->head  = aligned + size;
+    uploader->used += needed;
+    *ring_bytes     = needed;
+    *offset         = aligned;
+    return true;
+}
+
+/** reserves size bytes of the ring, retiring or submitting batches until they fit */
+static VkDeviceSize
+vk_upload_reserve
+(
+    VK_CONTEXT *context,
+    VkDeviceSize size,
+    VkDeviceSize *ring_bytes
+)
+{
+    VkDeviceSize offset;
+
+    if (size > context->uploader.size) {
+        VK_LOG(LOG_ERROR, "Upload larger than the staging ring");
+        exit(-1);
+    }
+
+    /** the ring is full of in flight copies, wait for the oldest or submit our own */
+    while (!vk_upload_try_reserve(context, size, ring_bytes, &offset)) {
+        if (!vk_upload_retire_oldest(context, true))
+            vk_upload_submit(context);
+    }
+    return offset;
+}
+
+/** grows a barrier array to fit one more element */
+#define VK_UPLOAD_PUSH_BARRIER(array, count, capacity, barrier)                 \
+    do {                                                                        \
+        if ((count) == (capacity)) {                                            \
+            (capacity) = (capacity) ? (capacity) * 2 : 16;                      \
+            (array)    = realloc((array), sizeof(*(array)) * (capacity));       \
+        }                                                                       \
+        (array)[(count)++] = (barrier);                                         \
+    } while(0)
+
+/** batches go through the scheduler if vk_create_scheduler ran first, it must then outlive the uploader */
+void
+vk_create_uploader
+(
+    VK_CONTEXT *context,
+    VkDeviceSize size
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+
+    /** buffer uploads stream in quarters of the ring, each needs at least one aligned slot */
+    if (size < 4 * VK_UPLOAD_ALIGNMENT) {
+        VK_LOGF(LOG_ERROR, "vk", "Staging ring of %llu bytes is too small, at least %d are needed",
+                (unsigned long long) size, 4 * VK_UPLOAD_ALIGNMENT);
+        exit(-1);
+    }
+
+    *uploader = (VK_UPLOADER) {};
+    pthread_mutex_init(&uploader->lock, NULL);
+
+    /** prefer the dedicated transfer queue, fall back to graphics which can always copy */
+    uint32_t role = (context->queue_families.found[TRANSFER]) ? TRANSFER : GRAPHICS;
+
+    uploader->size            = size;
+    uploader->queue           = context->queues[role];
+    uploader->role            = role;
+    uploader->family          = context->queue_families.indicies[role];
+    uploader->graphics_family = context->queue_families.indicies[GRAPHICS];
+    uploader->scheduled       = context->scheduler.enabled;
+
+    vk_create_buffer
+    (
+        context,
+        size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &uploader->staging
+    );
+
+    VkCommandPoolCreateInfo pool_create_info = {};
+    pool_create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_create_info.queueFamilyIndex = uploader->family;
+
+    VK_CHECK(vkCreateCommandPool(context->logical_device, &pool_create_info, NULL, &uploader->command_pool));
+
+    VkCommandBuffer command_buffers[VK_UPLOAD_BATCHES];
+
+    VkCommandBufferAllocateInfo allocate_info = {};
+    allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool        = uploader->command_pool;
+    allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = VK_UPLOAD_BATCHES;
+
+    VK_CHECK(vkAllocateCommandBuffers(context->logical_device, &allocate_info, command_buffers));
+
+    VkFenceCreateInfo fence_create_info = {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkSemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < VK_UPLOAD_BATCHES; i++) {
+        VK_UPLOAD_BATCH *batch = &uploader->batches[i];
+
+        batch->command_buffer = command_buffers[i];
+        if (!uploader->scheduled)
+            VK_CHECK(vkCreateFence(context->logical_device, &fence_create_info, NULL, &batch->fence));
+        VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &batch->semaphore));
+    }
+    VK_LOG(LOG_INFO, "Created Uploader");
+}
+
+void
+vk_destroy_uploader
+(
+    VK_CONTEXT *context
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+
+    if (uploader->size == 0)
+        return;
+
+    vk_upload_wait_idle(context);
+
+    for (uint32_t i = 0; i < VK_UPLOAD_BATCHES; i++) {
+        vkDestroySemaphore(context->logical_device, uploader->batches[i].semaphore, NULL);
+        vkDestroyFence(context->logical_device, uploader->batches[i].fence, NULL);
+    }
+    for (uint32_t i = 0; i < uploader->handed_count; i++)
+        vkDestroySemaphore(context->logical_device, uploader->handed[i].semaphore, NULL);
+    vkDestroyCommandPool(context->logical_device, uploader->command_pool, NULL);
+    vk_destroy_buffer(context, &uploader->staging);
+
+    free(uploader->buffer_barriers);
+    free(uploader->image_barriers);
+    free(uploader->handed);
+    pthread_mutex_destroy(&uploader->lock);
+
+    *uploader = (VK_UPLOADER) {};
+}
+
+void
+vk_upload_buffer
+(
+    VK_CONTEXT *context,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    const void *data,
+    VkDeviceSize size
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+
+    /** large buffers are streamed through the ring in chunks so they never need all of it */
+    VkDeviceSize chunk_size = uploader->size / 4;
+
+    pthread_mutex_lock(&uploader->lock);
+    for (VkDeviceSize done = 0; done < size; done += chunk_size) {
+        VkDeviceSize chunk = (size - done < chunk_size) ? size - done : chunk_size;
+        VkDeviceSize ring_bytes;
+        VkDeviceSize staging_offset = vk_upload_reserve(context, chunk, &ring_bytes);
+
+        memcpy((uint8_t *) uploader->staging.allocation.mapped + staging_offset, (const uint8_t *) data + done, chunk);
+
+        VkCommandBuffer command_buffer = vk_upload_begin(context);
+        uploader->batches[uploader->current_batch].ring_bytes += ring_bytes;
+
+        VkBufferCopy region = {};
+        region.srcOffset = staging_offset;
+        region.dstOffset = offset + done;
+        region.size      = chunk;
+
+        vkCmdCopyBuffer(command_buffer, uploader->staging.buffer, buffer, 1, &region);
+
+        if (uploader->family == uploader->graphics_family)
+            continue;
+
+        /** release to the graphics family, the matching acquire is recorded by vk_upload_acquire */
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask       = 0;
+        barrier.srcQueueFamilyIndex = uploader->family;
+        barrier.dstQueueFamilyIndex = uploader->graphics_family;
+        barrier.buffer              = buffer;
+        barrier.offset              = offset + done;
+        barrier.size                = chunk;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        VK_UPLOAD_PUSH_BARRIER(uploader->buffer_barriers, uploader->buffer_barriers_count, uploader->buffer_barriers_capacity, barrier);
+    }
+    pthread_mutex_unlock(&uploader->lock);
+}
+
+/** copies data into the reserved staging bytes and records the copy, must be called with the lock held */
+static void
+vk_upload_image_reserved
+(
+    VK_CONTEXT *context,
+    VkImage image,
+    VkImageSubresourceLayers subresource,
+    VkExtent3D extent,
+    const void *data,
+    VkDeviceSize size,
+    VkImageLayout final_layout,
+    VkDeviceSize staging_offset,
+    VkDeviceSize ring_bytes
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+    bool ownership_transfer = uploader->family != uploader->graphics_family;
+
+    memcpy((uint8_t *) uploader->staging.allocation.mapped + staging_offset, data, size);
+
+    VkCommandBuffer command_buffer = vk_upload_begin(context);
+    uploader->batches[uploader->current_batch].ring_bytes += ring_bytes;
+
+    /** the whole subresource is overwritten so its previous contents can be discarded */
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask                   = 0;
+    barrier.dstAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image                           = image;
+    barrier.subresourceRange.aspectMask     = subresource.aspectMask;
+    barrier.subresourceRange.baseMipLevel   = subresource.mipLevel;
+    barrier.subresourceRange.levelCount     = 1;
+    barrier.subresourceRange.baseArrayLayer = subresource.baseArrayLayer;
+    barrier.subresourceRange.layerCount     = subresource.layerCount;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset     = staging_offset;
+    region.imageSubresource = subresource;
+    region.imageExtent      = extent;
+
+    vkCmdCopyBufferToImage(command_buffer, uploader->staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    /** transition to the final layout, releasing ownership to the graphics family if it differs */
+    barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask       = 0;
+    barrier.oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout           = final_layout;
+    barrier.srcQueueFamilyIndex = (ownership_transfer) ? uploader->family          : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = (ownership_transfer) ? uploader->graphics_family : VK_QUEUE_FAMILY_IGNORED;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    if (ownership_transfer) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        VK_UPLOAD_PUSH_BARRIER(uploader->image_barriers, uploader->image_barriers_count, uploader->image_barriers_capacity, barrier);
+    }
+}
+
+void
+vk_upload_image
+(
+    VK_CONTEXT *context,
+    VkImage image,
+    VkImageSubresourceLayers subresource,
+    VkExtent3D extent,
+    const void *data,
+    VkDeviceSize size,
+    VkImageLayout final_layout
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+
+    pthread_mutex_lock(&uploader->lock);
+
+    VkDeviceSize ring_bytes;
+    VkDeviceSize staging_offset = vk_upload_reserve(context, size, &ring_bytes);
+
+    vk_upload_image_reserved(context, image, subresource, extent, data, size, final_layout, staging_offset, ring_bytes);
+    pthread_mutex_unlock(&uploader->lock);
+}
+
+/**
+ * vk_upload_image that never waits on the GPU, so the lock is only held for the copy into the ring.
+ * returns false without uploading when the ring or the next batch is still in flight, the recorded
+ * copies are submitted so a later attempt finds room. meant for loading jobs that retry later.
+ */
+bool
+vk_try_upload_image
+(
+    VK_CONTEXT *context,
+    VkImage image,
+    VkImageSubresourceLayers subresource,
+    VkExtent3D extent,
+    const void *data,
+    VkDeviceSize size,
+    VkImageLayout final_layout
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+    VkDeviceSize ring_bytes;
+    VkDeviceSize staging_offset;
+
+    if (size > uploader->size) {
+        VK_LOG(LOG_ERROR, "Upload larger than the staging ring");
+        exit(-1);
+    }
+
+    pthread_mutex_lock(&uploader->lock);
+
+    /** starting a batch whose slot is still in flight would wait on its fence */
+    while (vk_upload_retire_oldest(context, false));
+    VK_UPLOAD_BATCH *batch = &uploader->batches[uploader->current_batch];
+
+    if ((!batch->recording && batch->submitted) || !vk_upload_try_reserve(context, size, &ring_bytes, &staging_offset)) {
+        vk_upload_submit(context);
+        pthread_mutex_unlock(&uploader->lock);
+        return false;
+    }
+
+    vk_upload_image_reserved(context, image, subresource, extent, data, size, final_layout, staging_offset, ring_bytes);
+    pthread_mutex_unlock(&uploader->lock);
+    return true;
+}
+
+void
+vk_upload_flush
+(
+    VK_CONTEXT *context
+)
+{
+    pthread_mutex_lock(&context->uploader.lock);
+    vk_upload_submit(context);
+    pthread_mutex_unlock(&context->uploader.lock);
+}
+
+/**
+ * hands semaphore to the frame being recorded and returns the one its batch slot uses from now on.
+ * a worker may reuse the slot before the frame is submitted, which must not signal a semaphore still
+ * waiting for its wait, so the slot gets a semaphore whose frame has completed or a new one.
+ */
+static VkSemaphore
+vk_upload_hand_semaphore
+(
+    VK_CONTEXT *context,
+    VkSemaphore semaphore
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+    uint64_t completed = (context->frame_serial >= context->frames_count) ? context->frame_serial - context->frames_count : 0;
+    uint64_t serial    = context->frame_serial + 1;
+
+    for (uint32_t i = 0; i < uploader->handed_count; i++) {
+        VK_UPLOAD_HANDED_SEMAPHORE *handed = &uploader->handed[i];
+
+        if (handed->frame_serial > completed)
+            continue;
+
+        VkSemaphore replacement = handed->semaphore;
+        *handed = (VK_UPLOAD_HANDED_SEMAPHORE) { semaphore, serial };
+        return replacement;
+    }
+
+    if (uploader->handed_count == uploader->handed_capacity) {
+        uploader->handed_capacity = (uploader->handed_capacity) ? uploader->handed_capacity * 2 : 8;
+        uploader->handed = realloc(uploader->handed, sizeof(VK_UPLOAD_HANDED_SEMAPHORE) * uploader->handed_capacity);
+    }
+    uploader->handed[uploader->handed_count++] = (VK_UPLOAD_HANDED_SEMAPHORE) { semaphore, serial };
+
+    VkSemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkSemaphore replacement;
+    VK_CHECK(vkCreateSemaphore(context->logical_device, &semaphore_create_info, NULL, &replacement));
+    return replacement;
+}
+
+uint32_t
+vk_upload_acquire
+(
+    VK_CONTEXT *context,
+    VkCommandBuffer command_buffer,
+    VkSemaphore semaphores[VK_UPLOAD_BATCHES],
+    VkPipelineStageFlags stages[VK_UPLOAD_BATCHES]
+)
+{
+    VK_UPLOADER *uploader = &context->uploader;
+    uint32_t count = 0;
+
+    pthread_mutex_lock(&uploader->lock);
+
+    /** an acquire must never run ahead of its release, so submit whatever is still being recorded */
+    vk_upload_submit(context);
+
+    if (uploader->buffer_barriers_count || uploader->image_barriers_count) {
+        vkCmdPipelineBarrier
+        (
+            command_buffer,
+            VK_UPLOAD_DST_STAGES,
+            VK_UPLOAD_DST_STAGES,
+            0,
+            0, NULL,
+            uploader->buffer_barriers_count, uploader->buffer_barriers,
+            uploader->image_barriers_count, uploader->image_barriers
+        );
+        uploader->buffer_barriers_count = 0;
+        uploader->image_barriers_count  = 0;
+    }
+
+    for (uint32_t i = 0; i < VK_UPLOAD_BATCHES; i++) {
+        VK_UPLOAD_BATCH *batch = &uploader->batches[i];
+
+        if (!batch->semaphore_pending)
+            continue;
+
+        semaphores[count] = batch->semaphore;
+        stages[count]     = VK_UPLOAD_DST_STAGES;
+        batch->semaphore  = vk_upload_hand_semaphore(context, batch->semaphore);
+        batch->semaphore_pending = false;
+        count++;
+    }
+    pthread_mutex_unlock(&uploader->lock);
+
+    return count;
+}
+
+void
+vk_upload_wait_idle
+(
+    VK_CONTEXT *context
+)
+{
+    pthread_mutex_lock(&context->uploader.lock);
+    vk_upload_submit(context);
+    while (vk_upload_retire_oldest(context, true));
+    pthread_mutex_unlock(&context->uploader.lock);
+}
@@ -7,12 +7,33 @@
 #define W 640
 #define H 480
 
-int main(void) {
+#define FRAMES_IN_FLIGHT 2
+#define HEADLESS_FRAMES  3
+
+/** writes a tightly packed RGBA8 image as a binary PPM */
+static void write_ppm(const char *filename, const uint8_t *pixels, uint32_t width, uint32_t height) {
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        VK_LOG(LOG_WARNING, "Could not open image file for writing");
+        return;
+    }
+
+    fprintf(f, "P6\n%u %u\n255\n", width, height);
+    for (uint32_t i = 0; i < width * height; i++)
+        fwrite(&pixels[i * 4], 1, 3, f);
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    /** --headless renders a few frames offscreen and writes the last one to frame.ppm */
+    bool headless = argc > 1 && !strcmp(argv[1], "--headless");
+
     /** context specification */
     VK_CONTEXT ctx                                    = {};
     VK_DEVICE_SPECIFICATION device_specification      = {};
     VK_SWAPCHAIN_SUPPORT_DETAILS swapchain_details    = {};
     VK_SUBPASS_SPECIFICATION subpass_specification    = {};
+    VK_SUBPASS_DEPENDENCY_SPECIFICATION subpass_dependency_specification = {};
     VK_PIPELINE_SPECIFICATION pipeline_specification  = {};
 
     VK_ATTACHMENT_COLOR_BLEND_SPECIFICATION attachment_color_blend_specification = {};
@@ -23,7 +44,6 @@ int main(void) {
     const char **required_instance_extensions;
     const char *required_device_extensions[] = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-        VK_EXT_DEBUG_UTILS_EXTENSION_NAME
     };
     const char *required_layers[] = {
         "VK_LAYER_KHRONOS_validation",
@@ -33,18 +53,31 @@ int main(void) {
         "shaders/triangle.frag.spv",
     };
     uint32_t required_instance_extension_count = 0;
-    uint32_t required_device_extension_count   = 1;
+    uint32_t required_device_extension_count   = (headless) ? 0 : 1;
     uint32_t required_layer_count              = 1;
     uint32_t shader_files_count                = 2;
+    VK_JOB_COUNTER shader_counter              = {};
     
-    /** SDL context definition */
-    SDL_Init(SDL_INIT_VIDEO);
-    ctx.window = SDL_CreateWindow("example app", X, Y, W, H, SDL_WINDOW_VULKAN);
-    SDL_CHECK(SDL_Vulkan_GetInstanceExtensions(ctx.window, &required_instance_extension_count, NULL));
-    required_instance_extensions = malloc(sizeof(char *) * required_instance_extension_count);
-    SDL_CHECK(SDL_Vulkan_GetInstanceExtensions(ctx.window, &required_instance_extension_count, required_instance_extensions));
+    /** SDL context definition, headless runs need no window or surface extensions */
+    required_instance_extensions = NULL;
+    if (!headless) {
+        SDL_Init(SDL_INIT_VIDEO);
+        ctx.window = SDL_CreateWindow("example app", X, Y, W, H, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+        SDL_CHECK(SDL_Vulkan_GetInstanceExtensions(ctx.window, &required_instance_extension_count, NULL));
+        required_instance_extensions = malloc(sizeof(char *) * required_instance_extension_count);
+        SDL_CHECK(SDL_Vulkan_GetInstanceExtensions(ctx.window, &required_instance_extension_count, required_instance_extensions));
+    }
+    /* debug utils routes the validation messages into the log */
+    required_instance_extensions = realloc(required_instance_extensions, sizeof(char *) * (required_instance_extension_count + 1));
+    required_instance_extensions[required_instance_extension_count++] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
     
     /***** vulkan context creation *****/
+    /* buffer log records per thread and write them from a background thread */
+    vk_create_logger(NULL, NULL);
+    /* worker threads for asset loading and pipeline compilation, one per CPU */
+    vk_create_job_system(&ctx, 0);
+    /* read the shader files while the instance and device are created */
+    vk_prefetch_shader_files(&ctx, shader_files, shader_files_count, &shader_counter);
     /* create the instance */
     vk_create_instance
     (
@@ -56,11 +89,14 @@ int main(void) {
          required_instance_extension_count, 
          required_layer_count
     );
+    vk_create_debug_messenger(&ctx);
     /* create the surface */
-    vk_create_surface(&ctx);
+    if (!headless)
+        vk_create_surface(&ctx);
     /* specify the device characteristics */
     device_specification = (VK_DEVICE_SPECIFICATION) {
         .supported_types[VK_PHYSICAL_DEVICE_TYPE_CPU] = 1,
+        .scored = true,
     };
     /* select a device per your specifications */
     vk_select_physical_device
@@ -79,19 +115,33 @@ int main(void) {
     );
     /* create the device queues */
     vk_create_queues(&ctx);
+    /* create the device memory allocator with the default block size */
+    vk_create_allocator(&ctx, 0);
+    /* load the pipeline cache from a previous run, if any */
+    vk_create_pipeline_cache(&ctx, "pipeline_cache.bin");
+    /* share shader modules between pipelines */
+    vk_create_shader_cache(&ctx);
+    /* create the shader modules while the swapchain and render pass are set up */
+    vk_wait_job_counter(&ctx, &shader_counter);
+    vk_preload_shader_modules(&ctx, shader_files, shader_files_count, &shader_counter);
     /* specify the swapchain details */
     swapchain_details = (VK_SWAPCHAIN_SUPPORT_DETAILS) {
         .present_mode = VK_PRESENT_MODE_FIFO_KHR,
         .suggestion = true,
     };
-    /* create the swapchain */
-    vk_create_swapchain
-    (
-         &ctx,
-         swapchain_details
-    );
-    /* create the image views */
-    vk_create_image_views(&ctx);
+    if (headless) {
+        /* create device local render targets in place of the swapchain images */
+        vk_create_offscreen_targets(&ctx, (VkExtent2D) { W, H }, VK_FORMAT_R8G8B8A8_UNORM, 1);
+    } else {
+        /* create the swapchain */
+        vk_create_swapchain
+        (
+             &ctx,
+             swapchain_details
+        );
+        /* create the image views */
+        vk_create_image_views(&ctx);
+    }
     /* specify the pipeline specifications */
     pipeline_specification = (VK_PIPELINE_SPECIFICATION) {
         /** vertex descriptions */
@@ -105,13 +155,18 @@ int main(void) {
         .primitive_restart_enable = VK_FALSE,
 
         /** viewport */
-        .x      = X,
-        .y      = Y,
-        .width  = W,
-        .height = H,
+        .x         = X,
+        .y         = Y,
+        .width     = W,
+        .height    = H,
+        .min_depth = 0.0f,
+        .max_depth = 1.0f,
 
         /** scissor */
-        .scissor = {},
+        .scissor = { .offset = { X, Y }, .extent = { W, H } },
+
+        /** viewport and scissor are set every frame so the pipeline survives resizes */
+        .dynamic_viewport = VK_TRUE,
 
         /** rasterizer */
         .depth_clamp_enable         = VK_FALSE,
@@ -155,7 +210,7 @@ int main(void) {
         .stencil_load_op  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencil_store_op = VK_ATTACHMENT_STORE_OP_DONT_CARE,
         .initial_layout   = VK_IMAGE_LAYOUT_UNDEFINED,
-        .final_layout     = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+        .final_layout     = (headless) ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
     };
     /* create and add to the pipeline specifications */
     vk_create_attachment_description
@@ -198,7 +253,24 @@ int main(void) {
         &pipeline_specification,
         subpass_specification
     );
-    /* create the pipeline */
+    /** REPEAT: create zero or more subpass dependencies by re-specifying and calling the creation function */
+    /* make the first subpass wait for the swapchain image to be acquired before writing to it */
+    subpass_dependency_specification = (VK_SUBPASS_DEPENDENCY_SPECIFICATION) {
+        .src_subpass     = VK_SUBPASS_EXTERNAL,
+        .dst_subpass     = 0,
+        .src_stage_mask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .dst_stage_mask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .src_access_mask = 0,
+        .dst_access_mask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    };
+    /* create and add subpass dependency to pipeline specifications */
+    vk_create_subpass_dependency
+    (
+        &pipeline_specification,
+        subpass_dependency_specification
+    );
+    /* create the pipeline, its shader modules come from the cache */
+    vk_wait_job_counter(&ctx, &shader_counter);
     vk_create_pipeline
     (
         &ctx,
@@ -207,22 +279,104 @@ int main(void) {
         shader_files_count
     );
     vk_create_framebuffers(&ctx);
+    /* create the per frame command buffers and synchronisation objects */
+    vk_create_frames(&ctx, FRAMES_IN_FLIGHT);
+    /* GPU and CPU scope timings, written as a Chrome trace */
+    vk_create_profiler(&ctx, "trace.json");
+    /* timings of every startup stage so far, for tracking startup time between commits */
+    vk_write_init_report(&ctx, "init_report.json");
     /***** application code *****/
+    bool running = true;
+    uint32_t frame_count = 0;
+    while (running) {
+        SDL_Event event;
+        while (!headless && SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT)
+                running = false;
+            /* the swapchain is recreated when the next frame begins */
+            if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                ctx.swapchain_out_of_date = true;
+        }
+
+        if (headless && frame_count++ == HEADLESS_FRAMES)
+            break;
+
+        /** exercise the resize path, the resize time is logged */
+        if (headless && frame_count == HEADLESS_FRAMES)
+            vk_recreate_swapchain(&ctx, (VkExtent2D) { W / 2, H / 2 });
+
+        VkCommandBuffer cmd = vk_begin_frame(&ctx);
+        if (cmd == VK_NULL_HANDLE)
+            continue;
+
+        /* CPU only scope around the recording, the pass scope nests inside it */
+        vk_profile_begin(&ctx, VK_NULL_HANDLE, "record");
+
+        VkClearValue clear_value = { .color = { .float32 = { 0.0f, 0.0f, 0.0f, 1.0f } } };
+
+        VkRenderPassBeginInfo render_pass_begin_info = {};
+        render_pass_begin_info.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_begin_info.renderPass        = ctx.render_pass;
+        render_pass_begin_info.framebuffer       = ctx.framebuffers[ctx.image_index];
+        render_pass_begin_info.renderArea.extent = ctx.swapchain_details.extent;
+        render_pass_begin_info.clearValueCount   = 1;
+        render_pass_begin_info.pClearValues      = &clear_value;
+
+        vk_profile_begin(&ctx, cmd, "main pass");
+        vkCmdBeginRenderPass(cmd, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.pipeline);
+
+        VkViewport viewport = {
+            .width    = ctx.swapchain_details.extent.width,
+            .height   = ctx.swapchain_details.extent.height,
+            .maxDepth = 1.0f
+        };
+        VkRect2D scissor = { .extent = ctx.swapchain_details.extent };
+
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+        vkCmdDraw(cmd, 3, 1, 0, 0);
+        vkCmdEndRenderPass(cmd);
+        vk_profile_end(&ctx, cmd);
+        vk_profile_end(&ctx, VK_NULL_HANDLE);
+
+        vk_end_frame(&ctx);
+    }
+
+    if (headless) {
+        uint8_t *pixels = malloc(vk_get_offscreen_target_size(&ctx));
+
+        vk_read_offscreen_target(&ctx, ctx.image_index, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pixels);
+        write_ppm("frame.ppm", pixels, ctx.swapchain_details.extent.width, ctx.swapchain_details.extent.height);
+        free(pixels);
+    }
 
 
     /***** context cleanup *****/
-    for (uint32_t i = 0; i < ctx.framebuffers_count; i++)
-        vkDestroyFramebuffer(ctx.logical_device, ctx.framebuffers[i], NULL);
+    vk_destroy_profiler(&ctx);
+    vk_destroy_init_report(&ctx);
+    vk_destroy_frames(&ctx);
     vkDestroyPipeline(ctx.logical_device, ctx.pipeline, NULL);
-    vkDestroyRenderPass(ctx.logical_device, ctx.render_pass, NULL);
-    vkDestroyPipelineLayout(ctx.logical_device, ctx.pipeline_layout, NULL);
-    for (uint32_t i = 0; i < ctx.image_count; i++)
-        vkDestroyImageView(ctx.logical_device, ctx.image_views[i], NULL);
-    vkDestroySwapchainKHR(ctx.logical_device, ctx.swapchain, NULL);
+    vk_destroy_shader_cache(&ctx);
+    vk_destroy_pipeline_cache(&ctx);
+    vk_release_render_pass(&ctx, ctx.render_pass);
+    vk_release_pipeline_layout(&ctx, ctx.pipeline_layout);
+    /* destroys framebuffers, image views and the swapchain or offscreen targets */
+    vk_destroy_swapchain(&ctx);
+    vk_destroy_allocator(&ctx);
+    vk_destroy_object_cache(&ctx);
+    /* logs how busy each worker was */
+    vk_destroy_job_system(&ctx);
+    vk_destroy_queues(&ctx);
     vkDestroyDevice(ctx.logical_device, NULL);
-    vkDestroySurfaceKHR(ctx.instance, ctx.surface, NULL);
+    if (!headless)
+        vkDestroySurfaceKHR(ctx.instance, ctx.surface, NULL);
+    vk_destroy_debug_messenger(&ctx);
     vkDestroyInstance(ctx.instance, NULL);
     free(required_instance_extensions);
-    SDL_DestroyWindow(ctx.window);
-    SDL_Quit();
+    if (!headless) {
+        SDL_DestroyWindow(ctx.window);
+        SDL_Quit();
+    }
+    vk_destroy_logger();
 }
@@ -0,0 +1,23 @@
+#version 450
+
+// the culler draws object i with firstInstance i
+layout(std430, set = 0, binding = 0) readonly buffer Transforms { mat4 transforms[]; };
+
+layout(location = 0) out vec3 fragColor;
+
+vec2 positions[3] = vec2[](
+    vec2( 0.0, -0.5),
+    vec2( 0.5,  0.5),
+    vec2(-0.5,  0.5)
+);
+
+vec3 colors[3] = vec3[] (
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+void main() {
+    gl_Position = transforms[gl_InstanceIndex] * vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    fragColor  = colors[gl_VertexIndex];
+}